@@ -4,10 +4,15 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#define AUDIO_PATTERN_SIZE 16 /* XO-CHIP audio pattern buffer, 128 1-bit samples. */
+
 int8_t audio_init(void); /* Create audio specification and open device. */
 void audio_quit(void);	 /* Close audio device. */
 
 /* Pause or unpause audio */
 void audio_pause(bool pause);
 
+/* Load the 16 bytes pattern buffer and the pitch used for playback. */
+void audio_set_pattern(const uint8_t *pattern, uint8_t pitch);
+
 #endif /* _AUDIO_H_ */
@@ -0,0 +1,76 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "cpu.h"
+#include "gfx.h"
+
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BATCH_MAX_THREADS 64
+
+/* Observation of an environment, the screen planes with the layout of the cpu. */
+typedef gfx_plane_t batch_observation_t[GFX_PLANES];
+
+/* Reward of the frame just stepped, data is given to batch_set_reward. */
+typedef float (*batch_reward_t)(const cpu_t *cpu, void *data);
+
+typedef struct batch batch_t;
+
+/* Environments stepped by a thread, the first slice is stepped by the caller. */
+typedef struct {
+	batch_t *batch;
+	uint32_t first;
+	uint32_t last; /* One past the last environment. */
+	SDL_Thread *thread;
+	SDL_sem *start; /* Posted once per step, so the slice is stepped once. */
+} batch_worker_t;
+
+/* Many environments running the same program, stepped one frame (timer tick) at a
+ * time with an action per environment. Everything is allocated once in an arena:
+ * the cpus, and the arrays of actions, observations, rewards and done flags,
+ * which are contiguous so they can be used as tensors without copies.
+ * Environments are stepped in parallel by a thread per processor.
+ */
+struct batch {
+	uint32_t count;
+	void *arena;
+	cpu_t initial; /* Episodes start from this state. */
+	cpu_t *cpus;
+
+	uint16_t *actions; /* Keypad state of each environment, one bit per key. */
+	batch_observation_t *observations;
+	float *rewards;
+	uint8_t *dones; /* Set when the episode ended, the environment is reset. */
+
+	batch_reward_t reward;
+	void *reward_data;
+
+	bool use_lanes; /* Step the environments in lockstep, with lanes_step_tick. */
+	/* Ticks left to step each cpu of the lanes starting at an environment, as too many
+	 * of their instructions were not done by vectors.
+	 */
+	uint8_t *scalar_ticks;
+
+	batch_worker_t workers[BATCH_MAX_THREADS];
+	uint8_t workers_count;
+	SDL_sem *finish;
+	SDL_atomic_t is_running;
+};
+
+/* Create count environments starting from the cpu state, sharing its rom. */
+int8_t batch_init(batch_t *batch, const cpu_t *cpu, uint32_t count);
+void batch_quit(batch_t *batch);
+
+/* Called for each environment after each step, rewards are 0 without it. */
+void batch_set_reward(batch_t *batch, batch_reward_t reward, void *data);
+
+/* Step every environment by one frame with its action, then write its observation,
+ * reward and done flag. Ended episodes are reset after their observation is written.
+ */
+void batch_step(batch_t *batch);
+void batch_reset(batch_t *batch); /* Start a new episode in every environment. */
+
+#endif /* _BATCH_H_ */
@@ -0,0 +1,95 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include "cpu.h"
+#include "gfx.h"
+#include "phosphor.h"
+#include "scaler.h"
+
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CAPTURE_BUFFERS		  32 /* Frames queued for the writer thread. */
+#define CAPTURE_DEFAULT_SCALE 4
+#define CAPTURE_MAX_SCALE	  16
+
+/* Frames are written at the SUPER-CHIP resolution, low resolution pixels are
+ * doubled, then the whole frame is scaled. With a scaler, the screen is scaled at its
+ * own resolution first, then resized to the frame size.
+ */
+#define CAPTURE_WIDTH  GFX_WIDTH
+#define CAPTURE_HEIGHT GFX_HEIGHT
+
+typedef enum {
+	CAPTURE_Y4M, /* YUV4MPEG2 with full resolution chroma (C444). */
+	CAPTURE_RGB, /* Raw frames of 24 bits pixels. */
+} capture_format_t;
+
+/* Screen queued by the emulation thread. */
+typedef struct {
+	gfx_plane_t gfx[GFX_PLANES];
+	uint8_t width;
+	uint32_t repeats; /* Frames equal to the previous one, before this one. */
+	bool is_last;	  /* No screen, the stream ends after the repeats. */
+} capture_slot_t;
+
+/* Stream of the screens of each frame. The emulation thread only copies the planes to
+ * a pool of slots, and a writer thread converts and writes them, so disk I/O never
+ * delays the cpu. Frames equal to the previous one take no slot, they are counted as
+ * repeats of it, which is the common case of CHIP-8 programs.
+ */
+typedef struct {
+	FILE *file;
+	capture_format_t format;
+	uint8_t scale;
+	scaler_t scaler;
+	bool is_eliding;  /* Repeated frames are written once, flagged in Y4M. */
+	bool is_blocking; /* Wait for a free slot, instead of dropping the frame. */
+
+	capture_slot_t slots[CAPTURE_BUFFERS];
+	SDL_sem *free_slots;
+	SDL_sem *ready_slots;
+	SDL_Thread *writer;
+
+	/* Owned by the emulation thread. */
+	uint32_t head;
+	gfx_plane_t last[GFX_PLANES]; /* Screen of the latest queued frame. */
+	uint8_t last_width;
+	bool has_last;
+	uint32_t repeats;
+	uint32_t dropped; /* Frames written as repeats, as no slot was free. */
+
+	/* Owned by the writer thread. */
+	uint32_t tail;
+	uint8_t *image;	  /* Previous frame, ready to be written. */
+	uint32_t *scaled; /* Palette indexes of the scaled screen. */
+
+	/* Phosphor persistence, faded once per frame of the stream, repeats included. */
+	bool has_phosphor;
+	phosphor_t phosphor;
+	gfx_plane_t screen[GFX_PLANES]; /* Screen of the previous frame. */
+	uint8_t screen_width;
+	size_t image_size;
+	bool has_image;
+	bool has_failed;
+	uint64_t written;
+} capture_t;
+
+/* Write to path, or to the standard output if it is "-". The format is raw RGB if the
+ * path ends with ".rgb", Y4M otherwise. Phosphor is the percent of intensity kept by
+ * erased pixels at each frame, or 0.
+ */
+int8_t capture_init(
+	capture_t *capture, const char *path, uint8_t scale, scaler_t scaler,
+	uint8_t phosphor, bool is_eliding, bool is_blocking
+);
+/* Write the queued frames and close the stream. */
+void capture_quit(capture_t *capture);
+
+/* Add the cpu screen as the next frame of the stream. */
+void capture_frame(capture_t *capture, const cpu_t *cpu);
+
+#endif /* _CAPTURE_H_ */
@@ -1,18 +1,53 @@
 #ifndef _CONFIGS_H_
 #define _CONFIGS_H_
 
+#include "cpu.h"
+#include "quirks.h"
+#include "scaler.h"
+
+#include <stdbool.h>
 #include <stdint.h>
 
 #define MAX_FILEPATH_SIZE 1024
+#define MAX_RUN_AHEAD	  8
 
 #define STATUS_STOP		  1 /* Stop program execution. */
 #define STATUS_CONTINUE	  2 /* Continue program execution. */
 
+/* Options set in the command line, they take precedence over the rom database. */
+#define CFG_CLOCK_SPEED 0x1
+#define CFG_PROFILE		0x2
+
 typedef struct {
 	char rom_filepath[MAX_FILEPATH_SIZE];
+	const char *database_filepath;
 	uint16_t clock_speed;
+	profile_t profile; /* Interpreter quirks. */
+	bounds_t bounds;   /* Accesses crossing the end of memory. */
 	int16_t width;	/* Window Width */
 	int16_t height; /* Window Height */
+	scaler_t scaler; /* Applied to the screen, shown and captured. */
+	uint8_t phosphor; /* Percent kept by erased pixels at each tick, or 0. */
+	uint8_t options; /* CFG_* options set in the command line. */
+
+	bool is_turbo;	  /* Run timer ticks back to back, without waiting for real time. */
+	bool is_headless; /* Run in turbo mode, without window and audio. */
+	uint32_t frames;  /* Timer ticks to run in headless mode, 0 runs until exit. */
+	uint32_t batch;	  /* Environments stepped together in headless mode, or 0. */
+	bool use_lanes;	  /* Step the batch by vectors of cpus. */
+	uint32_t fuzz_cases; /* Cases run by the differential fuzzer in headless mode. */
+
+	const char *debug_socket_path; /* Debugger commands socket, or NULL. */
+
+	uint8_t run_ahead; /* Timer ticks the shown screen runs ahead of the cpu. */
+	bool show_latency; /* Print the input latency histogram at exit. */
+
+	const char *link_address; /* Ports of a two players session, or NULL. */
+	bool is_exporting;		  /* Publish each frame to shared memory. */
+
+	const char *capture_path; /* Stream of the frames, or NULL. */
+	uint8_t capture_scale;	  /* 0 uses the default scale. */
+	bool is_eliding;		  /* Write repeated frames once. */
 } configs_t;
 
 int8_t cfg_parse_options(configs_t *config, int argc, char *argv[]);
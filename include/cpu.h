@@ -1,46 +1,114 @@
 #ifndef _CPU_H_
 #define _CPU_H_
 
+#include "audio.h"
+#include "events.h"
+#include "gfx.h"
+#include "mega.h"
+#include "quirks.h"
+#include "rom.h"
+
 #include <SDL_render.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 /* CPU settings */
-#define GFX_WIDTH		  64
-#define GFX_HEIGHT		  32
-#define RAM_SIZE		  0x0FFF /* 4096 bytes */
+#define RAM_SIZE		  0x10000 /* 65536 bytes, XO-CHIP address space. */
+#define RAM_MASK		  (RAM_SIZE - 1)
+#define RAM_GUARD_SIZE	  64 /* Longest read at an address, 2 planes of 16x16 sprites. */
 #define STACK_SIZE		  16
 #define V_REGISTERS_COUNT 16
 #define KEYS_COUNT		  16
+#define RPL_FLAGS_COUNT	  16
 
 #define FONT_ADDRESS	  0x50 /* Address to load font. */
 #define FONT_CHAR_COUNT	  16
 #define FONT_CHAR_SIZE	  5
+#define BIG_FONT_ADDRESS  0xA0 /* Address to load SUPER-CHIP 8x10 font. */
+#define BIG_FONT_SIZE	  10
 
 #define TIMER_CLOCK_SPEED 60 /* Time clock speed in Hz. */
+#define DEFAULT_PITCH	  64 /* XO-CHIP pitch for 4000Hz playback rate. */
+#define RANDOM_SEED		  0x2545F491
+
+#define PAGE_SIZE		  256 /* Memory written since a fork is tracked by pages. */
+#define PAGES_COUNT		  (RAM_SIZE / PAGE_SIZE)
+
+typedef struct debugger debugger_t; /* Defined in "debug.h". */
+
+/* Accesses crossing the end of memory, at I or PC. */
+typedef enum {
+	BOUNDS_WRAP, /* Addresses wrap around to 0, like the 16 bits registers. */
+	BOUNDS_TRAP, /* The cpu stops with an error, to debug programs. */
+	BOUNDS_COUNT,
+} bounds_t;
 
-typedef struct {
+typedef struct cpu {
 	uint16_t opcode; /* Current Opcode. */
-	uint8_t memory[RAM_SIZE];
+	/* Memory is followed by a mirror of its first bytes, so reads of several bytes
+	 * at a masked address wrap around without checks.
+	 */
+	uint8_t memory[RAM_SIZE + RAM_GUARD_SIZE];
+	uint8_t decoded[RAM_SIZE]; /* Instruction predecoded at each address, 0 if none. */
 	uint16_t stack[STACK_SIZE];
 
 	/* Registers. */
 	uint8_t V[V_REGISTERS_COUNT];
-	uint16_t I;	 /* Index register. */
+	uint32_t I;	 /* Index register, 16 bits wide or 24 bits in MegaChip. */
 	uint16_t PC; /* Points to the next instruction in memory to execute. */
 	uint16_t SP; /* Points to the next empty spot in stack. */
 
-	/* Screen has a total of 2048 pixels, and hold state of 0 or 1. */
-	uint8_t gfx[GFX_WIDTH * GFX_HEIGHT];
+	/* Screen has up to 128x64 pixels, packed in rows of 64 bits words.
+	 * Each XO-CHIP bitplane has its own rows, the pixel color is the planes bits.
+	 */
+	gfx_plane_t gfx[GFX_PLANES];
+	uint8_t planes; /* Bitplanes selected for drawing, scrolling and clearing. */
+	uint8_t gfx_width; /* Current resolution, 64x32 or 128x64 (SUPER-CHIP). */
+	uint8_t gfx_height;
 	bool has_gfx_changed;
 
+	/* MegaChip 256x192 indexed colors screen, used instead of the planes if enabled. */
+	mega_t mega;
+	bool is_mega;
+
+	/* Whole ROM content, addresses above RAM_SIZE are read from it in MegaChip. */
+	rom_t *rom;
+
 	/* Timers count at 60Hz. When set above 0, they will count down to 0. */
 	uint8_t delay_timer;
 	uint8_t sound_timer;
 
+	/* XO-CHIP audio. The pattern is played while sound_timer is above 0. */
+	uint8_t audio_pattern[AUDIO_PATTERN_SIZE];
+	uint8_t pitch;
+	bool has_audio_changed;
+
 	uint8_t key_state[KEYS_COUNT]; /* HEX based keymap (0x0-0xF) */
 
+	uint8_t rpl[RPL_FLAGS_COUNT]; /* SUPER-CHIP HP48 RPL user flags. */
+	bool has_exited;			  /* Set by 0x00FD, program stops execution. */
+
+	uint32_t random; /* Xorshift state of 0xCxkk, snapshots replay the same values. */
+
 	uint16_t clock_speed; /* CPU clock speed for executing code. */
+	profile_t profile;	  /* Selects the opcode table compiled for the quirks. */
+	bounds_t bounds;	  /* Kept by cpu_reset, accesses wrap by default. */
+
+	/* Time of the previous update and cycles accumulated but not done yet. */
+	uint64_t last_time;
+	double pending_cpu_cycles;
+	double pending_timer_cycles;
+	bool is_idle;	/* Waiting for the delay timer, the rest of the update is skipped. */
+	bool is_halted; /* Waiting for a key (0xFx0A), no cycles are done until a key event. */
+	uint64_t instructions; /* Instructions done since reset. */
+	uint64_t input_time;   /* Time of the first key press not published yet, or 0. */
+
+	debugger_t *debugger; /* Attached debugger, or NULL. */
+	bool is_muted;		  /* Audio is not updated, set in snapshots. */
+
+	/* Fork sharing its memory with the clones, and pages written since the fork. */
+	const struct cpu *base;
+	uint64_t written_pages[PAGES_COUNT / 64];
 
 	/* Data */
 	uint16_t addr;	/* 0nnn */
@@ -51,15 +119,64 @@ typedef struct {
 } cpu_t;
 
 /* Reset CPU and load font to the memory. */
-int8_t cpu_init(cpu_t *cpu, uint16_t clock_speed);
-
-/* Do cpu cycles and update timers. */
-int8_t cpu_update(cpu_t *cpu);
+int8_t cpu_init(cpu_t *cpu, uint16_t clock_speed, profile_t profile);
+
+/* Do cpu cycles and update timers.
+ * Queued key events are applied at the cycle matching the time they happened,
+ * events may be NULL.
+ */
+int8_t cpu_update(cpu_t *cpu, event_queue_t *events);
+/* Do the cpu cycles of a single timer tick, as fast as possible (turbo mode). */
+int8_t cpu_step_tick(cpu_t *cpu, event_queue_t *events);
+/* Count down the timers of a tick, and return the cpu cycles it has to do. */
+uint32_t cpu_start_tick(cpu_t *cpu);
+void cpu_end_tick(cpu_t *cpu); /* Update audio after the cycles of the tick are done. */
+/* Milliseconds until the next timer tick of cpu_update. */
+uint32_t cpu_next_tick_delay(const cpu_t *cpu);
 void cpu_reset(cpu_t *cpu); /* Set CPU to a initial state. */
 
-/* Read rom from filepath and load it to the memory. */
-int8_t cpu_loadrom(cpu_t *cpu, const char *filepath);
+/* Copy the cpu state to run it ahead, without the debugger and audio. The snapshot
+ * shares the rom of the cpu, so it must not be released with cpu_quit.
+ */
+void cpu_snapshot(cpu_t *snapshot, const cpu_t *cpu);
+/* Go back to the state of a snapshot, keeping the debugger and audio of the cpu. */
+void cpu_restore(cpu_t *cpu, const cpu_t *snapshot);
+
+/* Take a snapshot to fork clones from. The fork must not run nor change while its
+ * clones are in use.
+ */
+void cpu_fork(cpu_t *fork, const cpu_t *cpu);
+/* Copy a clone of a fork, or the fork itself, like cpu_snapshot. If the copy was
+ * already a clone of the same fork, only the memory pages written by either of them
+ * since the fork are copied, the others are the same as the fork. The copy must be
+ * zeroed or a snapshot when first used.
+ */
+void cpu_clone(cpu_t *clone, const cpu_t *cpu);
+
+void cpu_quit(cpu_t *cpu); /* Release the loaded ROM. */
+
+/* Copy ROM to memory and keep a reference to it. */
+int8_t cpu_loadrom(cpu_t *cpu, rom_t *rom);
 
 int8_t cpu_decode_opcode(cpu_t *cpu); /* Decode OPCODE and execute instruction. */
+/* Execute a single instruction at PC, without timers. Nothing is done if the cpu is
+ * idle, halted or exited.
+ */
+int8_t cpu_step(cpu_t *cpu);
+/* Return true if the cpu is polling the delay timer in a loop at PC, the cycles of a
+ * tick stop there as nothing changes until the next one.
+ */
+bool cpu_is_delay_loop(const cpu_t *cpu);
+
+/* Read byte at address, using MegaChip 24 bits addressing. */
+uint8_t cpu_read_byte(const cpu_t *cpu, uint32_t address);
+/* Copy the first bytes of memory to its guard, if the size bytes written at address
+ * include them.
+ */
+void cpu_mirror_memory(cpu_t *cpu, uint16_t address, uint32_t size);
+
+/* Return bounds policy with the given name, or BOUNDS_COUNT if there is none. */
+bounds_t cpu_find_bounds(const char *name);
+const char *cpu_bounds_name(bounds_t bounds);
 
 #endif /* _CPU_H_ */
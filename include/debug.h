@@ -0,0 +1,69 @@
+#ifndef _DEBUG_H_
+#define _DEBUG_H_
+
+#include "cpu.h"
+
+#include <SDL_atomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DEBUG_MAX_BREAKPOINTS 16
+#define DEBUG_MAX_WATCHPOINTS 16
+#define DEBUG_COMMAND_SIZE	  128
+#define DEBUG_NO_ADDRESS	  -1
+
+/* Requests sent by the hotkeys of the render thread. */
+typedef enum {
+	DEBUG_REQUEST_NONE,
+	DEBUG_REQUEST_PAUSE, /* Pause, or continue if paused. */
+	DEBUG_REQUEST_STEP,
+	DEBUG_REQUEST_VIEW, /* Show registers and stack. */
+} debug_request_t;
+
+/* Memory range, the cpu is paused after an instruction writes to it. */
+typedef struct {
+	uint16_t address;
+	uint16_t size;
+} watchpoint_t;
+
+/* Breakpoints are set in the predecoded instructions of the cpu, and watchpoints are
+ * checked when memory is written, so nothing is done in the cpu cycles without them.
+ * Everything but the requests is owned by the thread running the cpu.
+ */
+struct debugger {
+	uint16_t breakpoints[DEBUG_MAX_BREAKPOINTS];
+	uint8_t breakpoints_count;
+	watchpoint_t watchpoints[DEBUG_MAX_WATCHPOINTS];
+	uint8_t watchpoints_count;
+	int32_t run_to; /* Temporary breakpoint of "until", or DEBUG_NO_ADDRESS. */
+	bool is_paused;
+
+	SDL_atomic_t request; /* debug_request_t */
+
+	/* Commands are read one per line from a client of the local socket. */
+	int32_t server;
+	int32_t client;
+	char command[DEBUG_COMMAND_SIZE];
+	uint8_t command_size;
+};
+
+/* Attach a debugger to the cpu. Commands are accepted on the Unix socket at
+ * socket_path, if it is not NULL.
+ */
+int8_t debug_init(debugger_t *debugger, cpu_t *cpu, const char *socket_path);
+void debug_quit(debugger_t *debugger, cpu_t *cpu);
+
+/* Can be called from any thread, the request is done by the next debug_poll. */
+void debug_request(debugger_t *debugger, debug_request_t request);
+
+/* Do requests and socket commands, cpu cycles must not be done while paused. */
+void debug_poll(debugger_t *debugger, cpu_t *cpu);
+
+/* Called by the cpu at a breakpoint, before executing its instruction. */
+void debug_break(debugger_t *debugger, cpu_t *cpu);
+/* Called by the cpu after memory is written. */
+void debug_check_write(
+	debugger_t *debugger, cpu_t *cpu, uint16_t address, uint32_t size
+);
+
+#endif /* _DEBUG_H_ */
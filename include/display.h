@@ -1,6 +1,11 @@
 #ifndef _DISPLAY_H_
 #define _DISPLAY_H_
 
+#include "gfx.h"
+#include "mega.h"
+#include "phosphor.h"
+#include "scaler.h"
+
 #include <SDL2/SDL_render.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -9,13 +14,53 @@ typedef struct {
 	SDL_Window *window;
 	SDL_Renderer *renderer;
 	SDL_Texture *cpu_screen;
+	SDL_Texture *mega_screen; /* MegaChip 256x192 screen. */
+	SDL_Texture *active_screen;
+	SDL_Rect screen_area; /* Area of active_screen used by the current resolution. */
+
+	scaler_t scaler; /* Applied to the cpu screen when it is uploaded. */
+	uint8_t scale;	 /* Size of the cpu screen pixels in the texture. */
+
+	/* With phosphor persistence, the latest cpu screen is kept and faded at each
+	 * timer tick, as frames are only published when the screen changes.
+	 */
+	bool has_phosphor;
+	bool has_new_screen; /* Set by a new screen, until it is uploaded. */
+	phosphor_t phosphor;
+	gfx_plane_t planes[GFX_PLANES];
+	uint8_t screen_width;
+	uint8_t screen_height;
+	uint32_t ramp[PHOSPHOR_RAMP_SIZE]; /* Phosphor ramp mapped colors. */
+
+	SDL_PixelFormat *format; /* Pixel format of the screen textures. */
+
+	/* Colors for each combination of the planes bits, mapped to the texture format. */
+	uint32_t palette[1 << GFX_PLANES];
+	uint32_t mega_palette[MEGA_PALETTE_SIZE]; /* MegaChip palette mapped colors. */
 } display_t;
 
-int8_t create_display(display_t *display, int16_t width, int16_t height);
+/* Phosphor is the percent of intensity kept by erased pixels at each tick, 0 disables
+ * phosphor persistence.
+ */
+int8_t create_display(
+	display_t *display, int16_t width, int16_t height, scaler_t scaler, uint8_t phosphor
+);
 void destroy_display(display_t *display);
 
-/* Update screen texture using cpu array. */
-void display_update_screen(display_t *display, uint8_t *gfx);
+/* Update screen texture using cpu packed planes with the given resolution. It is only
+ * called for new frames, so the scaler runs once per drawn screen.
+ */
+void display_update_screen(
+	display_t *display, gfx_plane_t *planes, uint8_t width, uint8_t height
+);
+/* Fade the phosphor by the timer ticks since the previous update, and upload the cpu
+ * screen if it has changed.
+ */
+void display_update_phosphor(display_t *display, uint32_t ticks);
+/* Return true if the phosphor changes in the next ticks, even without new frames. */
+bool display_is_fading(const display_t *display);
+/* Update MegaChip screen texture, only the dirty area is uploaded. */
+void display_update_mega(display_t *display, mega_t *mega);
 int8_t display_render_screen(display_t *display, SDL_Rect *srcrect, SDL_Rect *dstrect);
 
 /* Set desired pixel on the surface to the desired color. */
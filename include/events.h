@@ -0,0 +1,35 @@
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+
+#include <SDL_atomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EVENT_QUEUE_SIZE 64 /* Must be a power of two. */
+
+/* Key press or release, timestamped in host milliseconds (SDL_GetTicks64). */
+typedef struct {
+	uint64_t timestamp;
+	uint8_t key;
+	bool is_pressed;
+} input_event_t;
+
+/* Lock-free queue, with a single producer and a single consumer.
+ * Head and tail only grow, their difference is the number of queued events.
+ */
+typedef struct {
+	input_event_t events[EVENT_QUEUE_SIZE];
+	SDL_atomic_t head; /* Next event to be read, written by the consumer. */
+	SDL_atomic_t tail; /* Next free slot, written by the producer. */
+} event_queue_t;
+
+void event_queue_init(event_queue_t *queue);
+
+/* Return false if the queue is full, the event is dropped. */
+bool event_queue_push(event_queue_t *queue, input_event_t event);
+
+/* Return the oldest event without removing it, or NULL if the queue is empty. */
+const input_event_t *event_queue_peek(event_queue_t *queue);
+void event_queue_pop(event_queue_t *queue);
+
+#endif /* _EVENTS_H_ */
@@ -0,0 +1,21 @@
+#ifndef _EXPORT_H_
+#define _EXPORT_H_
+
+#include "cpu.h"
+#include "shared.h"
+
+#include <stdint.h>
+
+/* Writer of the shared memory segment read by "shared.h", named after the pid. */
+typedef struct {
+	shared_segment_t *segment;
+	char name[SHARED_NAME_SIZE];
+} export_t;
+
+int8_t export_init(export_t *export);
+void export_quit(export_t *export); /* Remove the segment, readers keep their copy. */
+
+/* Copy the cpu state after a frame. Must be called by a single thread. */
+void export_publish(export_t *export, const cpu_t *cpu);
+
+#endif /* _EXPORT_H_ */
@@ -0,0 +1,47 @@
+#ifndef _FRAME_H_
+#define _FRAME_H_
+
+#include "cpu.h"
+#include "gfx.h"
+#include "mega.h"
+
+#include <SDL_atomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FRAME_BUFFER_COUNT 3
+
+/* Copy of the cpu screen, published by the emulation thread to the render thread. */
+typedef struct {
+	gfx_plane_t gfx[GFX_PLANES];
+	uint8_t width;
+	uint8_t height;
+
+	bool is_mega;
+	mega_t mega;
+
+	uint64_t input_time; /* Key press first shown by this frame, cleared when read. */
+} frame_t;
+
+/* Lock-free triple buffer, with a single writer and a single reader.
+ * The writer owns the back frame and the reader owns the front frame, the middle
+ * frame is exchanged between them with an atomic swap, so none of them ever waits.
+ */
+typedef struct {
+	frame_t frames[FRAME_BUFFER_COUNT];
+	SDL_atomic_t middle; /* Middle frame index, with FRAME_FRESH set if not read. */
+	uint8_t back;
+	uint8_t front;
+} frame_buffer_t;
+
+void frame_buffer_init(frame_buffer_t *buffer);
+
+/* Copy the cpu screen to the back frame and make it the latest frame.
+ * Return false if the previous frame has been replaced before being read.
+ */
+bool frame_buffer_publish(frame_buffer_t *buffer, cpu_t *cpu);
+
+/* Return the latest published frame, or NULL if there is no new frame. */
+frame_t *frame_buffer_acquire(frame_buffer_t *buffer);
+
+#endif /* _FRAME_H_ */
@@ -0,0 +1,88 @@
+#ifndef _FUZZ_H_
+#define _FUZZ_H_
+
+#include "cpu.h"
+#include "lanes.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FUZZ_ROM_SIZE	 4096 /* Largest program of a case, seeds are truncated. */
+#define FUZZ_BLOCKS		 16	  /* Timer ticks run by each case. */
+#define FUZZ_LANES		 LANES_COUNT
+#define FUZZ_CORPUS_SIZE 64
+
+/* Execution engines checked against the reference, which decodes each instruction
+ * with opcode_decode over the OPCODES table.
+ */
+typedef enum {
+	FUZZ_PREDECODED,   /* cpu_step_tick, with predecoded and fused instructions. */
+	FUZZ_LANES_ENGINE, /* lanes_step_tick, with the cpus in lockstep. */
+	FUZZ_ENGINE_COUNT,
+} fuzz_engine_t;
+
+#define FUZZ_ALL_ENGINES ((1u << FUZZ_ENGINE_COUNT) - 1)
+
+/* A program run by every lane, with the inputs drawn from a seed. */
+typedef struct {
+	uint8_t rom[FUZZ_ROM_SIZE];
+	uint16_t size;
+	uint32_t seed; /* Keys pressed between the blocks, 0 for none. */
+	uint8_t lanes; /* Lanes compared, the others only run along. */
+} fuzz_case_t;
+
+/* First difference found between the reference and an engine. */
+typedef struct {
+	fuzz_engine_t engine;
+	uint32_t block;
+	uint8_t lane;
+	const char *field; /* Name of the cpu_t field, or "status" for the results. */
+} fuzz_divergence_t;
+
+/* Differential fuzzing of the execution engines. Every case runs on clones of the
+ * same initial cpu, so a run only copies back the memory pages written by the
+ * previous one, and the cpus are allocated once. After each block, the whole state
+ * of each lane is compared but the predecoded instructions. Memory is compared on
+ * the pages written since the clone, the others are the ones of the initial cpu.
+ */
+typedef struct {
+	cpu_t initial;
+	cpu_t *cpus; /* FUZZ_LANES cpus of the reference, then of each engine. */
+	lanes_t lanes;
+	uint8_t opcodes_count; /* Entries of the profile table, to generate programs. */
+
+	fuzz_case_t *corpus; /* Programs mutated by the next cases. */
+	uint32_t corpus_size;
+	uint32_t corpus_next; /* Entry replaced once the corpus is full. */
+	bool is_minimizing;	  /* Cases are not added to the corpus. */
+
+	uint32_t random;
+	uint64_t cases;
+	uint64_t instructions; /* Done by the reference. */
+} fuzz_t;
+
+/* Start the cases from a reset cpu with the clock speed and profile of the cpu. */
+int8_t fuzz_init(fuzz_t *fuzz, const cpu_t *cpu, uint32_t seed);
+void fuzz_quit(fuzz_t *fuzz);
+
+/* Add a program to the corpus, and write it as a case without inputs. */
+void fuzz_add_seed(fuzz_t *fuzz, const uint8_t *rom, uint32_t size, fuzz_case_t *test);
+/* Write a random program, or a mutation of the corpus, with random inputs. */
+void fuzz_generate(fuzz_t *fuzz, fuzz_case_t *test);
+
+/* Run the case on the reference and the engines of the mask (bits of fuzz_engine_t),
+ * return true and the first difference if they diverged. Cases running to the end
+ * are added to the corpus.
+ */
+bool fuzz_run(
+	fuzz_t *fuzz, const fuzz_case_t *test, uint32_t engines,
+	fuzz_divergence_t *divergence
+);
+/* Remove the instructions, the inputs and the lanes not needed by the divergence. */
+void fuzz_minimize(fuzz_t *fuzz, fuzz_case_t *test, fuzz_divergence_t *divergence);
+/* Write the program of the case, it runs as a ROM. */
+int8_t fuzz_write_rom(const fuzz_case_t *test, const char *filepath);
+
+const char *fuzz_engine_name(fuzz_engine_t engine);
+
+#endif /* _FUZZ_H_ */
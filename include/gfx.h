@@ -0,0 +1,37 @@
+#ifndef _GFX_H_
+#define _GFX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Screen settings. */
+#define GFX_WIDTH		 128 /* SUPER-CHIP high resolution. */
+#define GFX_HEIGHT		 64
+#define GFX_LORES_WIDTH	 64
+#define GFX_LORES_HEIGHT 32
+
+#define GFX_WORD_BITS	 64
+#define GFX_ROW_WORDS	 (GFX_WIDTH / GFX_WORD_BITS)
+
+#define GFX_PLANES		 2 /* XO-CHIP bitplanes, giving 4 colors. */
+#define GFX_PLANES_MASK	 0x3
+
+/* A row of pixels packed in 64 bits words. The leftmost pixel is the most significant
+ * bit of the first word. In low resolution only the first word is used.
+ */
+typedef uint64_t gfx_row_t[GFX_ROW_WORDS];
+typedef gfx_row_t gfx_plane_t[GFX_HEIGHT];
+
+/* XOR sprite bits (left aligned in a 16 bits word) into the row starting at x.
+ * Pixels going beyond the row width wrap around.
+ * Return true if any pixel has been erased.
+ */
+bool gfx_xor_row(gfx_row_t row, uint16_t bits, uint8_t x, uint8_t width);
+
+/* Scroll the screen, pixels scrolled out are lost and new ones are cleared. */
+void gfx_scroll_down(gfx_row_t *rows, uint8_t amount, uint8_t height);
+void gfx_scroll_up(gfx_row_t *rows, uint8_t amount, uint8_t height);
+void gfx_scroll_right(gfx_row_t *rows, uint8_t amount, uint8_t width, uint8_t height);
+void gfx_scroll_left(gfx_row_t *rows, uint8_t amount, uint8_t width, uint8_t height);
+
+#endif /* _GFX_H_ */
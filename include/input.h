@@ -2,11 +2,15 @@
 #define _INPUT_H_
 
 #include "cpu.h"
+#include "events.h"
 
 #include <SDL2/SDL_keyboard.h>
 #include <SDL_events.h>
+#include <SDL_gamecontroller.h>
 #include <stdint.h>
 
+#define INPUT_NO_KEY -1
+
 /* Chip8 Key layout.
  * 1 | 2 | 3 | C
  * 4 | 5 | 6 | D
@@ -15,13 +19,24 @@
  */
 
 typedef struct {
-	SDL_Scancode cpu_keys[KEYS_COUNT]; /* CPU keymap. */
+	/* CPU key for each scancode and gamepad button, or INPUT_NO_KEY. */
+	int8_t scancode_keys[SDL_NUM_SCANCODES];
+	int8_t button_keys[SDL_CONTROLLER_BUTTON_MAX];
+
+	SDL_GameController *controller; /* First gamepad connected. */
 } input_t;
 
-/* Load default key mapping. */
+/* Load default key and gamepad mappings. */
 void input_init(input_t *input);
+void input_quit(input_t *input); /* Close the gamepad. */
 
-/* Read scancode from SDL_Event and update keystate. */
-void input_update_keystate(SDL_Event *event, input_t input, uint8_t *keystate);
+/* Map keys to the given scancodes, keys with SDL_SCANCODE_UNKNOWN are unchanged. */
+void input_set_keymap(input_t *input, const uint16_t *scancodes);
+
+/* Queue key and gamepad button events, with the time they happened.
+ * Gamepads connected or disconnected are opened or closed.
+ * Return true if an event has been queued.
+ */
+bool input_handle_event(input_t *input, SDL_Event *event, event_queue_t *queue);
 
 #endif /* _INPUT_H_ */
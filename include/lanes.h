@@ -0,0 +1,44 @@
+#ifndef _LANES_H_
+#define _LANES_H_
+
+#include "cpu.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LANES_COUNT 16 /* Bytes in a vector register of SSE2 or NEON. */
+
+typedef uint8_t lanes_vector_t __attribute__((vector_size(LANES_COUNT)));
+
+/* Up to LANES_COUNT cpus running the same program in lockstep, for batch workloads.
+ * The registers of all of them are packed in vectors, one lane per cpu. At each step
+ * the lanes at the lowest address run its instruction together: ALU instructions,
+ * loads, skips and jumps are done by vector operations masked to those lanes, until
+ * the lanes branch apart. The other instructions are done by each cpu, up to the next
+ * vector instruction. The cpus must have no debugger.
+ */
+typedef struct {
+	cpu_t *cpus[LANES_COUNT];
+	uint8_t count;
+
+	lanes_vector_t V[V_REGISTERS_COUNT]; /* Register r of every lane. */
+	/* The registers are copied between the vectors and the cpus when they change. */
+	uint16_t dirty[LANES_COUNT]; /* Registers written by vector operations. */
+	uint32_t in_cpu;			 /* Lanes run by their cpu since the saved registers. */
+	uint8_t saved[LANES_COUNT][V_REGISTERS_COUNT];
+	uint32_t budgets[LANES_COUNT];		 /* Cycles of the current tick. */
+	uint32_t done[LANES_COUNT];
+	bool has_failed[LANES_COUNT]; /* The cpu stopped at an error in this tick. */
+	uint32_t running;			  /* Bit of each lane with cycles left in the tick. */
+
+	/* Instructions done by vector operations, and by each cpu. */
+	uint64_t vector_instructions;
+	uint64_t scalar_instructions;
+} lanes_t;
+
+/* Do the cycles of a timer tick in every lane, as cpu_step_tick without events.
+ * A lane stopped by an error does not stop the others.
+ */
+int8_t lanes_step_tick(lanes_t *lanes);
+
+#endif /* _LANES_H_ */
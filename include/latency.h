@@ -0,0 +1,24 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+
+#define LATENCY_BUCKET_SIZE 4  /* Milliseconds per bucket. */
+#define LATENCY_BUCKETS		32 /* The last bucket counts all slower samples. */
+
+/* Histogram of the time from a key press to the first presented frame drawn after it,
+ * measured from the key event timestamp to the end of the present.
+ */
+typedef struct {
+	uint32_t buckets[LATENCY_BUCKETS];
+	uint32_t count;
+	uint64_t total; /* Sum of samples, for the average. */
+	uint32_t slowest;
+} latency_t;
+
+void latency_add(latency_t *latency, uint32_t time); /* Time in milliseconds. */
+
+/* Print the histogram to the standard output, if there are samples. */
+void latency_report(const latency_t *latency);
+
+#endif /* _LATENCY_H_ */
@@ -0,0 +1,59 @@
+#ifndef _LINK_H_
+#define _LINK_H_
+
+#include "cpu.h"
+#include "events.h"
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LINK_MAX_ROLLBACK 7 /* Frames run with predicted remote keys. */
+/* Power of two. The remote keys received at once go from LINK_MAX_ROLLBACK frames
+ * behind the local frame to as many ahead of it, and must not overwrite each other.
+ */
+#define LINK_HISTORY 16
+
+/* Two players share a session, each one running the same program on its own cpu.
+ * Every frame (timer tick), the keypad state of each player is sent to the other,
+ * and the cpu runs with the keys of both. Remote keys not received yet are predicted
+ * to be unchanged, and when a prediction was wrong, the cpu goes back to the snapshot
+ * of that frame and runs again to the current one. A player stops while the other
+ * one is more than LINK_MAX_ROLLBACK frames behind.
+ */
+typedef struct {
+	int32_t socket;
+	struct sockaddr_in peer;
+
+	uint32_t frame;		   /* Next frame to run. */
+	uint32_t remote_frame; /* Remote keys are known for the frames before it. */
+	uint32_t peer_frame;   /* The peer knows the local keys of the frames before it. */
+	uint16_t keys;		   /* Local keypad state, one bit per key. */
+	uint16_t pressed;	   /* Keys pressed since the last frame, so taps are seen. */
+	uint16_t local_keys[LINK_HISTORY];
+	uint16_t remote_keys[LINK_HISTORY]; /* Received or predicted. */
+	cpu_t *snapshots;					/* State before each frame of the history. */
+
+	uint64_t start_time; /* Time of frame 0, moved forward by stalls. */
+	bool is_stalled;
+	bool has_run_frame; /* The last update ran the next frame. */
+
+	/* Rollbacks done, and the slowest one in microseconds. */
+	uint32_t rollbacks;
+	uint32_t rollback_frames;
+	uint32_t slowest_rollback;
+} link_t;
+
+/* Open a UDP socket on the loopback interface. Address is "<port>:<peer port>". */
+int8_t link_init(link_t *link, const char *address);
+void link_quit(link_t *link); /* Log the rollback statistics. */
+
+/* Apply local key events and received keys, then run the next frame if its time has
+ * come and the remote player is not too far behind. has_run_frame tells if it did.
+ */
+int8_t link_update(link_t *link, cpu_t *cpu, event_queue_t *events);
+
+/* Milliseconds until the next frame, or until received keys are checked again. */
+uint32_t link_next_delay(const link_t *link);
+
+#endif /* _LINK_H_ */
@@ -0,0 +1,54 @@
+#ifndef _MEGA_H_
+#define _MEGA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* MegaChip screen settings. */
+#define MEGA_WIDTH		  256
+#define MEGA_HEIGHT		  192
+#define MEGA_PALETTE_SIZE 256
+#define MEGA_RAM_SIZE	  0x1000000 /* 24 bits address space. */
+
+/* Area of the screen changed since the last texture upload. Empty if right == 0. */
+typedef struct {
+	uint16_t left;
+	uint16_t top;
+	uint16_t right; /* Exclusive. */
+	uint16_t bottom;
+} mega_rect_t;
+
+typedef struct {
+	uint8_t gfx[MEGA_HEIGHT][MEGA_WIDTH]; /* Palette indexes. */
+	uint32_t palette[MEGA_PALETTE_SIZE];  /* ARGB colors, index 0 is transparent. */
+	bool has_palette_changed;
+	mega_rect_t dirty;
+
+	uint16_t sprite_width; /* Sprite size in pixels, from 1 to 256. */
+	uint16_t sprite_height;
+	uint8_t alpha;			 /* Screen alpha. */
+	uint8_t blend_mode;		 /* Sprite blend mode, set by 0x080n. */
+	uint8_t collision_color; /* Drawing over this palette index sets VF. */
+} mega_t;
+
+/* Reset MegaChip state and clear the screen. */
+void mega_reset(mega_t *mega);
+void mega_clear(mega_t *mega);
+
+/* Copy sprite row pixels over the screen row, index 0 is transparent.
+ * Return true if a drawn pixel covered a pixel of the collision color.
+ */
+bool mega_blit_row(
+	uint8_t *restrict dst, const uint8_t *restrict src, uint16_t count, uint8_t collision
+);
+
+/* Add area to the dirty region, clipped to the screen. */
+void mega_mark_dirty(mega_t *mega, uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+
+/* Scroll the screen, pixels scrolled out are lost and new ones are transparent. */
+void mega_scroll_down(mega_t *mega, uint8_t amount);
+void mega_scroll_up(mega_t *mega, uint8_t amount);
+void mega_scroll_right(mega_t *mega, uint8_t amount);
+void mega_scroll_left(mega_t *mega, uint8_t amount);
+
+#endif /* _MEGA_H_ */
@@ -2,10 +2,12 @@
 #define _OPCODES_H_
 
 #include "cpu.h"
+#include "quirks.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 
-#define MAX_OPCODES 36
+#define MAX_OPCODES 57 /* Largest profile table plus its terminator. */
 
 typedef uint16_t (*opcode_handler_t)(cpu_t *cpu);
 
@@ -15,9 +17,28 @@ typedef struct {
 	uint16_t mask;
 } opcode_t;
 
-/* List of opcodes initialized in "opcodes.c" */
-extern const opcode_t OPCODES[MAX_OPCODES];
+/* Lists of opcodes for each profile initialized in "opcodes.c".
+ * Each list ends with an entry without handler.
+ */
+extern const opcode_t OPCODES[PROFILE_COUNT][MAX_OPCODES];
 
+/* Fetch the opcode at PC and split its fields. */
+void opcode_fetch(cpu_t *cpu);
 int8_t opcode_decode(cpu_t *cpu);
 
+/* Execute the instruction at PC, predecoded on its first execution.
+ * Common sequences of instructions are fused into a single handler, used if all of
+ * them fit in the budget of cycles. The number of instructions done is added to cycles.
+ */
+int8_t opcode_execute(cpu_t *cpu, uint32_t budget, uint32_t *cycles);
+/* Decode again the instructions overlapping the memory written at address. */
+void opcode_invalidate(cpu_t *cpu, uint16_t address, uint32_t size);
+/* Forget the predecoded instructions overlapping the memory at address, but not their
+ * breakpoints.
+ */
+void opcode_clear_decoded(cpu_t *cpu, uint16_t address, uint32_t size);
+/* Patch the predecoded instruction at address to call the cpu debugger instead. */
+void opcode_set_breakpoint(cpu_t *cpu, uint16_t address, bool is_set);
+bool opcode_has_breakpoint(const cpu_t *cpu, uint16_t address);
+
 #endif /* _OPCODES_H_ */
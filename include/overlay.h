@@ -0,0 +1,49 @@
+#ifndef _OVERLAY_H_
+#define _OVERLAY_H_
+
+#include "display.h"
+
+#include <SDL2/SDL_render.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define OVERLAY_SAMPLES	  256 /* Frame times kept for the percentiles. */
+#define OVERLAY_LINES	  4
+#define OVERLAY_LINE_SIZE 32
+
+/* Performance statistics drawn over the screen. They are updated once per second,
+ * and the texture is only drawn again when they change.
+ */
+typedef struct {
+	SDL_Texture *texture;
+	uint32_t text_color;
+	uint32_t background_color;
+	bool is_visible;
+	bool has_changed; /* Text changed since the texture was drawn. */
+
+	/* Samples of the current period, times are in microseconds. */
+	uint32_t frame_times[OVERLAY_SAMPLES];
+	uint32_t frames_count;
+	uint64_t period_time;
+	uint64_t cpu_time;
+	uint64_t upload_time;
+	uint64_t present_time;
+	uint64_t instructions;
+
+	char lines[OVERLAY_LINES][OVERLAY_LINE_SIZE];
+} overlay_t;
+
+int8_t overlay_init(overlay_t *overlay, display_t *display);
+void overlay_quit(overlay_t *overlay);
+void overlay_toggle(overlay_t *overlay);
+
+/* Add the times of a presented frame, and the cpu work done meanwhile. */
+void overlay_add_frame(
+	overlay_t *overlay, uint32_t frame_time, uint32_t upload_time, uint32_t present_time
+);
+void overlay_add_cpu(overlay_t *overlay, uint32_t cpu_time, uint32_t instructions);
+
+/* Render over the screen if visible. */
+int8_t overlay_render(overlay_t *overlay, display_t *display);
+
+#endif /* _OVERLAY_H_ */
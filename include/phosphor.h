@@ -0,0 +1,51 @@
+#ifndef _PHOSPHOR_H_
+#define _PHOSPHOR_H_
+
+#include "gfx.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PHOSPHOR_LEVELS	   16 /* Intensity levels of each plane in the palette ramp. */
+#define PHOSPHOR_RAMP_SIZE (PHOSPHOR_LEVELS * PHOSPHOR_LEVELS)
+#define PHOSPHOR_COLORS	   (1 << GFX_PLANES)
+
+/* Persistence of the screen pixels, as the phosphor of a CRT. Sprites are erased and
+ * drawn again by XOR, so they are often missing from some frames and flicker. Erased
+ * pixels fade over some timer ticks instead, lit pixels are shown at once.
+ */
+typedef struct {
+	uint8_t intensity[GFX_PLANES][GFX_HEIGHT][GFX_WIDTH]; /* 255 is fully lit. */
+	uint8_t width;
+	uint8_t height;
+	uint16_t decay;	  /* Intensity kept at each tick, out of 256. */
+	bool is_settled; /* Every pixel is dark or fully lit, so ticks change nothing. */
+} phosphor_t;
+
+/* Keep percent of the intensity of erased pixels at each tick, from 1 to 99. */
+void phosphor_init(phosphor_t *phosphor, uint8_t percent);
+
+/* Fade the pixels by the given timer ticks, then light the pixels set in the planes.
+ * Intensities are cleared when the resolution changes.
+ */
+void phosphor_step(
+	phosphor_t *phosphor, gfx_plane_t *planes, uint8_t width, uint8_t height,
+	uint32_t ticks
+);
+
+/* Write the ramp entry of each pixel, rows start every pitch bytes. The ramp index is
+ * the first plane level plus the second plane level * PHOSPHOR_LEVELS.
+ */
+void phosphor_colors(
+	const phosphor_t *phosphor, const uint32_t ramp[PHOSPHOR_RAMP_SIZE],
+	uint32_t *pixels, int32_t pitch
+);
+
+/* Blend the RGB colors of the planes bits (none, first, second, both) into the colors
+ * of the ramp indexes.
+ */
+void phosphor_ramp(
+	uint8_t ramp[PHOSPHOR_RAMP_SIZE][3], const uint8_t colors[PHOSPHOR_COLORS][3]
+);
+
+#endif /* _PHOSPHOR_H_ */
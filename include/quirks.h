@@ -0,0 +1,67 @@
+#ifndef _QUIRKS_H_
+#define _QUIRKS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Named profiles of the interpreters behaviour. Each profile has its own opcode table,
+ * with handlers compiled for its quirks.
+ */
+typedef enum {
+	PROFILE_VIP = 0,  /* COSMAC VIP CHIP-8. */
+	PROFILE_CHIP48,	  /* HP48 CHIP-48. */
+	PROFILE_SCHIP,	  /* SUPER-CHIP 1.1. */
+	PROFILE_XOCHIP,	  /* Octo XO-CHIP. */
+	PROFILE_MEGACHIP, /* MegaChip 8. */
+	PROFILE_COUNT,
+} profile_t;
+
+#define DEFAULT_PROFILE PROFILE_XOCHIP
+
+/* How Fx55 and Fx65 change I. */
+typedef enum {
+	MEMORY_INCREMENT_X1 = 0, /* I = I + X + 1 */
+	MEMORY_INCREMENT_X,		 /* I = I + X */
+	MEMORY_UNCHANGED,		 /* I is not modified. */
+} memory_quirk_t;
+
+typedef struct {
+	bool vf_reset;	  /* 8xy1, 8xy2 and 8xy3 set VF to 0. */
+	bool shift_vy;	  /* 8xy6 and 8xyE shift Vy and store the result in Vx. */
+	bool jump_vx;	  /* Bxnn jumps to xnn + Vx, instead of nnn + V0. */
+	bool clip;		  /* Sprites are clipped at the screen edges instead of wrapping. */
+	bool long_skip;	  /* Skip instructions step over 4 bytes long F000 nnnn. */
+	bool mega;		  /* DRAW uses the MegaChip screen when enabled. */
+	memory_quirk_t memory;
+} quirks_t;
+
+/* clang-format off */
+#define QUIRKS_VIP ((quirks_t){ \
+	.vf_reset = true, .shift_vy = true, .jump_vx = false, .clip = true, \
+	.long_skip = false, .mega = false, .memory = MEMORY_INCREMENT_X1, \
+})
+#define QUIRKS_CHIP48 ((quirks_t){ \
+	.vf_reset = false, .shift_vy = false, .jump_vx = true, .clip = true, \
+	.long_skip = false, .mega = false, .memory = MEMORY_INCREMENT_X, \
+})
+#define QUIRKS_SCHIP ((quirks_t){ \
+	.vf_reset = false, .shift_vy = false, .jump_vx = true, .clip = true, \
+	.long_skip = false, .mega = false, .memory = MEMORY_UNCHANGED, \
+})
+#define QUIRKS_XOCHIP ((quirks_t){ \
+	.vf_reset = false, .shift_vy = true, .jump_vx = false, .clip = false, \
+	.long_skip = true, .mega = false, .memory = MEMORY_INCREMENT_X1, \
+})
+#define QUIRKS_MEGACHIP ((quirks_t){ \
+	.vf_reset = false, .shift_vy = false, .jump_vx = false, .clip = true, \
+	.long_skip = false, .mega = true, .memory = MEMORY_UNCHANGED, \
+})
+/* clang-format on */
+
+/* Return profile with the given name, or PROFILE_COUNT if there is none. */
+profile_t quirks_find_profile(const char *name);
+const char *quirks_profile_name(profile_t profile);
+/* Quirks of a profile, for code not compiled for each profile. */
+quirks_t quirks_of(profile_t profile);
+
+#endif /* _QUIRKS_H_ */
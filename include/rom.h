@@ -0,0 +1,45 @@
+#ifndef _ROM_H_
+#define _ROM_H_
+
+#include "mega.h"
+
+#include <SDL_atomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ROM_OFFSET	 0x200 /* 512, ROMs are loaded at this address. */
+#define ROM_MAX_SIZE (MEGA_RAM_SIZE - ROM_OFFSET) /* MegaChip ROMs. */
+#define ROM_STDIN	 "-" /* Filepath used to read the ROM from standard input. */
+
+typedef enum {
+	ROM_MAPPED = 0, /* Read-only mapping of the file, shared with the page cache. */
+	ROM_ALLOCATED,	/* Content read from a stream. */
+	ROM_BORROWED,	/* Buffer owned by the caller, never freed. */
+} rom_source_t;
+
+/* Read-only ROM content. It is reference counted, so a single ROM can be loaded
+ * by many cpus without reading the file again.
+ */
+typedef struct {
+	const uint8_t *content;
+	uint32_t size;
+
+	rom_source_t source;
+	size_t mapped_size;
+	SDL_atomic_t references;
+} rom_t;
+
+/* Open ROM from a file, or from the standard input if filepath is ROM_STDIN.
+ * Files are memory-mapped, the size is validated before reading anything.
+ */
+rom_t *rom_open(const char *filepath);
+/* Use buffer as ROM content without copying it, it must outlive the ROM. */
+rom_t *rom_from_buffer(const uint8_t *buffer, uint32_t size);
+
+/* Add a reference to the ROM. */
+rom_t *rom_retain(rom_t *rom);
+/* Remove a reference, the ROM is freed when the last one is removed. */
+void rom_release(rom_t *rom);
+
+#endif /* _ROM_H_ */
@@ -0,0 +1,39 @@
+#ifndef _ROMDB_H_
+#define _ROMDB_H_
+
+#include "cpu.h"
+#include "quirks.h"
+
+#include <stdint.h>
+
+#define ROMDB_DEFAULT_FILEPATH "chip8.db"
+
+/* Binary index layout, all values are little-endian.
+ * Header: "C8DB" magic, uint16 version, uint16 reserved, uint32 entries count.
+ * Entry: uint64 hash, uint8 profile, uint8 reserved, uint16 clock speed,
+ * uint16 scancode for each key (0 keeps the default key).
+ */
+#define ROMDB_MAGIC		  "C8DB"
+#define ROMDB_VERSION	  1
+#define ROMDB_HEADER_SIZE 12
+#define ROMDB_ENTRY_SIZE  (12 + KEYS_COUNT * 2)
+
+/* Settings recommended for a ROM. */
+typedef struct {
+	uint64_t hash;
+	profile_t profile;			 /* Platform of the ROM, with its quirks. */
+	uint16_t clock_speed;		 /* 0 if unknown. */
+	uint16_t keymap[KEYS_COUNT]; /* SDL scancode of each key, 0 keeps the default. */
+} romdb_entry_t;
+
+/* Load database index, entries are kept until romdb_free. */
+int8_t romdb_load(const char *filepath);
+void romdb_free(void);
+
+/* Return ROM settings, or NULL if the ROM is not in the database. */
+const romdb_entry_t *romdb_find(uint64_t hash);
+
+/* 64 bits FNV-1a hash of the ROM content, used as database key. */
+uint64_t romdb_hash(const uint8_t *content, uint32_t size);
+
+#endif /* _ROMDB_H_ */
@@ -0,0 +1,33 @@
+#ifndef _SCALER_H_
+#define _SCALER_H_
+
+#include "gfx.h"
+
+#include <stdint.h>
+
+/* Pixel-art scalers applied to the screen before it is uploaded or captured. */
+typedef enum {
+	SCALER_NONE,	/* The screen is stretched by the renderer. */
+	SCALER_NEAREST, /* Each pixel becomes a 4x4 block. */
+	SCALER_SCALE2X,
+	SCALER_SCALE3X,
+	SCALER_EPX, /* 2x, also rounds corners where 3 neighbours are the same. */
+	SCALER_COUNT,
+} scaler_t;
+
+/* Return scaler with the given name, or SCALER_COUNT if there is none. */
+scaler_t scaler_find(const char *name);
+const char *scaler_name(scaler_t scaler);
+uint8_t scaler_factor(scaler_t scaler); /* 1 for SCALER_NONE. */
+
+/* Scale an image of up to GFX_WIDTH x GFX_HEIGHT pixels, with rows of width pixels.
+ * The pixels are only compared and copied, so they can be colors or palette indexes.
+ * The output has width * factor pixels per row, and rows start every pitch bytes.
+ * Pixels outside of the image are copies of its edges.
+ */
+void scaler_scale(
+	scaler_t scaler, const uint32_t *pixels, uint8_t width, uint8_t height,
+	uint32_t *output, int32_t pitch
+);
+
+#endif /* _SCALER_H_ */
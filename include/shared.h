@@ -0,0 +1,74 @@
+#ifndef _SHARED_H_
+#define _SHARED_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Layout of the state exported by "--export", and the library reading it. Only the
+ * C standard library and POSIX are used, so other programs can build it alone.
+ */
+
+#define SHARED_MAGIC	 0x48533843 /* "C8SH" */
+#define SHARED_VERSION	 1
+#define SHARED_PREFIX	 "/chip8-" /* Segments are named by the emulator pid. */
+#define SHARED_NAME_SIZE 32
+
+#define SHARED_PLANES	 2
+#define SHARED_HEIGHT	 64
+#define SHARED_ROW_WORDS 2
+
+/* Cpu state after a frame. The planes are packed like gfx_plane_t, the leftmost pixel
+ * is the most significant bit of the first word of a row.
+ */
+typedef struct {
+	uint64_t frame; /* Frames published since the start, the first one is 1. */
+	uint64_t instructions;
+	uint64_t gfx[SHARED_PLANES][SHARED_HEIGHT][SHARED_ROW_WORDS];
+
+	uint16_t stack[16];
+	uint8_t V[16];
+	uint32_t I;
+	uint16_t PC;
+	uint16_t SP;
+	uint16_t opcode;
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+
+	uint8_t width; /* Current resolution, 64x32 or 128x64. */
+	uint8_t height;
+	bool is_mega; /* The MegaChip screen is shown, it is not exported. */
+	bool has_exited;
+} shared_state_t;
+
+/* The writer makes the sequence odd while it copies the state, and even once done,
+ * so readers copy the state again if the sequence was odd or has changed meanwhile.
+ * Publishing never waits for readers, and is done without syscalls.
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size; /* Size of the segment, the layout is checked by readers. */
+	_Atomic uint32_t sequence;
+	shared_state_t state;
+} shared_segment_t;
+
+typedef struct {
+	const shared_segment_t *segment;
+} shared_reader_t;
+
+/* Write the segment name of the emulator with this pid. */
+void shared_name(char name[SHARED_NAME_SIZE], int32_t pid);
+
+/* Map the segment read only. Return false and set errno if it does not exist, or if
+ * its layout is not this one (EPROTO).
+ */
+bool shared_attach(shared_reader_t *reader, const char *name);
+void shared_detach(shared_reader_t *reader);
+
+/* Copy the latest state. Return false and set errno to EAGAIN if the writer did not
+ * leave it alone after a few tries.
+ */
+bool shared_read(const shared_reader_t *reader, shared_state_t *state);
+
+#endif /* _SHARED_H_ */
@@ -3,7 +3,6 @@
 
 #include <SDL2/SDL_endian.h>
 #include <stdint.h>
-#include <stdio.h>
 
 #define STATUS_ERROR -1
 #define STATUS_OK	 0
@@ -17,14 +16,13 @@
 #define FORE_R 0xFF
 #define FORE_G 0xFF
 #define FORE_B 0xFF
-
-/* File management. */
-typedef struct {
-	char *content;
-	uint32_t lenght;
-} file_t;
-
-int8_t get_file_content(file_t *file, FILE *origin);
-void file_free(file_t *file);
+/* XO-CHIP second plane */
+#define PLANE2_R 0xFF
+#define PLANE2_G 0x66
+#define PLANE2_B 0x00
+/* XO-CHIP both planes */
+#define BLEND_R 0x66
+#define BLEND_G 0x22
+#define BLEND_B 0x00
 
 #endif /* _UTILS_H_ */
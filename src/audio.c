@@ -6,27 +6,49 @@
 #include <SDL_audio.h>
 #include <SDL_error.h>
 #include <SDL_stdinc.h>
+#include <math.h>
+#include <string.h>
 
-#define TWO_PI		   (M_PI * 2.0f)
-#define FREQUENCY	   44100.0f
-#define SINE_FREQUENCY 1000.0f
+#define FREQUENCY		  44100.0f
+#define AMPLITUDE		  0x40 /* Distance from the silence level of AUDIO_U8. */
+#define SILENCE			  0x80
+
+#define PATTERN_BITS	  (AUDIO_PATTERN_SIZE * 8)
+#define PHASE_SHIFT		  25 /* 32 bits phase, top 7 bits index the 128 pattern bits. */
+#define BASE_BIT_RATE	  4000.0f /* Pattern bits played per second at pitch 64. */
+#define BASE_PITCH		  64
+#define PITCH_PER_OCTAVE  48
+#define PITCH_COUNT		  256
 
 static struct sample_data_t {
-	double position;
-	double per_sine;
+	uint32_t position; /* Fixed point position inside the pattern. */
+	uint32_t step;	   /* Phase increment per output sample. */
+	uint8_t levels[PATTERN_BITS];
 } SampleData;
 
 static SDL_AudioDeviceID device = 0;
 static SDL_AudioSpec spec;
 
+/* Phase increment for each pitch register value, computed once at init. */
+static uint32_t phase_steps[PITCH_COUNT];
+
 static void audio_callback(void *userdata, uint8_t *stream, int32_t lenght);
 
 int8_t audio_init(void) {
 	SDL_AudioSpec desired_spec;
 
+	/* Playback rate is 4000 * 2 ^ ((pitch - 64) / 48) bits per second. */
+	for (uint32_t pitch = 0; pitch < PITCH_COUNT; pitch += 1) {
+		const double exponent = ((double)pitch - BASE_PITCH) / PITCH_PER_OCTAVE;
+		const double bit_rate = BASE_BIT_RATE * pow(2.0, exponent);
+
+		phase_steps[pitch] = (uint32_t)(bit_rate / FREQUENCY * (1u << PHASE_SHIFT));
+	}
+
 	/* Initialize sample data structure. */
-	SampleData.position = 0.0f;
-	SampleData.per_sine = SINE_FREQUENCY / FREQUENCY;
+	SampleData.position = 0;
+	SampleData.step = phase_steps[BASE_PITCH];
+	memset(SampleData.levels, SILENCE, sizeof(SampleData.levels));
 
 	/* Set desired audio specification. */
 	desired_spec.freq = FREQUENCY;
@@ -36,9 +58,8 @@ int8_t audio_init(void) {
 	desired_spec.callback = audio_callback;
 	desired_spec.userdata = &SampleData;
 
-	device = SDL_OpenAudioDevice(
-		NULL, 0, &desired_spec, &spec, SDL_AUDIO_ALLOW_FORMAT_CHANGE
-	);
+	/* Don't allow format changes, the callback only knows how to write AUDIO_U8. */
+	device = SDL_OpenAudioDevice(NULL, 0, &desired_spec, &spec, 0);
 	if (device == 0) {
 		return STATUS_ERROR;
 	}
@@ -58,11 +79,26 @@ void audio_pause(bool pause) {
 	SDL_PauseAudioDevice(device, pause ? 1 : 0);
 }
 
+void audio_set_pattern(const uint8_t *pattern, uint8_t pitch) {
+	uint8_t levels[PATTERN_BITS];
+
+	/* Expand pattern bits to output levels, so the callback only does lookups. */
+	for (uint32_t bit = 0; bit < PATTERN_BITS; bit += 1) {
+		const uint8_t is_set = (pattern[bit / 8] >> (7 - bit % 8)) & 0x1;
+		levels[bit] = is_set ? SILENCE + AMPLITUDE : SILENCE - AMPLITUDE;
+	}
+
+	SDL_LockAudioDevice(device);
+	memcpy(SampleData.levels, levels, sizeof(levels));
+	SampleData.step = phase_steps[pitch];
+	SDL_UnlockAudioDevice(device);
+}
+
 static void audio_callback(void *userdata, uint8_t *stream, int32_t lenght) {
 	struct sample_data_t *sample = (struct sample_data_t *)userdata;
 
 	for (int32_t i = 0; i < lenght; i += 1) {
-		stream[i] = sin(sample->position / sample->per_sine * TWO_PI) * 127.5;
-		sample->position += TWO_PI * sample->per_sine;
+		stream[i] = sample->levels[sample->position >> PHASE_SHIFT];
+		sample->position += sample->step;
 	}
 }
@@ -0,0 +1,264 @@
+#include "batch.h"
+
+#include "lanes.h"
+#include "log.h"
+#include "utils.h"
+
+#include <SDL_cpuinfo.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT 64		   /* Arrays start on their own cache line. */
+#define SEED_INCREMENT	0x9E3779B9 /* Environments draw different random values. */
+#define RETRY_TICKS		64		   /* Ticks before trying the vectors again. */
+#define SCALAR_SHARE	8		   /* Lanes are slower past 1 instruction in 8 by cpus. */
+
+static int32_t worker_thread(void *data);
+static void step_environments(batch_t *batch, uint32_t first, uint32_t last);
+static void step_lanes(batch_t *batch, uint32_t first, uint32_t last);
+static void apply_action(cpu_t *cpu, uint16_t keys);
+static void reset_environment(batch_t *batch, cpu_t *cpu);
+static size_t reserve(size_t *offset, size_t size); /* Return the aligned offset. */
+
+int8_t batch_init(batch_t *batch, const cpu_t *cpu, uint32_t count) {
+	size_t size = 0;
+
+	*batch = (batch_t){ .count = count };
+	SDL_AtomicSet(&batch->is_running, 1);
+
+	if (count == 0) {
+		log_error("A batch needs at least one environment!");
+		return STATUS_ERROR;
+	}
+
+	/* Carve every array from a single allocation. */
+	const size_t cpus = reserve(&size, sizeof(cpu_t) * count);
+	const size_t observations = reserve(&size, sizeof(batch_observation_t) * count);
+	const size_t actions = reserve(&size, sizeof(uint16_t) * count);
+	const size_t rewards = reserve(&size, sizeof(float) * count);
+	const size_t dones = reserve(&size, sizeof(uint8_t) * count);
+	const size_t scalar_ticks = reserve(&size, sizeof(uint8_t) * count);
+	reserve(&size, 0);
+
+	batch->arena = aligned_alloc(ARENA_ALIGNMENT, size);
+	if (batch->arena == NULL) {
+		log_error("Unable to allocate %zu bytes for %u environments!", size, count);
+		return STATUS_ERROR;
+	}
+	memset(batch->arena, 0, size);
+
+	batch->cpus = (cpu_t *)((uint8_t *)batch->arena + cpus);
+	batch->observations = (batch_observation_t *)((uint8_t *)batch->arena + observations);
+	batch->actions = (uint16_t *)((uint8_t *)batch->arena + actions);
+	batch->rewards = (float *)((uint8_t *)batch->arena + rewards);
+	batch->dones = (uint8_t *)((uint8_t *)batch->arena + dones);
+	batch->scalar_ticks = (uint8_t *)((uint8_t *)batch->arena + scalar_ticks);
+
+	/* The rom is shared by the snapshots, keep it while they run. */
+	cpu_fork(&batch->initial, cpu);
+	rom_retain(batch->initial.rom);
+
+	for (uint32_t i = 0; i < count; i += 1) {
+		cpu_t *environment = &batch->cpus[i];
+
+		memcpy(environment, &batch->initial, sizeof(cpu_t));
+		environment->random += i * SEED_INCREMENT;
+		if (environment->random == 0) {
+			environment->random = RANDOM_SEED; /* Xorshift never leaves 0. */
+		}
+	}
+
+	batch->finish = SDL_CreateSemaphore(0);
+	if (batch->finish == NULL) {
+		log_error("Unable to create batch semaphore: %s", SDL_GetError());
+		batch_quit(batch);
+		return STATUS_ERROR;
+	}
+
+	/* A slice per processor, the first one is stepped by the caller. */
+	uint32_t threads = SDL_GetCPUCount();
+	threads = threads < BATCH_MAX_THREADS ? threads : BATCH_MAX_THREADS;
+	threads = threads < count ? threads : count;
+
+	for (uint32_t i = 0; i < threads; i += 1) {
+		batch_worker_t *worker = &batch->workers[i];
+
+		worker->batch = batch;
+		worker->first = (uint64_t)count * i / threads;
+		worker->last = (uint64_t)count * (i + 1) / threads;
+		batch->workers_count += 1;
+
+		if (i > 0) {
+			worker->start = SDL_CreateSemaphore(0);
+			if (worker->start == NULL) {
+				log_error("Unable to create batch semaphore: %s", SDL_GetError());
+				batch_quit(batch);
+				return STATUS_ERROR;
+			}
+
+			worker->thread = SDL_CreateThread(worker_thread, "batch", worker);
+			if (worker->thread == NULL) {
+				log_error("Unable to create batch thread: %s", SDL_GetError());
+				batch_quit(batch);
+				return STATUS_ERROR;
+			}
+		}
+	}
+
+	log_info("Running %u environments on %u threads.", count, threads);
+	return STATUS_OK;
+}
+
+void batch_quit(batch_t *batch) {
+	SDL_AtomicSet(&batch->is_running, 0);
+
+	for (uint8_t i = 1; i < batch->workers_count; i += 1) {
+		batch_worker_t *worker = &batch->workers[i];
+
+		if (worker->thread != NULL) {
+			SDL_SemPost(worker->start);
+			SDL_WaitThread(worker->thread, NULL);
+			worker->thread = NULL;
+		}
+		if (worker->start != NULL) {
+			SDL_DestroySemaphore(worker->start);
+			worker->start = NULL;
+		}
+	}
+	batch->workers_count = 0;
+
+	if (batch->finish != NULL) {
+		SDL_DestroySemaphore(batch->finish);
+		batch->finish = NULL;
+	}
+
+	if (batch->arena != NULL) {
+		rom_release(batch->initial.rom);
+		free(batch->arena);
+		batch->arena = NULL;
+	}
+}
+
+void batch_set_reward(batch_t *batch, batch_reward_t reward, void *data) {
+	batch->reward = reward;
+	batch->reward_data = data;
+}
+
+void batch_step(batch_t *batch) {
+	for (uint8_t i = 1; i < batch->workers_count; i += 1) {
+		SDL_SemPost(batch->workers[i].start);
+	}
+
+	step_environments(batch, batch->workers[0].first, batch->workers[0].last);
+
+	for (uint8_t i = 1; i < batch->workers_count; i += 1) {
+		SDL_SemWait(batch->finish);
+	}
+}
+
+void batch_reset(batch_t *batch) {
+	for (uint32_t i = 0; i < batch->count; i += 1) {
+		reset_environment(batch, &batch->cpus[i]);
+	}
+}
+
+static int32_t worker_thread(void *data) {
+	batch_worker_t *worker = data;
+	batch_t *batch = worker->batch;
+
+	while (true) {
+		SDL_SemWait(worker->start);
+		if (SDL_AtomicGet(&batch->is_running) == 0) {
+			break;
+		}
+
+		step_environments(batch, worker->first, worker->last);
+		SDL_SemPost(batch->finish);
+	}
+
+	return STATUS_OK;
+}
+
+static void step_environments(batch_t *batch, uint32_t first, uint32_t last) {
+	for (uint32_t i = first; i < last; i += 1) {
+		apply_action(&batch->cpus[i], batch->actions[i]);
+	}
+
+	/* Errors end the episode, as the program cannot go on. */
+	if (batch->use_lanes) {
+		step_lanes(batch, first, last);
+	} else {
+		for (uint32_t i = first; i < last; i += 1) {
+			batch->dones[i] = cpu_step_tick(&batch->cpus[i], NULL) != STATUS_OK;
+		}
+	}
+
+	for (uint32_t i = first; i < last; i += 1) {
+		cpu_t *cpu = &batch->cpus[i];
+
+		memcpy(batch->observations[i], cpu->gfx, sizeof(batch_observation_t));
+		batch->rewards[i] = batch->reward != NULL ? batch->reward(cpu, batch->reward_data)
+												  : 0;
+		batch->dones[i] |= cpu->has_exited;
+		if (batch->dones[i]) {
+			reset_environment(batch, cpu);
+		}
+	}
+}
+
+static void step_lanes(batch_t *batch, uint32_t first, uint32_t last) {
+	for (uint32_t i = first; i < last; i += LANES_COUNT) {
+		lanes_t lanes = { .count = last - i < LANES_COUNT ? last - i : LANES_COUNT };
+
+		/* Programs doing many other instructions run faster on each cpu. */
+		if (batch->scalar_ticks[i] > 0) {
+			batch->scalar_ticks[i] -= 1;
+			for (uint8_t lane = 0; lane < lanes.count; lane += 1) {
+				batch->dones[i + lane] = cpu_step_tick(&batch->cpus[i + lane], NULL)
+									  != STATUS_OK;
+			}
+			continue;
+		}
+
+		for (uint8_t lane = 0; lane < lanes.count; lane += 1) {
+			lanes.cpus[lane] = &batch->cpus[i + lane];
+		}
+
+		lanes_step_tick(&lanes);
+		for (uint8_t lane = 0; lane < lanes.count; lane += 1) {
+			batch->dones[i + lane] = lanes.has_failed[lane];
+		}
+		const uint64_t scalar = lanes.scalar_instructions;
+		if (scalar * SCALAR_SHARE > lanes.vector_instructions + scalar) {
+			batch->scalar_ticks[i] = RETRY_TICKS;
+		}
+	}
+}
+
+static void apply_action(cpu_t *cpu, uint16_t keys) {
+	bool has_changed = false;
+
+	for (uint8_t key = 0; key < KEYS_COUNT; key += 1) {
+		const uint8_t state = (keys >> key) & 1;
+
+		has_changed |= cpu->key_state[key] != state;
+		cpu->key_state[key] = state;
+	}
+	if (has_changed) {
+		cpu->is_halted = false; /* Let 0xFx0A check the keys again. */
+	}
+}
+
+static void reset_environment(batch_t *batch, cpu_t *cpu) {
+	const uint32_t random = cpu->random; /* Episodes do not repeat each other. */
+
+	cpu_clone(cpu, &batch->initial); /* Only the memory written by the episode. */
+	cpu->random = random;
+}
+
+static size_t reserve(size_t *offset, size_t size) {
+	const size_t start = (*offset + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+	*offset = start + size;
+	return start;
+}
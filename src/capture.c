@@ -0,0 +1,380 @@
+#include "capture.h"
+
+#include "log.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_RATE 60 /* One frame per timer tick. */
+#define RGB_SUFFIX ".rgb"
+
+/* Components of each color, in the order of the stream pixels: R, G, B for raw frames,
+ * and Y, Cb, Cr (BT.601, limited range) for Y4M. Colors are the ones of the planes
+ * bits, as the display palette, or the phosphor ramp.
+ */
+static uint8_t colors[PHOSPHOR_RAMP_SIZE][3];
+static uint32_t ramp_indexes[PHOSPHOR_RAMP_SIZE]; /* Phosphor ramp of the colors. */
+
+static void init_colors(capture_format_t format, bool has_phosphor);
+static int32_t writer_thread(void *data);
+/* Write the previous frame, plus its repeats. */
+static void write_previous(capture_t *capture, uint32_t repeats);
+static void write_image(capture_t *capture, uint32_t repeats);
+static void convert_slot(capture_t *capture, const capture_slot_t *slot);
+/* Fade the phosphor of the previous screen by one frame. */
+static void fade_screen(capture_t *capture);
+static void convert_screen(capture_t *capture);
+/* Write the palette index of each pixel of the screen, in rows of its width. */
+static void expand_screen(const capture_t *capture, uint32_t *indexes);
+
+int8_t capture_init(
+	capture_t *capture, const char *path, uint8_t scale, scaler_t scaler,
+	uint8_t phosphor, bool is_eliding, bool is_blocking
+) {
+	const size_t length = strlen(path);
+	const size_t suffix_length = strlen(RGB_SUFFIX);
+
+	*capture = (capture_t){
+		.format = CAPTURE_Y4M,
+		.scale = scale,
+		.scaler = scaler,
+		.is_eliding = is_eliding,
+		.is_blocking = is_blocking,
+		.has_phosphor = phosphor > 0,
+	};
+	phosphor_init(&capture->phosphor, phosphor);
+
+	if (scale == 0 || scale > CAPTURE_MAX_SCALE) {
+		log_error("Invalid capture scale, expected 1-%d: %u", CAPTURE_MAX_SCALE, scale);
+		return STATUS_ERROR;
+	}
+	const char *suffix = length > suffix_length ? path + length - suffix_length : "";
+	if (strcmp(suffix, RGB_SUFFIX) == 0) {
+		capture->format = CAPTURE_RGB;
+	}
+
+	capture->file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+	if (capture->file == NULL) {
+		log_error("Unable to open capture file: %s", path);
+		return STATUS_ERROR;
+	}
+
+	/* Both formats have 3 bytes per pixel, in planes for Y4M. */
+	const uint32_t width = CAPTURE_WIDTH * scale;
+	const uint32_t height = CAPTURE_HEIGHT * scale;
+	capture->image_size = (size_t)width * height * 3;
+	capture->image = malloc(capture->image_size);
+	if (capture->image == NULL) {
+		log_error("Unable to allocate capture image!");
+		capture_quit(capture);
+		return STATUS_ERROR;
+	}
+
+	if (scaler != SCALER_NONE) {
+		const size_t factor = scaler_factor(scaler);
+		const size_t size = GFX_WIDTH * factor * GFX_HEIGHT * factor;
+		capture->scaled = malloc(size * sizeof(uint32_t));
+		if (capture->scaled == NULL) {
+			log_error("Unable to allocate scaled capture screen!");
+			capture_quit(capture);
+			return STATUS_ERROR;
+		}
+	}
+
+	init_colors(capture->format, capture->has_phosphor);
+	if (capture->format == CAPTURE_Y4M) {
+		fprintf(
+			capture->file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", width, height,
+			FRAME_RATE
+		);
+	}
+
+	capture->free_slots = SDL_CreateSemaphore(CAPTURE_BUFFERS);
+	capture->ready_slots = SDL_CreateSemaphore(0);
+	if (capture->free_slots == NULL || capture->ready_slots == NULL) {
+		log_error("Unable to create capture semaphores: %s", SDL_GetError());
+		capture_quit(capture);
+		return STATUS_ERROR;
+	}
+
+	capture->writer = SDL_CreateThread(writer_thread, "capture", capture);
+	if (capture->writer == NULL) {
+		log_error("Unable to create capture thread: %s", SDL_GetError());
+		capture_quit(capture);
+		return STATUS_ERROR;
+	}
+
+	log_info("Capturing %ux%u frames to %s", width, height, path);
+	return STATUS_OK;
+}
+
+void capture_quit(capture_t *capture) {
+	/* The last slot ends the stream after the repeats of the last frame. */
+	if (capture->writer != NULL) {
+		SDL_SemWait(capture->free_slots);
+		capture_slot_t *slot = &capture->slots[capture->head % CAPTURE_BUFFERS];
+		slot->repeats = capture->repeats;
+		slot->is_last = true;
+		capture->head += 1;
+		SDL_SemPost(capture->ready_slots);
+
+		SDL_WaitThread(capture->writer, NULL);
+		capture->writer = NULL;
+		log_info(
+			"Captured %llu frames, %u written as repeats as the writer was late.",
+			(unsigned long long)capture->written, capture->dropped
+		);
+	}
+
+	if (capture->free_slots != NULL) {
+		SDL_DestroySemaphore(capture->free_slots);
+		capture->free_slots = NULL;
+	}
+	if (capture->ready_slots != NULL) {
+		SDL_DestroySemaphore(capture->ready_slots);
+		capture->ready_slots = NULL;
+	}
+
+	if (capture->file != NULL && capture->file != stdout) {
+		fclose(capture->file);
+	} else if (capture->file != NULL) {
+		fflush(capture->file);
+	}
+	capture->file = NULL;
+
+	free(capture->image);
+	capture->image = NULL;
+	free(capture->scaled);
+	capture->scaled = NULL;
+}
+
+void capture_frame(capture_t *capture, const cpu_t *cpu) {
+	if (capture->has_last && capture->last_width == cpu->gfx_width
+		&& memcmp(capture->last, cpu->gfx, sizeof(capture->last)) == 0) {
+		capture->repeats += 1;
+		return;
+	}
+
+	/* A dropped frame shows the previous one, so the stream keeps its timing. */
+	if (capture->is_blocking) {
+		SDL_SemWait(capture->free_slots);
+	} else if (SDL_SemTryWait(capture->free_slots) != 0) {
+		capture->repeats += 1;
+		capture->dropped += 1;
+		return;
+	}
+
+	capture_slot_t *slot = &capture->slots[capture->head % CAPTURE_BUFFERS];
+	memcpy(slot->gfx, cpu->gfx, sizeof(slot->gfx));
+	slot->width = cpu->gfx_width;
+	slot->repeats = capture->repeats;
+	slot->is_last = false;
+	capture->head += 1;
+	SDL_SemPost(capture->ready_slots);
+
+	memcpy(capture->last, cpu->gfx, sizeof(capture->last));
+	capture->last_width = cpu->gfx_width;
+	capture->has_last = true;
+	capture->repeats = 0;
+}
+
+static void init_colors(capture_format_t format, bool has_phosphor) {
+	const uint8_t planes_colors[PHOSPHOR_COLORS][3] = {
+		{ BACK_R, BACK_G, BACK_B },
+		{ FORE_R, FORE_G, FORE_B },
+		{ PLANE2_R, PLANE2_G, PLANE2_B },
+		{ BLEND_R, BLEND_G, BLEND_B },
+	};
+	uint8_t rgb[PHOSPHOR_RAMP_SIZE][3];
+	size_t count = PHOSPHOR_COLORS;
+
+	memcpy(rgb, planes_colors, sizeof(planes_colors));
+	if (has_phosphor) {
+		phosphor_ramp(rgb, planes_colors);
+		count = PHOSPHOR_RAMP_SIZE;
+	}
+
+	for (size_t i = 0; i < count; i += 1) {
+		const int32_t r = rgb[i][0];
+		const int32_t g = rgb[i][1];
+		const int32_t b = rgb[i][2];
+
+		ramp_indexes[i] = i;
+		if (format == CAPTURE_RGB) {
+			memcpy(colors[i], rgb[i], 3);
+			continue;
+		}
+
+		colors[i][0] = 16 + (66 * r + 129 * g + 25 * b + 128) / 256;
+		colors[i][1] = 128 + (-38 * r - 74 * g + 112 * b + 128) / 256;
+		colors[i][2] = 128 + (112 * r - 94 * g - 18 * b + 128) / 256;
+	}
+}
+
+static int32_t writer_thread(void *data) {
+	capture_t *capture = data;
+
+	while (true) {
+		SDL_SemWait(capture->ready_slots);
+		const capture_slot_t *slot = &capture->slots[capture->tail % CAPTURE_BUFFERS];
+		capture->tail += 1;
+
+		write_previous(capture, slot->repeats);
+		if (slot->is_last) {
+			break;
+		}
+
+		convert_slot(capture, slot);
+		SDL_SemPost(capture->free_slots);
+	}
+
+	return 0;
+}
+
+static void write_previous(capture_t *capture, uint32_t repeats) {
+	if (!capture->has_image) {
+		return;
+	}
+
+	/* Repeated screens still fade, they are only equal once the phosphor is settled. */
+	while (capture->has_phosphor && !capture->phosphor.is_settled && repeats > 0) {
+		write_image(capture, 0);
+		fade_screen(capture);
+		repeats -= 1;
+	}
+
+	if (capture->is_eliding) {
+		write_image(capture, repeats);
+		return;
+	}
+	for (uint32_t i = 0; i <= repeats; i += 1) {
+		write_image(capture, 0);
+	}
+}
+
+static void write_image(capture_t *capture, uint32_t repeats) {
+	if (capture->has_failed) {
+		return; /* Slots are still read, so the emulation thread is not blocked. */
+	}
+
+	/* Players ignore the frame parameters, the repeats are kept for other tools. */
+	if (capture->format == CAPTURE_Y4M && repeats > 0) {
+		fprintf(capture->file, "FRAME XREPEAT=%u\n", repeats);
+	} else if (capture->format == CAPTURE_Y4M) {
+		fputs("FRAME\n", capture->file);
+	}
+
+	if (fwrite(capture->image, capture->image_size, 1, capture->file) != 1) {
+		log_error("Unable to write captured frame, the capture is stopped.");
+		capture->has_failed = true;
+		return;
+	}
+	capture->written += 1;
+}
+
+static void convert_slot(capture_t *capture, const capture_slot_t *slot) {
+	/* The slot is reused once converted, the screen is kept for the repeats. */
+	memcpy(capture->screen, slot->gfx, sizeof(capture->screen));
+	capture->screen_width = slot->width;
+
+	if (capture->has_phosphor) {
+		fade_screen(capture);
+	} else {
+		convert_screen(capture);
+	}
+}
+
+static void fade_screen(capture_t *capture) {
+	const uint8_t width = capture->screen_width;
+	const uint8_t height = width == GFX_WIDTH ? GFX_HEIGHT : GFX_LORES_HEIGHT;
+
+	phosphor_step(&capture->phosphor, capture->screen, width, height, 1);
+	convert_screen(capture);
+}
+
+static void convert_screen(capture_t *capture) {
+	const uint8_t screen_width = capture->screen_width;
+	const bool is_hires = screen_width == GFX_WIDTH;
+	const uint8_t screen_height = is_hires ? GFX_HEIGHT : GFX_LORES_HEIGHT;
+	const uint8_t factor = scaler_factor(capture->scaler);
+	const size_t width = CAPTURE_WIDTH * capture->scale;
+	const size_t height = CAPTURE_HEIGHT * capture->scale;
+	const size_t plane_size = width * height;
+	const size_t line_size = capture->format == CAPTURE_Y4M ? width : width * 3;
+	const uint8_t planes = capture->format == CAPTURE_Y4M ? 3 : 1;
+	uint32_t indexes[GFX_HEIGHT * GFX_WIDTH];
+	uint16_t columns[CAPTURE_WIDTH * CAPTURE_MAX_SCALE];
+
+	if (capture->has_phosphor) {
+		phosphor_colors(
+			&capture->phosphor, ramp_indexes, indexes, screen_width * sizeof(uint32_t)
+		);
+	} else {
+		expand_screen(capture, indexes);
+	}
+
+	const uint32_t *source = indexes;
+	const size_t source_width = screen_width * factor;
+	const size_t source_height = screen_height * factor;
+	if (capture->scaler != SCALER_NONE) {
+		scaler_scale(
+			capture->scaler, indexes, screen_width, screen_height, capture->scaled,
+			source_width * sizeof(uint32_t)
+		);
+		source = capture->scaled;
+	}
+
+	/* The source is resized to the frame by nearest pixels. */
+	for (size_t x = 0; x < width; x += 1) {
+		columns[x] = x * source_width / width;
+	}
+
+	for (size_t y = 0; y < height; y += 1) {
+		const size_t row = y * source_height / height;
+
+		/* Lines of the same source row are copies of the first one. */
+		if (y > 0 && row == (y - 1) * source_height / height) {
+			for (uint8_t plane = 0; plane < planes; plane += 1) {
+				uint8_t *line = capture->image + plane * plane_size + y * line_size;
+				memcpy(line, line - line_size, line_size);
+			}
+			continue;
+		}
+
+		const uint32_t *row_indexes = &source[row * source_width];
+		for (uint8_t component = 0; component < 3; component += 1) {
+			uint8_t *line = NULL;
+			size_t step = 1;
+
+			if (capture->format == CAPTURE_Y4M) {
+				line = capture->image + component * plane_size + y * width;
+			} else {
+				line = capture->image + y * line_size + component;
+				step = 3;
+			}
+
+			for (size_t x = 0; x < width; x += 1) {
+				line[x * step] = colors[row_indexes[columns[x]]][component];
+			}
+		}
+	}
+
+	capture->has_image = true;
+}
+
+static void expand_screen(const capture_t *capture, uint32_t *indexes) {
+	const uint8_t width = capture->screen_width;
+	const uint8_t height = width == GFX_WIDTH ? GFX_HEIGHT : GFX_LORES_HEIGHT;
+
+	for (uint8_t y = 0; y < height; y += 1) {
+		for (uint8_t x = 0; x < width; x += 1) {
+			const uint8_t word = x / GFX_WORD_BITS;
+			const uint8_t shift = GFX_WORD_BITS - 1 - x % GFX_WORD_BITS;
+			const uint64_t first = capture->screen[0][y][word] >> shift;
+			const uint64_t second = capture->screen[1][y][word] >> shift;
+
+			indexes[y * width + x] = (first & 1) | (second & 1) << 1;
+		}
+	}
+}
@@ -1,6 +1,7 @@
 #include "configs.h"
 
 #include "log.h"
+#include "romdb.h"
 #include "utils.h"
 
 #include <cargs.h>
@@ -12,6 +13,7 @@
 #define DEFAULT_HEIGHT		600
 #define DEFAULT_CLOCK_SPEED 400 /* Speed in Hz */
 #define MAX_CLOCK_SPEED		1000
+#define DEFAULT_PHOSPHOR	60 /* Erased pixels are dark after 6 ticks. */
 
 enum {
 	LOG_ALL = -1,
@@ -33,6 +35,133 @@ static struct cag_option options[] = {
 		.value_name = "<int>",
 		.description = "Set clock speed.",
 	},
+	{
+		.identifier = 'p',
+		.access_letters = "p",
+		.access_name = "profile",
+		.value_name = "<name>",
+		.description = "Set quirks profile (vip, chip48, schip, xochip, megachip).",
+	},
+	{
+		.identifier = 'm',
+		.access_letters = NULL,
+		.access_name = "bounds",
+		.value_name = "<name>",
+		.description = "Wrap or trap accesses past the end of memory, default is wrap.",
+	},
+	{
+		.identifier = 'd',
+		.access_letters = "d",
+		.access_name = "database",
+		.value_name = "<path>",
+		.description = "Set rom database path.",
+	},
+	{
+		.identifier = 't',
+		.access_letters = "t",
+		.access_name = "turbo",
+		.description = "Run as fast as possible, without real-time pacing.",
+	},
+	{
+		.identifier = 'l',
+		.access_letters = NULL,
+		.access_name = "headless",
+		.description = "Run in turbo mode without window and audio.",
+	},
+	{
+		.identifier = 'f',
+		.access_letters = "f",
+		.access_name = "frames",
+		.value_name = "<int>",
+		.description = "Set frames to run in headless mode, 0 runs until exit.",
+	},
+	{
+		.identifier = 'b',
+		.access_letters = NULL,
+		.access_name = "batch",
+		.value_name = "<int>",
+		.description = "Step many environments with random keys in headless mode.",
+	},
+	{
+		.identifier = 'n',
+		.access_letters = NULL,
+		.access_name = "lanes",
+		.description = "Step the batch environments 16 at a time with vector registers.",
+	},
+	{
+		.identifier = 'j',
+		.access_letters = NULL,
+		.access_name = "fuzz",
+		.value_name = "<int>",
+		.description = "Compare the execution engines on cases mutated from the rom.",
+	},
+	{
+		.identifier = 'g',
+		.access_letters = NULL,
+		.access_name = "debug",
+		.value_name = "<path>",
+		.description = "Accept debugger commands on a Unix socket at path.",
+	},
+	{
+		.identifier = 'r',
+		.access_letters = NULL,
+		.access_name = "run-ahead",
+		.value_name = "<int>",
+		.description = "Show the screen up to 8 timer ticks ahead, to hide input lag.",
+	},
+	{
+		.identifier = 'y',
+		.access_letters = NULL,
+		.access_name = "latency",
+		.description = "Print the input to screen latency histogram at exit.",
+	},
+	{
+		.identifier = 'k',
+		.access_letters = NULL,
+		.access_name = "link",
+		.value_name = "<port>:<peer port>",
+		.description = "Share the session with another instance on this machine.",
+	},
+	{
+		.identifier = 'x',
+		.access_letters = NULL,
+		.access_name = "export",
+		.description = "Publish each frame screen and registers in shared memory.",
+	},
+	{
+		.identifier = 'o',
+		.access_letters = NULL,
+		.access_name = "capture",
+		.value_name = "<path>",
+		.description = "Write the frames as Y4M, or raw RGB if path ends with .rgb.",
+	},
+	{
+		.identifier = 's',
+		.access_letters = NULL,
+		.access_name = "capture-scale",
+		.value_name = "<int>",
+		.description = "Scale the captured frames, from 1 to 16, default is 4.",
+	},
+	{
+		.identifier = 'e',
+		.access_letters = NULL,
+		.access_name = "capture-elide",
+		.description = "Write repeated frames once, flagged with XREPEAT in Y4M.",
+	},
+	{
+		.identifier = 'z',
+		.access_letters = NULL,
+		.access_name = "scaler",
+		.value_name = "<name>",
+		.description = "Scale the screen (none, nearest, scale2x, scale3x, epx).",
+	},
+	{
+		.identifier = 'u',
+		.access_letters = NULL,
+		.access_name = "phosphor",
+		.value_name = "<int>",
+		.description = "Fade erased pixels, keeping 1-99 percent at each tick.",
+	},
 	{
 		.identifier = 'w',
 		.access_letters = NULL,
@@ -75,8 +204,13 @@ static void show_help_message(void);
 
 static int8_t set_rom_filepath(char *filepath, char *value);
 static void set_clock(uint16_t *clock, const char *value);
+static int8_t set_profile(profile_t *profile, const char *value);
+static int8_t set_bounds(bounds_t *bounds, const char *value);
+static int8_t set_scaler(scaler_t *scaler, const char *value);
+static void set_phosphor(uint8_t *phosphor, const char *value);
 static void set_width(int16_t *width, const char *value);
 static void set_height(int16_t *height, const char *value);
+static void set_run_ahead(uint8_t *run_ahead, const char *value);
 
 int8_t cfg_parse_options(configs_t *config, int argc, char *argv[]) {
 	char identifier;
@@ -91,6 +225,8 @@ int8_t cfg_parse_options(configs_t *config, int argc, char *argv[]) {
 	*config = (configs_t){
 		.rom_filepath = "",
 		.clock_speed = DEFAULT_CLOCK_SPEED,
+		.profile = DEFAULT_PROFILE,
+		.database_filepath = ROMDB_DEFAULT_FILEPATH,
 		.width = DEFAULT_WIDTH,
 		.height = DEFAULT_HEIGHT,
 	};
@@ -120,6 +256,65 @@ static int8_t fetch_identifier(
 	switch (identifier) {
 	case 'c':
 		set_clock(&config->clock_speed, value);
+		config->options |= CFG_CLOCK_SPEED;
+		break;
+	case 'p':
+		config->options |= CFG_PROFILE;
+		return set_profile(&config->profile, value);
+	case 'm':
+		return set_bounds(&config->bounds, value);
+	case 'd':
+		config->database_filepath = value != NULL ? value : ROMDB_DEFAULT_FILEPATH;
+		break;
+	case 't':
+		config->is_turbo = true;
+		break;
+	case 'l':
+		config->is_headless = true;
+		config->is_turbo = true;
+		break;
+	case 'f':
+		config->frames = value != NULL ? strtoul(value, NULL, 10) : 0;
+		break;
+	case 'b':
+		config->batch = value != NULL ? strtoul(value, NULL, 10) : 0;
+		break;
+	case 'n':
+		config->use_lanes = true;
+		break;
+	case 'j':
+		config->fuzz_cases = value != NULL ? strtoul(value, NULL, 10) : 0;
+		config->is_headless = true;
+		config->is_turbo = true;
+		break;
+	case 'g':
+		config->debug_socket_path = value;
+		break;
+	case 'r':
+		set_run_ahead(&config->run_ahead, value);
+		break;
+	case 'y':
+		config->show_latency = true;
+		break;
+	case 'k':
+		config->link_address = value;
+		break;
+	case 'x':
+		config->is_exporting = true;
+		break;
+	case 'o':
+		config->capture_path = value;
+		break;
+	case 's':
+		config->capture_scale = value != NULL ? strtoul(value, NULL, 10) : 0;
+		break;
+	case 'e':
+		config->is_eliding = true;
+		break;
+	case 'z':
+		return set_scaler(&config->scaler, value);
+	case 'u':
+		set_phosphor(&config->phosphor, value);
 		break;
 	case 'w':
 		set_width(&config->width, value);
@@ -144,6 +339,7 @@ static int8_t fetch_identifier(
 static void show_help_message(void) {
 	/* TODO: Better help message. */
 	puts("Usage: Chip8 [OPTIONS] <path-to-rom>");
+	puts("Use '-' as path to read the rom from standard input.");
 	cag_option_print(options, CAG_ARRAY_SIZE(options), stdout);
 }
 
@@ -167,6 +363,55 @@ static void set_clock(uint16_t *clock, const char *value) {
 	}
 }
 
+static int8_t set_profile(profile_t *profile, const char *value) {
+	if (value != NULL) {
+		const profile_t found = quirks_find_profile(value);
+		if (found == PROFILE_COUNT) {
+			log_error("Unknown quirks profile: %s", value);
+			return STATUS_STOP;
+		}
+
+		*profile = found;
+	}
+
+	return STATUS_CONTINUE;
+}
+
+static int8_t set_bounds(bounds_t *bounds, const char *value) {
+	if (value != NULL) {
+		const bounds_t found = cpu_find_bounds(value);
+		if (found == BOUNDS_COUNT) {
+			log_error("Unknown bounds policy: %s", value);
+			return STATUS_STOP;
+		}
+
+		*bounds = found;
+	}
+
+	return STATUS_CONTINUE;
+}
+
+static int8_t set_scaler(scaler_t *scaler, const char *value) {
+	if (value != NULL) {
+		const scaler_t found = scaler_find(value);
+		if (found == SCALER_COUNT) {
+			log_error("Unknown scaler: %s", value);
+			return STATUS_STOP;
+		}
+
+		*scaler = found;
+	}
+
+	return STATUS_CONTINUE;
+}
+
+static void set_phosphor(uint8_t *phosphor, const char *value) {
+	if (value != NULL) {
+		int32_t percent = strtol(value, NULL, 10);
+		*phosphor = percent > 0 && percent < 100 ? percent : DEFAULT_PHOSPHOR;
+	}
+}
+
 static void set_width(int16_t *width, const char *value) {
 	if (value != NULL) {
 		int32_t size = strtol(value, NULL, 10);
@@ -180,3 +425,10 @@ static void set_height(int16_t *height, const char *value) {
 		*height = size != 0 ? size : DEFAULT_HEIGHT;
 	}
 }
+
+static void set_run_ahead(uint8_t *run_ahead, const char *value) {
+	if (value != NULL) {
+		int32_t ticks = strtol(value, NULL, 10);
+		*run_ahead = ticks > 0 && ticks <= MAX_RUN_AHEAD ? ticks : 0;
+	}
+}
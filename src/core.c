@@ -1,61 +1,232 @@
 #include "core.h"
 
 #include "audio.h"
+#include "batch.h"
+#include "capture.h"
 #include "cpu.h"
+#include "debug.h"
 #include "display.h"
+#include "export.h"
+#include "frame.h"
+#include "fuzz.h"
 #include "input.h"
+#include "latency.h"
+#include "link.h"
 #include "log.h"
+#include "overlay.h"
+#include "rom.h"
+#include "romdb.h"
 #include "utils.h"
 
 #include <SDL2/SDL.h>
 
-static void update_fps(void);
+static int8_t run_headless(void);
+static int8_t run_batch(void);
+static int8_t run_fuzz(void);
+static int32_t emulation_thread(void *data);
+static void apply_rom_settings(configs_t *configs, const rom_t *rom);
+static void handle_event(SDL_Event *event);
+static bool handle_hotkey(SDL_Scancode scancode);
+static void wait_halted(void);
+static void publish_frame(void);
+static void run_ahead(void);
+static void capture_frames(void);
+static void export_frames(void);
+static void update_screen(frame_t *frame);
+static void fade_screen(void);
+static uint32_t elapsed_time(uint64_t start, uint64_t end); /* In microseconds. */
 static void core_exit(void);
 
 static struct {
 	bool is_running;
 
 	display_t display;
-	cpu_t cpu;
+	cpu_t cpu; /* Owned by the emulation thread while it runs. */
 	input_t input;
+	debugger_t debugger; /* Used by the thread running the cpu. */
+	overlay_t overlay;
 
-	uint16_t current_fps;
+	/* Emulation runs on its own thread, so presenting does not delay cpu cycles.
+	 * Screens are handed to the render thread through the triple buffer and key
+	 * events are handed to the emulation thread through the events queue.
+	 */
+	SDL_Thread *emulation;
+	SDL_atomic_t is_emulating;
+	event_queue_t events;
+	frame_buffer_t frames;
+
+	/* While the cpu is halted by 0xFx0A, both threads sleep until a key event or
+	 * the next timer tick. The emulation thread is woken by the wake semaphore.
+	 */
+	SDL_sem *wake;
+	SDL_atomic_t is_halted;
+	SDL_atomic_t halt_timeout; /* Milliseconds until the next timer tick. */
+	uint64_t idle_time;		   /* Milliseconds slept while halted. */
+
+	/* Work of the emulation thread since the previous frame, shown by the overlay. */
+	SDL_atomic_t cpu_time; /* Microseconds. */
+	SDL_atomic_t instructions;
+
+	/* The screen shown can be the one of a copy of the cpu run some timer ticks
+	 * ahead, hiding the frames programs take to react to keys.
+	 */
+	uint8_t run_ahead;
+	cpu_t ahead;
+	uint64_t next_run_ahead; /* Time of the next run, unless a key is pressed. */
+
+	/* Two players session, the cpu runs frames in lockstep with the remote one. */
+	link_t link;
+	bool is_linked;
+
+	/* Frames are published to shared memory for other programs, at the timer rate. */
+	export_t export;
+	bool is_exporting;
+	uint64_t export_start; /* Time of the first frame in real time. */
+	uint64_t exported_ticks;
+
+	/* Frames written to a video stream, at the timer rate. */
+	capture_t capture;
+	bool is_capturing;
+	uint64_t capture_start; /* Time of the first frame in real time. */
+	uint64_t captured_frames;
+
+	/* The screen phosphor fades at the timer rate, by the render thread. */
+	uint64_t fade_start;
+	uint64_t faded_ticks;
+
+	latency_t latency; /* Owned by the render thread. */
+	bool show_latency;
+
+	bool is_turbo;
+	bool is_headless;
+	uint32_t headless_frames; /* Timer ticks to run in headless mode. */
+	uint32_t batch_count;	  /* Environments stepped together in headless mode. */
+	bool use_lanes;
+	uint32_t fuzz_cases; /* Cases of the differential fuzzer in headless mode. */
 } Core;
 
-static uint64_t last_time = 0;
-static uint64_t fps_count = 0;
-static double fps_timer = 0.0f;
+/* Longest sleep while halted without running timers. */
+#define HALT_TIMEOUT 250
+
+/* Frames stepped by a batch when none are set. */
+#define BATCH_DEFAULT_FRAMES 600
+
+/* Reproducers of the fuzzer divergences, numbered from 1. */
+#define FUZZ_REPRODUCER_FORMAT "fuzz-%u.ch8"
+
+/* Debugger hotkeys, and the sleep between commands while paused. */
+#define DEBUG_PAUSE_KEY SDL_SCANCODE_F5
+#define DEBUG_STEP_KEY	SDL_SCANCODE_F6
+#define DEBUG_VIEW_KEY	SDL_SCANCODE_F7
+#define DEBUG_DELAY		10
+
+#define OVERLAY_KEY SDL_SCANCODE_F1
 
 int8_t core_init(configs_t configs) {
-	uint32_t init_flags = SDL_INIT_EVERYTHING;
+	Core.is_turbo = configs.is_turbo;
+	Core.is_headless = configs.is_headless;
+	Core.headless_frames = configs.frames;
+	Core.batch_count = configs.batch;
+	Core.use_lanes = configs.use_lanes;
+	Core.fuzz_cases = configs.fuzz_cases;
+	Core.run_ahead = configs.run_ahead;
+	Core.show_latency = configs.show_latency;
+
+	/* Headless mode has no window and audio. */
+	uint32_t init_flags = Core.is_headless ? SDL_INIT_TIMER : SDL_INIT_EVERYTHING;
 	if (SDL_Init(init_flags) < 0) {
 		log_fatal("Unable to init SDL2: %s", SDL_GetError());
 		return STATUS_ERROR;
 	}
 
-	if (create_display(&Core.display, configs.width, configs.height) != STATUS_OK) {
+	if (!Core.is_headless
+		&& create_display(
+			   &Core.display, configs.width, configs.height, configs.scaler,
+			   configs.phosphor
+		   ) != STATUS_OK) {
 		log_fatal("Unable to create display!");
 		return STATUS_ERROR;
 	}
 
-	if (audio_init() != STATUS_OK) {
+	if (!Core.is_headless && overlay_init(&Core.overlay, &Core.display) != STATUS_OK) {
+		log_fatal("Unable to create performance overlay!");
+		return STATUS_ERROR;
+	}
+
+	if (!Core.is_headless && audio_init() != STATUS_OK) {
 		log_fatal("Unable to initialize audio device!");
 		return STATUS_ERROR;
 	}
 
-	if (cpu_init(&Core.cpu, configs.clock_speed) != STATUS_OK) {
+	rom_t *rom = rom_open(configs.rom_filepath);
+	if (rom == NULL) {
+		log_error("Unable to open rom!");
+		core_exit();
+		return STATUS_ERROR;
+	}
+
+	input_init(&Core.input);
+	apply_rom_settings(&configs, rom);
+
+	if (cpu_init(&Core.cpu, configs.clock_speed, configs.profile) != STATUS_OK) {
 		log_fatal("Unable to init Chip-8 CPU!");
+		rom_release(rom);
 		core_exit();
 		return STATUS_ERROR;
 	}
+	Core.cpu.bounds = configs.bounds;
+
+	/* The cpu keeps its own reference to the rom. */
+	const int8_t status = cpu_loadrom(&Core.cpu, rom);
+	rom_release(rom);
 
-	if (cpu_loadrom(&Core.cpu, configs.rom_filepath) != STATUS_OK) {
+	if (status != STATUS_OK) {
 		log_error("Unable to load rom to memory!");
 		core_exit();
 		return STATUS_ERROR;
 	}
 
-	input_init(&Core.input);
+	if (debug_init(&Core.debugger, &Core.cpu, configs.debug_socket_path) != STATUS_OK) {
+		log_fatal("Unable to start debugger!");
+		core_exit();
+		return STATUS_ERROR;
+	}
+
+	/* Linked frames are rolled back already, they are not run ahead. */
+	if (configs.link_address != NULL && !Core.is_headless) {
+		Core.is_linked = true;
+		Core.run_ahead = 0;
+		if (link_init(&Core.link, configs.link_address) != STATUS_OK) {
+			log_fatal("Unable to link with the other player!");
+			core_exit();
+			return STATUS_ERROR;
+		}
+	}
+
+	if (configs.is_exporting) {
+		Core.is_exporting = true;
+		if (export_init(&Core.export) != STATUS_OK) {
+			log_fatal("Unable to export frames!");
+			core_exit();
+			return STATUS_ERROR;
+		}
+	}
+
+	/* Headless frames are not paced by time, they wait for the writer. */
+	if (configs.capture_path != NULL) {
+		Core.is_capturing = true;
+		const uint8_t scale = configs.capture_scale != 0 ? configs.capture_scale
+														 : CAPTURE_DEFAULT_SCALE;
+		if (capture_init(
+				&Core.capture, configs.capture_path, scale, configs.scaler,
+				configs.phosphor, configs.is_eliding, Core.is_turbo
+			)
+			!= STATUS_OK) {
+			log_fatal("Unable to capture frames!");
+			core_exit();
+			return STATUS_ERROR;
+		}
+	}
 
 	Core.is_running = true;
 	return STATUS_OK;
@@ -63,62 +234,533 @@ int8_t core_init(configs_t configs) {
 
 int8_t core_run(void) {
 	int8_t status = STATUS_OK;
+	int32_t emulation_status = STATUS_OK;
 	SDL_Event event;
+	uint64_t last_present = 0;
+
+	if (Core.is_headless && Core.fuzz_cases > 0) {
+		return run_fuzz();
+	}
+	if (Core.is_headless) {
+		return Core.batch_count > 0 ? run_batch() : run_headless();
+	}
+
+	frame_buffer_init(&Core.frames);
+	event_queue_init(&Core.events);
+	SDL_AtomicSet(&Core.is_emulating, 1);
+	SDL_AtomicSet(&Core.is_halted, 0);
+
+	Core.wake = SDL_CreateSemaphore(0);
+	if (Core.wake == NULL) {
+		log_fatal("Unable to create semaphore: %s", SDL_GetError());
+		core_exit();
+		return STATUS_ERROR;
+	}
+
+	Core.emulation = SDL_CreateThread(emulation_thread, "emulation", NULL);
+	if (Core.emulation == NULL) {
+		log_fatal("Unable to create emulation thread: %s", SDL_GetError());
+		core_exit();
+		return STATUS_ERROR;
+	}
 
-	last_time = SDL_GetTicks64();
+	last_present = SDL_GetPerformanceCounter();
+	Core.fade_start = SDL_GetTicks64();
 	while (Core.is_running && status == STATUS_OK) {
 		while (SDL_PollEvent(&event)) {
-			switch (event.type) {
-			case SDL_QUIT:
-				Core.is_running = false;
-				break;
-			case SDL_KEYUP: /* FALLTHROUGH. */
-			case SDL_KEYDOWN:
-				/* Update cpu key state. */
-				input_update_keystate(&event, Core.input, Core.cpu.key_state);
-				break;
-			}
+			handle_event(&event);
 		}
 
-		if (cpu_update(&Core.cpu) != STATUS_OK) {
-			log_debug("An error has been found while running CPU!");
-			status = STATUS_ERROR;
+		/* Emulation thread stopped, by an error or program exit. */
+		if (SDL_AtomicGet(&Core.is_emulating) == 0) {
+			Core.is_running = false;
+		}
+
+		/* Update cpu screen if a new frame has been published. Frames are published
+		 * before halting, so the last one is always seen before sleeping. A fading
+		 * phosphor keeps the render thread awake until it settles.
+		 */
+		frame_t *frame = frame_buffer_acquire(&Core.frames);
+		if (frame == NULL && SDL_AtomicGet(&Core.is_halted) != 0
+			&& !display_is_fading(&Core.display)
+			&& (frame = frame_buffer_acquire(&Core.frames)) == NULL) {
+			wait_halted();
 		}
 
-		/* Update cpu screen if gfx has changed. */
-		if (Core.cpu.has_gfx_changed) {
-			display_update_screen(&Core.display, Core.cpu.gfx);
+		const uint64_t upload_start = SDL_GetPerformanceCounter();
+		if (frame != NULL) {
+			update_screen(frame);
 		}
+		fade_screen();
+		const uint64_t upload_end = SDL_GetPerformanceCounter();
 
 		display_clear(&Core.display, &Core.is_running);
-		if (display_render_screen(&Core.display, NULL, NULL) != STATUS_OK) {
+		if (display_render_screen(&Core.display, NULL, NULL) != STATUS_OK
+			|| overlay_render(&Core.overlay, &Core.display) != STATUS_OK) {
 			log_error("Unable to render CPU screen.");
 			status = STATUS_ERROR;
 		}
+
+		const uint64_t present_start = SDL_GetPerformanceCounter();
 		display_update(&Core.display);
+		const uint64_t present_end = SDL_GetPerformanceCounter();
+
+		/* Key press timestamps use the SDL_GetTicks64 base. */
+		if (frame != NULL && frame->input_time != 0) {
+			latency_add(&Core.latency, SDL_GetTicks64() - frame->input_time);
+			frame->input_time = 0;
+		}
+
+		overlay_add_frame(
+			&Core.overlay, elapsed_time(last_present, present_end),
+			elapsed_time(upload_start, upload_end),
+			elapsed_time(present_start, present_end)
+		);
+		overlay_add_cpu(
+			&Core.overlay, SDL_AtomicSet(&Core.cpu_time, 0),
+			SDL_AtomicSet(&Core.instructions, 0)
+		);
+		last_present = present_end;
+	}
+
+	SDL_AtomicSet(&Core.is_emulating, 0);
+	SDL_SemPost(Core.wake);
+	SDL_WaitThread(Core.emulation, &emulation_status);
+	if (emulation_status != STATUS_OK) {
+		status = STATUS_ERROR;
+	}
+
+	log_info("Idle for %d ms waiting for keys.", (uint32_t)Core.idle_time);
+	if (Core.show_latency) {
+		latency_report(&Core.latency);
+	}
+
+	core_exit();
+	return status;
+}
+
+static int8_t run_headless(void) {
+	int8_t status = STATUS_OK;
+	const uint64_t start_time = SDL_GetTicks64();
+	uint32_t frame = 0;
+
+	while ((Core.headless_frames == 0 || frame < Core.headless_frames)
+		   && !Core.cpu.has_exited) {
+		debug_poll(&Core.debugger, &Core.cpu);
+		if (Core.debugger.is_paused) {
+			SDL_Delay(DEBUG_DELAY);
+			continue;
+		}
+
+		if (cpu_step_tick(&Core.cpu, NULL) != STATUS_OK) {
+			log_debug("An error has been found while running CPU!");
+			status = STATUS_ERROR;
+			break;
+		}
+
+		if (Core.is_exporting) {
+			export_publish(&Core.export, &Core.cpu);
+		}
+		if (Core.is_capturing) {
+			capture_frame(&Core.capture, &Core.cpu);
+		}
+		Core.cpu.has_gfx_changed = false;
+		frame += 1;
+	}
+
+	log_info("Ran %d frames in %d ms.", frame, (uint32_t)(SDL_GetTicks64() - start_time));
+	core_exit();
+	return status;
+}
+
+/* Step many copies of the cpu with random keys, to measure the batch throughput. */
+static int8_t run_batch(void) {
+	static batch_t batch;
+	const uint32_t frames = Core.headless_frames != 0 ? Core.headless_frames
+													  : BATCH_DEFAULT_FRAMES;
+	uint32_t random = RANDOM_SEED;
+
+	if (batch_init(&batch, &Core.cpu, Core.batch_count) != STATUS_OK) {
+		log_error("Unable to create environments!");
+		core_exit();
+		return STATUS_ERROR;
+	}
+	batch.use_lanes = Core.use_lanes;
+
+	const uint64_t start_time = SDL_GetTicks64();
+	for (uint32_t frame = 0; frame < frames; frame += 1) {
+		/* A single key is held in each environment. */
+		for (uint32_t i = 0; i < batch.count; i += 1) {
+			random ^= random << 13;
+			random ^= random >> 17;
+			random ^= random << 5;
+			batch.actions[i] = 1 << (random & 0xF);
+		}
+
+		batch_step(&batch);
+	}
+
+	const uint64_t time = SDL_GetTicks64() - start_time;
+	log_info(
+		"Ran %u environments for %u frames in %u ms, %.0f frames per second.",
+		batch.count, frames, (uint32_t)time,
+		(double)batch.count * frames * 1000 / (time > 0 ? time : 1)
+	);
+
+	batch_quit(&batch);
+	core_exit();
+	return STATUS_OK;
+}
+
+/* Compare the execution engines on the rom, then on cases generated from it. Each
+ * divergence is minimized and written as a reproducer rom.
+ */
+static int8_t run_fuzz(void) {
+	static fuzz_t fuzz;
+	static fuzz_case_t test;
+	fuzz_divergence_t divergence;
+	char path[MAX_FILEPATH_SIZE];
+	uint32_t divergences = 0;
+
+	if (fuzz_init(&fuzz, &Core.cpu, RANDOM_SEED) != STATUS_OK) {
+		log_error("Unable to create fuzzing cpus!");
+		core_exit();
+		return STATUS_ERROR;
+	}
 
-		update_fps();
-		last_time = SDL_GetTicks64();
+	/* The first case is the rom itself, so a reproducer runs again as it was found. */
+	fuzz_add_seed(&fuzz, Core.cpu.rom->content, Core.cpu.rom->size, &test);
+
+	const uint64_t start_time = SDL_GetTicks64();
+	for (uint32_t i = 0; i < Core.fuzz_cases; i += 1) {
+		if (i > 0) {
+			fuzz_generate(&fuzz, &test);
+		}
+
+		/* Invalid instructions of the cases are expected, their errors are hidden. */
+		log_set_level(LOG_FATAL);
+		const bool has_diverged = fuzz_run(&fuzz, &test, FUZZ_ALL_ENGINES, &divergence);
+		if (has_diverged) {
+			fuzz_minimize(&fuzz, &test, &divergence);
+		}
+		log_set_level(LOG_TRACE);
+
+		if (!has_diverged) {
+			continue;
+		}
+		divergences += 1;
+		snprintf(path, sizeof(path), FUZZ_REPRODUCER_FORMAT, divergences);
+		fuzz_write_rom(&test, path);
+		log_warn(
+			"%s engine diverged in %s at tick %u of lane %u, with %u lanes and input "
+			"seed %u. Reproducer written to %s.",
+			fuzz_engine_name(divergence.engine), divergence.field, divergence.block,
+			divergence.lane, test.lanes, test.seed, path
+		);
 	}
 
+	const uint64_t time = SDL_GetTicks64() - start_time;
+	const double seconds = (time > 0 ? time : 1) / 1000.0;
+	log_info(
+		"Ran %llu cases in %u ms, %.0f cases and %.0f reference instructions per second, "
+		"%u divergences.",
+		(unsigned long long)fuzz.cases, (uint32_t)time, fuzz.cases / seconds,
+		fuzz.instructions / seconds, divergences
+	);
+
+	fuzz_quit(&fuzz);
 	core_exit();
+	return divergences == 0 ? STATUS_OK : STATUS_ERROR;
+}
+
+static int32_t emulation_thread(void *data) {
+	(void)data;
+	int32_t status = STATUS_OK;
+	uint64_t instructions = Core.cpu.instructions;
+
+	while (SDL_AtomicGet(&Core.is_emulating) != 0) {
+		/* No cycles are done while paused, but steps change the screen. */
+		debug_poll(&Core.debugger, &Core.cpu);
+		if (Core.debugger.is_paused) {
+			publish_frame();
+			SDL_Delay(DEBUG_DELAY);
+			continue;
+		}
+
+		const uint64_t update_start = SDL_GetPerformanceCounter();
+		int8_t update_status = STATUS_OK;
+		if (Core.is_linked) {
+			update_status = link_update(&Core.link, &Core.cpu, &Core.events);
+		} else if (Core.is_turbo) {
+			update_status = cpu_step_tick(&Core.cpu, &Core.events);
+		} else {
+			update_status = cpu_update(&Core.cpu, &Core.events);
+		}
+		SDL_AtomicAdd(
+			&Core.cpu_time, elapsed_time(update_start, SDL_GetPerformanceCounter())
+		);
+		SDL_AtomicAdd(&Core.instructions, Core.cpu.instructions - instructions);
+		instructions = Core.cpu.instructions;
+
+		if (update_status != STATUS_OK) {
+			log_debug("An error has been found while running CPU!");
+			status = STATUS_ERROR;
+			break;
+		}
+
+		if (Core.run_ahead > 0) {
+			run_ahead();
+		} else {
+			publish_frame();
+		}
+		if (Core.is_exporting) {
+			export_frames();
+		}
+		if (Core.is_capturing) {
+			capture_frames();
+		}
+
+		/* Program requested to exit (0x00FD). */
+		if (Core.cpu.has_exited) {
+			log_info("Program exited!");
+			break;
+		}
+
+		/* Frames keep their pace while halted, as the remote keys must be received. */
+		if (Core.is_linked) {
+			SDL_Delay(link_next_delay(&Core.link));
+			continue;
+		}
+
+		/* Halted waiting for a key, only timers can change until a key event. */
+		const bool has_timers = Core.cpu.delay_timer > 0 || Core.cpu.sound_timer > 0;
+		if (Core.cpu.is_halted) {
+			uint32_t timeout = HALT_TIMEOUT;
+			if (has_timers) {
+				timeout = Core.is_turbo ? 0 : cpu_next_tick_delay(&Core.cpu);
+			}
+
+			SDL_AtomicSet(&Core.halt_timeout, timeout);
+			SDL_AtomicSet(&Core.is_halted, 1);
+			SDL_SemWaitTimeout(Core.wake, timeout);
+			SDL_AtomicSet(&Core.is_halted, 0);
+			continue;
+		}
+
+		/* Cycles are accumulated by time, let some pass. If the program is waiting
+		 * for the delay timer, there is nothing to do until the next tick.
+		 */
+		if (!Core.is_turbo) {
+			SDL_Delay(Core.cpu.is_idle ? cpu_next_tick_delay(&Core.cpu) : 1);
+		}
+	}
+
+	SDL_AtomicSet(&Core.is_emulating, 0);
 	return status;
 }
 
-/* TODO: Render FPS on screen. */
-static void update_fps(void) {
-	fps_timer += (SDL_GetTicks64() - last_time) / 1000.0f;
+/* Use the rom database settings, unless they are set in the command line. */
+static void apply_rom_settings(configs_t *configs, const rom_t *rom) {
+	if (romdb_load(configs->database_filepath) != STATUS_OK) {
+		return;
+	}
+
+	const romdb_entry_t *entry = romdb_find(romdb_hash(rom->content, rom->size));
+	if (entry == NULL) {
+		log_info("Rom not found in the database, using default settings.");
+		romdb_free();
+		return;
+	}
+
+	if ((configs->options & CFG_PROFILE) == 0) {
+		configs->profile = entry->profile;
+	}
+	if ((configs->options & CFG_CLOCK_SPEED) == 0 && entry->clock_speed != 0) {
+		configs->clock_speed = entry->clock_speed;
+	}
+	input_set_keymap(&Core.input, entry->keymap);
+
+	romdb_free();
+}
+
+static void handle_event(SDL_Event *event) {
+	switch (event->type) {
+	case SDL_QUIT:
+		Core.is_running = false;
+		break;
+	default:
+		/* Queue key events for the cpu, and wake it if halted. Hotkeys wake it too,
+		 * as debugger requests are done by the emulation thread.
+		 */
+		if ((event->type == SDL_KEYDOWN && event->key.repeat == 0
+			 && handle_hotkey(event->key.keysym.scancode))
+			|| input_handle_event(&Core.input, event, &Core.events)) {
+			SDL_SemPost(Core.wake);
+		}
+		break;
+	}
+}
+
+/* Return true if the key is a hotkey. */
+static bool handle_hotkey(SDL_Scancode scancode) {
+	switch (scancode) {
+	case OVERLAY_KEY:
+		overlay_toggle(&Core.overlay);
+		return true;
+	case DEBUG_PAUSE_KEY:
+		debug_request(&Core.debugger, DEBUG_REQUEST_PAUSE);
+		return true;
+	case DEBUG_STEP_KEY:
+		debug_request(&Core.debugger, DEBUG_REQUEST_STEP);
+		return true;
+	case DEBUG_VIEW_KEY:
+		debug_request(&Core.debugger, DEBUG_REQUEST_VIEW);
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Sleep until an event arrives or the next timer tick. */
+static void wait_halted(void) {
+	const uint64_t start_time = SDL_GetTicks64();
+	SDL_Event event;
+
+	if (SDL_WaitEventTimeout(&event, SDL_AtomicGet(&Core.halt_timeout)) != 0) {
+		handle_event(&event);
+	}
+
+	Core.idle_time += SDL_GetTicks64() - start_time;
+}
+
+static void publish_frame(void) {
+	if (Core.cpu.has_gfx_changed) {
+		frame_buffer_publish(&Core.frames, &Core.cpu);
+		Core.cpu.has_gfx_changed = false;
+	}
+}
+
+/* Publish the screen of a snapshot run ahead of the cpu. Running ahead costs a copy
+ * of the cpu and some timer ticks of cycles, so it is done once per timer tick, and
+ * at once after a key press or before halting.
+ */
+static void run_ahead(void) {
+	const uint64_t now = SDL_GetTicks64();
+
+	if (now < Core.next_run_ahead && Core.cpu.input_time == 0 && !Core.cpu.is_halted) {
+		return;
+	}
+	Core.next_run_ahead = now + 1000 / TIMER_CLOCK_SPEED;
+
+	cpu_snapshot(&Core.ahead, &Core.cpu);
+	for (uint8_t i = 0; i < Core.run_ahead && !Core.ahead.has_exited; i += 1) {
+		/* Errors are reported when the cpu reaches them. */
+		if (cpu_step_tick(&Core.ahead, NULL) != STATUS_OK) {
+			break;
+		}
+	}
+
+	/* The previous frame came from another snapshot, so it is sent whole. */
+	mega_mark_dirty(&Core.ahead.mega, 0, 0, MEGA_WIDTH, MEGA_HEIGHT);
+	Core.ahead.mega.has_palette_changed = true;
+	frame_buffer_publish(&Core.frames, &Core.ahead);
+
+	Core.cpu.has_gfx_changed = false;
+	Core.cpu.input_time = 0;
+}
 
-	if (fps_timer >= 1.0f) {
-		Core.current_fps = fps_count;
-		fps_count = 0;
-		fps_timer = 0;
+/* Turbo updates run a single timer tick, linked updates one or none, in real time
+ * the updates run the ticks due since the previous one, so frames are added at the
+ * timer rate.
+ */
+static void capture_frames(void) {
+	if (Core.is_linked) {
+		if (Core.link.has_run_frame) {
+			capture_frame(&Core.capture, &Core.cpu);
+		}
+		return;
+	}
+	if (Core.is_turbo) {
+		capture_frame(&Core.capture, &Core.cpu);
+		return;
+	}
+
+	const uint64_t now = SDL_GetTicks64();
+	if (Core.captured_frames == 0) {
+		Core.capture_start = now;
+	}
+	while (Core.capture_start + Core.captured_frames * 1000 / TIMER_CLOCK_SPEED <= now) {
+		capture_frame(&Core.capture, &Core.cpu);
+		Core.captured_frames += 1;
+	}
+}
+
+/* The real time loop runs every millisecond, the state is only published when a timer
+ * tick has passed. Ticks missed by a late update are skipped, readers only see the
+ * latest state.
+ */
+static void export_frames(void) {
+	if (Core.is_linked) {
+		if (Core.link.has_run_frame) {
+			export_publish(&Core.export, &Core.cpu);
+		}
+		return;
+	}
+	if (Core.is_turbo) {
+		export_publish(&Core.export, &Core.cpu);
+		return;
+	}
+
+	const uint64_t now = SDL_GetTicks64();
+	if (Core.exported_ticks == 0) {
+		Core.export_start = now;
 	}
+	if (Core.export_start + Core.exported_ticks * 1000 / TIMER_CLOCK_SPEED <= now) {
+		export_publish(&Core.export, &Core.cpu);
+		Core.exported_ticks = (now - Core.export_start) * TIMER_CLOCK_SPEED / 1000 + 1;
+	}
+}
+
+static void update_screen(frame_t *frame) {
+	if (frame->is_mega) {
+		display_update_mega(&Core.display, &frame->mega);
+	} else {
+		display_update_screen(&Core.display, frame->gfx, frame->width, frame->height);
+	}
+}
+
+/* Frames are only published when the screen changes, so the phosphor is faded by the
+ * timer ticks of real time.
+ */
+static void fade_screen(void) {
+	const uint64_t ticks = (SDL_GetTicks64() - Core.fade_start) * TIMER_CLOCK_SPEED
+						 / 1000;
 
-	fps_count += 1;
+	display_update_phosphor(&Core.display, ticks - Core.faded_ticks);
+	Core.faded_ticks = ticks;
+}
+
+static uint32_t elapsed_time(uint64_t start, uint64_t end) {
+	return (end - start) * 1000000 / SDL_GetPerformanceFrequency();
 }
 
 static void core_exit(void) {
+	if (Core.wake != NULL) {
+		SDL_DestroySemaphore(Core.wake);
+		Core.wake = NULL;
+	}
+
+	debug_quit(&Core.debugger, &Core.cpu);
+	if (Core.is_linked) {
+		link_quit(&Core.link);
+	}
+	export_quit(&Core.export);
+	if (Core.is_capturing) {
+		capture_quit(&Core.capture);
+	}
+	cpu_quit(&Core.cpu);
+	input_quit(&Core.input);
+	overlay_quit(&Core.overlay);
 	destroy_display(&Core.display);
 	log_info("Core exitted!");
 }
@@ -7,18 +7,26 @@
 #include "utils.h"
 
 #include <SDL2/SDL.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define FONT_OFFSET 0x50
-#define ROM_OFFSET	0x200 /* 512 */
-
-static uint64_t last_time = 0;
-static double pending_cpu_cycles = 0;
-static double pending_timer_cycles = 0;
 
 static int8_t do_cpu_cycles(cpu_t *cpu, uint32_t amount); /* Fetch and decode opcodes. */
+/* Do cpu cycles, applying key events between them. */
+static int8_t do_input_cycles(
+	cpu_t *cpu, event_queue_t *events, uint64_t start_time, uint32_t amount
+);
 static void do_timers_cycles(cpu_t *cpu, uint32_t amount);
+static void update_audio(cpu_t *cpu);
+/* Copy a memory page and its predecoded instructions. */
+static void copy_page(cpu_t *cpu, const cpu_t *source, uint16_t page);
+
+static const char *bounds_names[BOUNDS_COUNT] = {
+	[BOUNDS_WRAP] = "wrap",
+	[BOUNDS_TRAP] = "trap",
+};
 
 static const uint8_t cpu_font[] = {
 	0xF0, 0x90, 0x90, 0x90, 0xF0, /* 0 */
@@ -39,42 +47,107 @@ static const uint8_t cpu_font[] = {
 	0xF0, 0x80, 0xF0, 0x80, 0x80, /* F */
 };
 
-int8_t cpu_init(cpu_t *cpu, uint16_t clock_speed) {
+/* SUPER-CHIP 8x10 font, extended with A-F like XO-CHIP. */
+static const uint8_t cpu_big_font[] = {
+	0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, /* 0 */
+	0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, /* 1 */
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, /* 2 */
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, /* 3 */
+	0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, /* 4 */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, /* 5 */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, /* 6 */
+	0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, /* 7 */
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, /* 8 */
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, /* 9 */
+	0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, /* A */
+	0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, /* B */
+	0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, /* C */
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, /* D */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, /* E */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0, /* F */
+};
+
+/* Square wave with a period of 4 bits, gives a 1000Hz tone at the default pitch. */
+static const uint8_t default_audio_pattern[AUDIO_PATTERN_SIZE] = {
+	0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC,
+	0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC,
+};
+
+int8_t cpu_init(cpu_t *cpu, uint16_t clock_speed, profile_t profile) {
 	cpu_reset(cpu); /* Reset CPU to a initial state. */
 
+	if (profile >= PROFILE_COUNT) {
+		log_error("Invalid quirks profile: %d", profile);
+		return STATUS_ERROR;
+	}
+
 	cpu->clock_speed = clock_speed;
+	cpu->profile = profile;
+	log_info("Using %s quirks profile", quirks_profile_name(profile));
 	return STATUS_OK;
 }
 
-int8_t cpu_update(cpu_t *cpu) {
-	if (last_time == 0.0f) { /* Running for the first time. */
-		last_time = SDL_GetTicks64();
+int8_t cpu_update(cpu_t *cpu, event_queue_t *events) {
+	if (cpu->last_time == 0) { /* Running for the first time. */
+		cpu->last_time = SDL_GetTicks64();
 	}
 
 	/* Figure out how long it has been since the previous cpu_update call.*/
-	const uint64_t time_passed = SDL_GetTicks64() - last_time;
-	last_time = SDL_GetTicks64();
+	const uint64_t start_time = cpu->last_time;
+	const uint64_t time_passed = SDL_GetTicks64() - cpu->last_time;
+	cpu->last_time = start_time + time_passed;
 
 	/* Get pending cycles for cpu and timer. */
-	pending_cpu_cycles += time_passed * cpu->clock_speed / 1000.0f;
-	pending_timer_cycles += time_passed * TIMER_CLOCK_SPEED / 1000.0f;
+	cpu->pending_cpu_cycles += time_passed * cpu->clock_speed / 1000.0f;
+	cpu->pending_timer_cycles += time_passed * TIMER_CLOCK_SPEED / 1000.0f;
 
 	/* Perform for the number of whole cycles accumulated. */
-	do_timers_cycles(cpu, (uint32_t)pending_timer_cycles);
-	if (do_cpu_cycles(cpu, (uint32_t)pending_cpu_cycles) != STATUS_OK) {
+	cpu->is_idle = false;
+	do_timers_cycles(cpu, (uint32_t)cpu->pending_timer_cycles);
+	if (do_input_cycles(cpu, events, start_time, (uint32_t)cpu->pending_cpu_cycles)
+		!= STATUS_OK) {
 		log_error("Unable to do cpu cycles!");
 		return STATUS_ERROR;
 	}
-
-	/* Unpause audio if sound_timer is greater than 0. */
-	audio_pause(cpu->sound_timer <= 0);
+	update_audio(cpu);
 
 	/* Keep the pending cycles remainder. */
-	pending_cpu_cycles = fmodf(pending_cpu_cycles, 1.0);
-	pending_timer_cycles = fmodf(pending_timer_cycles, 1.0);
+	cpu->pending_cpu_cycles = fmod(cpu->pending_cpu_cycles, 1.0);
+	cpu->pending_timer_cycles = fmod(cpu->pending_timer_cycles, 1.0);
 	return STATUS_OK;
 }
 
+int8_t cpu_step_tick(cpu_t *cpu, event_queue_t *events) {
+	const uint32_t cycles = cpu_start_tick(cpu);
+
+	/* Queued events are all late, they are applied at the start of the tick. */
+	const uint64_t now = events != NULL ? SDL_GetTicks64() : 0;
+	if (do_input_cycles(cpu, events, now, cycles) != STATUS_OK) {
+		log_error("Unable to do cpu cycles!");
+		return STATUS_ERROR;
+	}
+
+	cpu_end_tick(cpu);
+	return STATUS_OK;
+}
+
+uint32_t cpu_start_tick(cpu_t *cpu) {
+	cpu->pending_cpu_cycles += (double)cpu->clock_speed / TIMER_CLOCK_SPEED;
+	cpu->is_idle = false;
+	do_timers_cycles(cpu, 1);
+
+	return (uint32_t)cpu->pending_cpu_cycles;
+}
+
+void cpu_end_tick(cpu_t *cpu) {
+	update_audio(cpu);
+	cpu->pending_cpu_cycles = fmod(cpu->pending_cpu_cycles, 1.0);
+}
+
+uint32_t cpu_next_tick_delay(const cpu_t *cpu) {
+	return (1.0 - cpu->pending_timer_cycles) * 1000 / TIMER_CLOCK_SPEED;
+}
+
 void cpu_reset(cpu_t *cpu) {
 	cpu->PC = ROM_OFFSET; /* ROM is loaded at memory location 0x200 */
 	cpu->opcode = 0;	  /* Reset current opcode. */
@@ -85,67 +158,287 @@ void cpu_reset(cpu_t *cpu) {
 	cpu->delay_timer = 0;
 	cpu->sound_timer = 0;
 
-	memset(cpu->memory, 0, sizeof(uint8_t) * RAM_SIZE);			   /* Reset memory */
+	/* Reset audio pattern and pitch. */
+	memcpy(cpu->audio_pattern, default_audio_pattern, AUDIO_PATTERN_SIZE);
+	cpu->pitch = DEFAULT_PITCH;
+	cpu->has_audio_changed = true;
+
+	memset(cpu->memory, 0, sizeof(cpu->memory));				   /* Reset memory */
+	memset(cpu->decoded, 0, sizeof(uint8_t) * RAM_SIZE);		   /* Reset decoded code */
 	memset(cpu->stack, 0, sizeof(uint16_t) * STACK_SIZE);		   /* Reset stack */
 	memset(cpu->V, 0, sizeof(uint8_t) * V_REGISTERS_COUNT);		   /* Reset registers */
-	memset(cpu->gfx, 0, sizeof(uint8_t) * GFX_WIDTH * GFX_HEIGHT); /* Reset display */
+	memset(cpu->gfx, 0, sizeof(gfx_plane_t) * GFX_PLANES);		   /* Reset display */
 	memset(cpu->key_state, 0, sizeof(uint8_t) * KEYS_COUNT);	   /* Reset key states */
+	memset(cpu->rpl, 0, sizeof(uint8_t) * RPL_FLAGS_COUNT);		   /* Reset RPL flags */
+	memset(cpu->written_pages, 0xFF, sizeof(cpu->written_pages)); /* Whole memory */
+
+	/* Start in low resolution mode. */
+	cpu->gfx_width = GFX_LORES_WIDTH;
+	cpu->gfx_height = GFX_LORES_HEIGHT;
+	cpu->planes = 0x1; /* Only the first plane is used by CHIP-8 programs. */
+	cpu->has_gfx_changed = true;
+	cpu->has_exited = false;
+	cpu->random = RANDOM_SEED; /* Every run of a program sees the same values. */
+
+	/* Start counting cycles at the first update. */
+	cpu->last_time = 0;
+	cpu->pending_cpu_cycles = 0;
+	cpu->pending_timer_cycles = 0;
+	cpu->is_idle = false;
+	cpu->is_halted = false;
+	cpu->instructions = 0;
+	cpu->input_time = 0;
+
+	/* MegaChip mode is enabled by the program. */
+	mega_reset(&cpu->mega);
+	cpu->is_mega = false;
 
 	/* Load the built-in fontset in 0x50-0x0A0 */
 	memcpy(
 		cpu->memory + FONT_ADDRESS, cpu_font,
 		FONT_CHAR_COUNT * FONT_CHAR_SIZE * sizeof(uint8_t)
 	);
+	/* Load the big fontset in 0xA0-0x140 */
+	memcpy(
+		cpu->memory + BIG_FONT_ADDRESS, cpu_big_font,
+		FONT_CHAR_COUNT * BIG_FONT_SIZE * sizeof(uint8_t)
+	);
+}
+
+void cpu_snapshot(cpu_t *snapshot, const cpu_t *cpu) {
+	memcpy(snapshot, cpu, sizeof(cpu_t));
+	snapshot->debugger = NULL; /* Breakpoints are run through. */
+	snapshot->is_muted = true;
 }
 
-int8_t cpu_loadrom(cpu_t *cpu, const char *filepath) {
-	const uint32_t max_rom_size = RAM_SIZE - ROM_OFFSET; /* 0xDFF = 3584 bytes */
-	FILE *rom = fopen(filepath, "rb");
-	file_t file;
+void cpu_restore(cpu_t *cpu, const cpu_t *snapshot) {
+	debugger_t *debugger = cpu->debugger;
+	const bool is_muted = cpu->is_muted;
 
-	if (rom == NULL || get_file_content(&file, rom) != STATUS_OK) {
-		log_error("Unable to read rom!");
-		return STATUS_ERROR;
+	memcpy(cpu, snapshot, sizeof(cpu_t));
+	cpu->debugger = debugger;
+	cpu->is_muted = is_muted;
+
+	/* The screen and audio shown are not the ones of the snapshot, send them whole. */
+	cpu->has_gfx_changed = true;
+	mega_mark_dirty(&cpu->mega, 0, 0, MEGA_WIDTH, MEGA_HEIGHT);
+	cpu->mega.has_palette_changed = true;
+	cpu->has_audio_changed = true;
+}
+
+void cpu_fork(cpu_t *fork, const cpu_t *cpu) {
+	cpu_snapshot(fork, cpu);
+	fork->base = fork;
+	memset(fork->written_pages, 0, sizeof(fork->written_pages));
+}
+
+void cpu_clone(cpu_t *clone, const cpu_t *cpu) {
+	const cpu_t *base = cpu->base;
+
+	if (clone == cpu) {
+		return;
+	}
+	if (base == NULL || clone->base != base) {
+		cpu_snapshot(clone, cpu);
+		return;
 	}
 
-	if (file.lenght > max_rom_size) {
-		log_error("Rom file size is bigger than max rom size!");
-		file_free(&file);
+	/* Pages written by the clone go back to the fork, the ones of the cpu are copied. */
+	for (uint16_t word = 0; word < PAGES_COUNT / 64; word += 1) {
+		const uint64_t written = cpu->written_pages[word];
+
+		for (uint64_t pages = clone->written_pages[word] | written; pages != 0;
+			 pages &= pages - 1) {
+			const uint8_t bit = __builtin_ctzll(pages);
+			const cpu_t *source = (written >> bit) & 1 ? cpu : base;
+
+			copy_page(clone, source, word * 64 + bit);
+		}
+	}
+
+	/* The rest is small, but the MegaChip screen which is only copied if shown. */
+	clone->opcode = cpu->opcode;
+	memcpy(
+		(uint8_t *)clone + offsetof(cpu_t, stack),
+		(const uint8_t *)cpu + offsetof(cpu_t, stack),
+		offsetof(cpu_t, mega) - offsetof(cpu_t, stack)
+	);
+	if (cpu->is_mega || clone->is_mega) {
+		clone->mega = cpu->mega;
+	} else {
+		memcpy(
+			clone->mega.palette, cpu->mega.palette,
+			sizeof(mega_t) - offsetof(mega_t, palette)
+		);
+	}
+	memcpy(
+		(uint8_t *)clone + offsetof(cpu_t, is_mega),
+		(const uint8_t *)cpu + offsetof(cpu_t, is_mega),
+		sizeof(cpu_t) - offsetof(cpu_t, is_mega)
+	);
+	clone->debugger = NULL;
+	clone->is_muted = true;
+}
+
+void cpu_quit(cpu_t *cpu) {
+	rom_release(cpu->rom);
+	cpu->rom = NULL;
+}
+
+int8_t cpu_loadrom(cpu_t *cpu, rom_t *rom) {
+	const uint32_t ram_rom_size = RAM_SIZE - ROM_OFFSET; /* 0xFE00 = 65024 bytes */
+
+	if (rom == NULL) {
+		log_error("Unable to load NULL rom!");
 		return STATUS_ERROR;
 	}
 
-	/* Load ROM to memory */
-	memcpy(cpu->memory + 0x200, file.content, file.lenght * sizeof(uint8_t));
-	log_info("Loaded %s with %d bytes to memory.", filepath, file.lenght);
+	/* Load ROM to memory, the rest is only reachable with MegaChip addressing. */
+	const uint32_t ram_lenght = rom->size < ram_rom_size ? rom->size : ram_rom_size;
+	if (ram_lenght > 0) {
+		memcpy(cpu->memory + ROM_OFFSET, rom->content, ram_lenght * sizeof(uint8_t));
+		opcode_invalidate(cpu, ROM_OFFSET, ram_lenght);
+	}
+	log_info("Loaded rom with %d bytes to memory.", rom->size);
 
-	file_free(&file); /* We don't need the file anymore. */
+	/* Keep ROM content for 24 bits addresses. */
+	rom_retain(rom);
+	cpu_quit(cpu);
+	cpu->rom = rom;
 	return STATUS_OK;
 }
 
+int8_t cpu_step(cpu_t *cpu) {
+	return do_cpu_cycles(cpu, 1);
+}
+
+uint8_t cpu_read_byte(const cpu_t *cpu, uint32_t address) {
+	if (address < RAM_SIZE) {
+		return cpu->memory[address];
+	}
+
+	/* ROM is loaded at ROM_OFFSET, so addresses are shifted in the ROM content. */
+	const uint32_t offset = address - ROM_OFFSET;
+	return cpu->rom != NULL && offset < cpu->rom->size ? cpu->rom->content[offset] : 0;
+}
+
+bool cpu_is_delay_loop(const cpu_t *cpu) {
+	const uint16_t pc = cpu->PC;
+
+	/* The loop ends when the timer reaches 0, and 1nnn can only jump below 0x1000. */
+	if (cpu->delay_timer == 0 || pc >= 0x1000) {
+		return false;
+	}
+
+	/* Fx07, 3x00, 1nnn jumping back to Fx07. */
+	const uint8_t *code = &cpu->memory[pc];
+	const uint8_t x = code[0] & 0x0F;
+	return code[2] == (0x30 | x) && code[3] == 0x00 && code[4] == (0x10 | pc >> 8)
+		&& code[5] == (pc & 0xFF);
+}
+
+void cpu_mirror_memory(cpu_t *cpu, uint16_t address, uint32_t size) {
+	/* Writes are wrapped, they reach the mirrored bytes from the start of memory. */
+	if (address < RAM_GUARD_SIZE || address + size > RAM_SIZE) {
+		memcpy(cpu->memory + RAM_SIZE, cpu->memory, RAM_GUARD_SIZE);
+	}
+}
+
+bounds_t cpu_find_bounds(const char *name) {
+	for (bounds_t bounds = 0; bounds < BOUNDS_COUNT; bounds += 1) {
+		if (strcmp(bounds_names[bounds], name) == 0) {
+			return bounds;
+		}
+	}
+
+	return BOUNDS_COUNT;
+}
+
+const char *cpu_bounds_name(bounds_t bounds) {
+	return bounds < BOUNDS_COUNT ? bounds_names[bounds] : "unknown";
+}
+
 static int8_t do_cpu_cycles(cpu_t *cpu, uint32_t amount) {
-	for (uint32_t i = 0; i < amount; i += 1) {
-		if (cpu->PC > RAM_SIZE) {
+	const bool is_trapping = cpu->bounds == BOUNDS_TRAP;
+	uint32_t done = 0;
+
+	while (done < amount && !cpu->has_exited) {
+		if (cpu->is_idle || cpu->is_halted) {
+			break; /* Nothing changes until the next timer tick or key event. */
+		}
+
+		/* Otherwise the fetch at the last byte reads the mirror of the first one. */
+		if (is_trapping && cpu->PC > RAM_SIZE - 2) {
 			log_error("CPU program counter is greater than RAM size!");
 			return STATUS_ERROR;
 		}
 
-		/* Fetch opcode */
-		cpu->opcode = cpu->memory[cpu->PC] << 8 | cpu->memory[cpu->PC + 1];
-		cpu->addr = cpu->opcode & 0x0FFF;
-		cpu->byte = cpu->opcode & 0x00FF;
-		cpu->nibble = cpu->opcode & 0x000F;
-		cpu->x = (cpu->opcode & 0x0F00) >> 8;
-		cpu->y = (cpu->opcode & 0x00F0) >> 4;
+		opcode_fetch(cpu);
+
+		/* Polling loop of the delay timer, nothing changes until the next tick.
+		 * A breakpoint on it is hit first, it is checked by opcode_execute.
+		 */
+		if ((cpu->opcode & 0xF0FF) == 0xF007 && cpu_is_delay_loop(cpu)
+			&& (cpu->debugger == NULL || !opcode_has_breakpoint(cpu, cpu->PC))) {
+			cpu->V[cpu->x] = cpu->delay_timer;
+			cpu->is_idle = true;
+			break;
+		}
 
-		if (opcode_decode(cpu) != STATUS_OK) {
+		/* Fused instructions do several cycles at once. */
+		if (opcode_execute(cpu, amount - done, &done) != STATUS_OK) {
 			log_error("Unable to decode opcode: %X", cpu->opcode);
 			return STATUS_ERROR;
 		}
 	}
 
+	cpu->instructions += done;
 	return STATUS_OK;
 }
 
+static int8_t do_input_cycles(
+	cpu_t *cpu, event_queue_t *events, uint64_t start_time, uint32_t amount
+) {
+	uint32_t done = 0;
+
+	while (events != NULL && done < amount) {
+		const input_event_t *event = event_queue_peek(events);
+		if (event == NULL) {
+			break;
+		}
+
+
+		/* Events from before this update are late, they are applied first. */
+		const uint64_t offset = event->timestamp > start_time
+								  ? event->timestamp - start_time
+								  : 0;
+		const uint64_t cycle = offset * cpu->clock_speed / 1000;
+		if (cycle >= amount) {
+			break; /* Event belongs to the next update. */
+		}
+
+		if (cycle > done && do_cpu_cycles(cpu, cycle - done) != STATUS_OK) {
+			return STATUS_ERROR;
+		}
+		done = cycle > done ? cycle : done;
+
+		cpu->key_state[event->key] = event->is_pressed ? 1 : 0;
+		if (event->is_pressed && cpu->input_time == 0) {
+			cpu->input_time = event->timestamp; /* Measured until it is presented. */
+		}
+		cpu->is_halted = false; /* Let 0xFx0A check the keys again. */
+		event_queue_pop(events);
+
+		/* Do at least one cycle before the next event, so short taps are not missed. */
+		if (do_cpu_cycles(cpu, 1) != STATUS_OK) {
+			return STATUS_ERROR;
+		}
+		done += 1;
+	}
+
+	return do_cpu_cycles(cpu, amount - done);
+}
+
 static void do_timers_cycles(cpu_t *cpu, uint32_t amount) {
 	for (uint32_t i = 0; i < amount; i += 1) {
 		if (cpu->delay_timer > 0) {
@@ -156,3 +449,28 @@ static void do_timers_cycles(cpu_t *cpu, uint32_t amount) {
 		}
 	}
 }
+
+static void update_audio(cpu_t *cpu) {
+	if (cpu->is_muted) {
+		return;
+	}
+
+	/* Send the new pattern buffer and pitch to the audio device. */
+	if (cpu->has_audio_changed) {
+		audio_set_pattern(cpu->audio_pattern, cpu->pitch);
+		cpu->has_audio_changed = false;
+	}
+
+	/* Unpause audio if sound_timer is greater than 0. */
+	audio_pause(cpu->sound_timer <= 0);
+}
+
+static void copy_page(cpu_t *cpu, const cpu_t *source, uint16_t page) {
+	const uint16_t address = page * PAGE_SIZE;
+
+	memcpy(cpu->memory + address, source->memory + address, PAGE_SIZE);
+	memcpy(cpu->decoded + address, source->decoded + address, PAGE_SIZE);
+	cpu_mirror_memory(cpu, address, PAGE_SIZE);
+	/* Sequences fused before the page were decoded from its previous bytes. */
+	opcode_clear_decoded(cpu, address, 1);
+}
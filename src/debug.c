@@ -0,0 +1,497 @@
+#include "debug.h"
+
+#include "log.h"
+#include "opcodes.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define NO_SOCKET			-1
+#define REPLY_SIZE			1024
+#define MEMORY_ROW_SIZE		16
+#define DEFAULT_MEMORY_SIZE 64
+
+static const char *HELP_MESSAGE =
+	"break <addr>    Stop before executing the instruction at addr.\n"
+	"delete <addr>   Remove breakpoint.\n"
+	"watch <addr> [size]\n"
+	"                Stop after an instruction writes memory at addr.\n"
+	"unwatch <addr>  Remove watchpoint.\n"
+	"list            Show breakpoints and watchpoints.\n"
+	"pause           Stop execution.\n"
+	"continue        Continue execution.\n"
+	"step [count]    Execute count instructions, 1 by default.\n"
+	"until <addr>    Continue execution until addr.\n"
+	"regs            Show registers.\n"
+	"stack           Show stack.\n"
+	"mem <addr> [size]\n"
+	"                Show memory.\n"
+	"Addresses and sizes are hexadecimal.\n";
+
+static int8_t open_server(debugger_t *debugger, const char *socket_path);
+static void read_commands(debugger_t *debugger, cpu_t *cpu);
+static void do_command(debugger_t *debugger, cpu_t *cpu, char *command);
+static void do_request(debugger_t *debugger, cpu_t *cpu, debug_request_t request);
+
+static void set_paused(debugger_t *debugger, cpu_t *cpu);
+static void resume(debugger_t *debugger, cpu_t *cpu);
+static void step(debugger_t *debugger, cpu_t *cpu, uint32_t count);
+static void run_to(debugger_t *debugger, cpu_t *cpu, uint16_t address);
+
+static void add_breakpoint(debugger_t *debugger, cpu_t *cpu, uint16_t address);
+static void remove_breakpoint(debugger_t *debugger, cpu_t *cpu, uint16_t address);
+static void add_watchpoint(debugger_t *debugger, uint16_t address, uint16_t size);
+static void remove_watchpoint(debugger_t *debugger, uint16_t address);
+static bool is_breakpoint(const debugger_t *debugger, uint16_t address);
+
+static void show_registers(debugger_t *debugger, const cpu_t *cpu);
+static void show_stack(debugger_t *debugger, const cpu_t *cpu);
+static void show_memory(
+	debugger_t *debugger, const cpu_t *cpu, uint16_t address, uint32_t size
+);
+static void show_points(debugger_t *debugger);
+
+/* Write to the socket client, or to the terminal if there is none. */
+static void reply(debugger_t *debugger, const char *format, ...);
+
+int8_t debug_init(debugger_t *debugger, cpu_t *cpu, const char *socket_path) {
+	*debugger = (debugger_t){
+		.run_to = DEBUG_NO_ADDRESS,
+		.server = NO_SOCKET,
+		.client = NO_SOCKET,
+	};
+	SDL_AtomicSet(&debugger->request, DEBUG_REQUEST_NONE);
+	cpu->debugger = debugger;
+
+	if (socket_path != NULL) {
+		return open_server(debugger, socket_path);
+	}
+
+	return STATUS_OK;
+}
+
+void debug_quit(debugger_t *debugger, cpu_t *cpu) {
+	if (cpu->debugger != debugger) {
+		return; /* Not attached. */
+	}
+
+	if (debugger->client != NO_SOCKET) {
+		close(debugger->client);
+	}
+	if (debugger->server != NO_SOCKET) {
+		close(debugger->server);
+	}
+
+	cpu->debugger = NULL;
+}
+
+void debug_request(debugger_t *debugger, debug_request_t request) {
+	SDL_AtomicSet(&debugger->request, request);
+}
+
+void debug_poll(debugger_t *debugger, cpu_t *cpu) {
+	const debug_request_t request = SDL_AtomicSet(&debugger->request, DEBUG_REQUEST_NONE);
+
+	if (request != DEBUG_REQUEST_NONE) {
+		do_request(debugger, cpu, request);
+	}
+
+	if (debugger->server != NO_SOCKET) {
+		read_commands(debugger, cpu);
+	}
+}
+
+void debug_break(debugger_t *debugger, cpu_t *cpu) {
+	cpu->is_idle = true; /* Stop the cycles of this update. */
+
+	if (debugger->is_paused) {
+		return;
+	}
+
+	/* Temporary breakpoint of "until" is removed once reached. */
+	if (debugger->run_to == cpu->PC) {
+		if (!is_breakpoint(debugger, cpu->PC)) {
+			opcode_set_breakpoint(cpu, cpu->PC, false);
+		}
+		debugger->run_to = DEBUG_NO_ADDRESS;
+	}
+
+	debugger->is_paused = true;
+	reply(debugger, "Break at %04X\n", cpu->PC);
+}
+
+void debug_check_write(
+	debugger_t *debugger, cpu_t *cpu, uint16_t address, uint32_t size
+) {
+	for (uint8_t i = 0; i < debugger->watchpoints_count; i += 1) {
+		const watchpoint_t *watchpoint = &debugger->watchpoints[i];
+
+		if (address < watchpoint->address + watchpoint->size
+			&& watchpoint->address < address + size) {
+			/* The instruction is done, the cpu stops after it. */
+			cpu->is_idle = true;
+			debugger->is_paused = true;
+			reply(
+				debugger, "Watchpoint %04X written at %04X\n", watchpoint->address,
+				cpu->PC
+			);
+			return;
+		}
+	}
+}
+
+static int8_t open_server(debugger_t *debugger, const char *socket_path) {
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	struct stat info;
+
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		log_error("Debugger socket path is too long: %s", socket_path);
+		return STATUS_ERROR;
+	}
+	strcpy(address.sun_path, socket_path);
+
+	/* Remove the socket left by a previous run, but never other files. */
+	if (stat(socket_path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+		unlink(socket_path);
+	}
+
+	debugger->server = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (debugger->server == NO_SOCKET) {
+		log_error("Unable to create debugger socket: %s", strerror(errno));
+		return STATUS_ERROR;
+	}
+
+	if (bind(debugger->server, (struct sockaddr *)&address, sizeof(address)) != 0
+		|| listen(debugger->server, 1) != 0
+		|| fcntl(debugger->server, F_SETFL, O_NONBLOCK) != 0) {
+		log_error("Unable to listen at %s: %s", socket_path, strerror(errno));
+		close(debugger->server);
+		debugger->server = NO_SOCKET;
+		return STATUS_ERROR;
+	}
+
+	log_info("Debugger listening at %s", socket_path);
+	return STATUS_OK;
+}
+
+static void read_commands(debugger_t *debugger, cpu_t *cpu) {
+	char buffer[DEBUG_COMMAND_SIZE];
+
+	/* Only one client is served at a time. */
+	if (debugger->client == NO_SOCKET) {
+		debugger->client = accept(debugger->server, NULL, NULL);
+		if (debugger->client == NO_SOCKET) {
+			return;
+		}
+
+		fcntl(debugger->client, F_SETFL, O_NONBLOCK);
+		debugger->command_size = 0;
+		reply(debugger, "Chip8 debugger, type help for commands.\n");
+	}
+
+	const ssize_t size = recv(debugger->client, buffer, sizeof(buffer), 0);
+	if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+		close(debugger->client);
+		debugger->client = NO_SOCKET;
+		return;
+	}
+
+	for (ssize_t i = 0; i < size; i += 1) {
+		if (buffer[i] == '\n') {
+			debugger->command[debugger->command_size] = '\0';
+			debugger->command_size = 0;
+			do_command(debugger, cpu, debugger->command);
+		} else if (buffer[i] != '\r' && debugger->command_size < DEBUG_COMMAND_SIZE - 1) {
+			debugger->command[debugger->command_size] = buffer[i];
+			debugger->command_size += 1;
+		}
+	}
+}
+
+static void do_command(debugger_t *debugger, cpu_t *cpu, char *command) {
+	const char *name = strtok(command, " \t");
+	const char *first = strtok(NULL, " \t");
+	const char *second = strtok(NULL, " \t");
+	const uint32_t value = first != NULL ? strtoul(first, NULL, 16) : 0;
+	const uint32_t size = second != NULL ? strtoul(second, NULL, 16) : 0;
+
+	if (name == NULL) {
+		return;
+	}
+
+	/* Commands without address. */
+	if (strcmp(name, "help") == 0) {
+		reply(debugger, "%s", HELP_MESSAGE);
+		return;
+	} else if (strcmp(name, "list") == 0) {
+		show_points(debugger);
+		return;
+	} else if (strcmp(name, "pause") == 0) {
+		set_paused(debugger, cpu);
+		return;
+	} else if (strcmp(name, "continue") == 0) {
+		resume(debugger, cpu);
+		return;
+	} else if (strcmp(name, "step") == 0) {
+		step(debugger, cpu, first != NULL ? value : 1);
+		return;
+	} else if (strcmp(name, "regs") == 0) {
+		show_registers(debugger, cpu);
+		return;
+	} else if (strcmp(name, "stack") == 0) {
+		show_stack(debugger, cpu);
+		return;
+	}
+
+	if (first == NULL || value >= RAM_SIZE) {
+		reply(debugger, "Unknown command or invalid address, type help for commands.\n");
+		return;
+	}
+
+	if (strcmp(name, "break") == 0) {
+		add_breakpoint(debugger, cpu, value);
+	} else if (strcmp(name, "delete") == 0) {
+		remove_breakpoint(debugger, cpu, value);
+	} else if (strcmp(name, "watch") == 0) {
+		add_watchpoint(debugger, value, size > 0 && size <= RAM_SIZE ? size : 1);
+	} else if (strcmp(name, "unwatch") == 0) {
+		remove_watchpoint(debugger, value);
+	} else if (strcmp(name, "until") == 0) {
+		run_to(debugger, cpu, value);
+	} else if (strcmp(name, "mem") == 0) {
+		show_memory(debugger, cpu, value, second != NULL ? size : DEFAULT_MEMORY_SIZE);
+	} else {
+		reply(debugger, "Unknown command, type help for commands.\n");
+	}
+}
+
+static void do_request(debugger_t *debugger, cpu_t *cpu, debug_request_t request) {
+	switch (request) {
+	case DEBUG_REQUEST_PAUSE:
+		if (debugger->is_paused) {
+			resume(debugger, cpu);
+		} else {
+			set_paused(debugger, cpu);
+		}
+		break;
+	case DEBUG_REQUEST_STEP:
+		step(debugger, cpu, 1);
+		break;
+	case DEBUG_REQUEST_VIEW:
+		show_registers(debugger, cpu);
+		show_stack(debugger, cpu);
+		break;
+	case DEBUG_REQUEST_NONE:
+		break;
+	}
+}
+
+static void set_paused(debugger_t *debugger, cpu_t *cpu) {
+	debugger->is_paused = true;
+	reply(debugger, "Paused at %04X\n", cpu->PC);
+}
+
+static void resume(debugger_t *debugger, cpu_t *cpu) {
+	if (!debugger->is_paused) {
+		return;
+	}
+
+	/* The instruction of the breakpoint the cpu stopped at is done by the debugger. */
+	if (is_breakpoint(debugger, cpu->PC)) {
+		step(debugger, cpu, 1);
+	}
+
+	/* Time passed while paused is not caught up. */
+	debugger->is_paused = false;
+	cpu->last_time = 0;
+	cpu->is_idle = false;
+	reply(debugger, "Running\n");
+}
+
+static void step(debugger_t *debugger, cpu_t *cpu, uint32_t count) {
+	debugger->is_paused = true;
+
+	/* Instructions are decoded without the predecoded table, ignoring breakpoints. */
+	for (uint32_t i = 0; i < count && !cpu->has_exited; i += 1) {
+		if (cpu->bounds == BOUNDS_TRAP && cpu->PC > RAM_SIZE - 2) {
+			reply(debugger, "Program counter is outside of memory!\n");
+			return;
+		}
+
+		opcode_fetch(cpu);
+		if (opcode_decode(cpu) != STATUS_OK) {
+			reply(debugger, "Unable to execute opcode %04X\n", cpu->opcode);
+			return;
+		}
+	}
+
+	reply(debugger, "%04X: %04X\n", cpu->PC, cpu_read_byte(cpu, cpu->PC) << 8
+											  | cpu_read_byte(cpu, cpu->PC + 1));
+}
+
+static void run_to(debugger_t *debugger, cpu_t *cpu, uint16_t address) {
+	const int32_t previous = debugger->run_to;
+	if (previous != DEBUG_NO_ADDRESS && !is_breakpoint(debugger, previous)) {
+		opcode_set_breakpoint(cpu, previous, false);
+	}
+
+	debugger->run_to = address;
+	opcode_set_breakpoint(cpu, address, true);
+	resume(debugger, cpu);
+}
+
+static void add_breakpoint(debugger_t *debugger, cpu_t *cpu, uint16_t address) {
+	if (is_breakpoint(debugger, address)) {
+		return;
+	}
+
+	if (debugger->breakpoints_count >= DEBUG_MAX_BREAKPOINTS) {
+		reply(debugger, "Only %d breakpoints can be set.\n", DEBUG_MAX_BREAKPOINTS);
+		return;
+	}
+
+	debugger->breakpoints[debugger->breakpoints_count] = address;
+	debugger->breakpoints_count += 1;
+	opcode_set_breakpoint(cpu, address, true);
+	reply(debugger, "Breakpoint at %04X\n", address);
+}
+
+static void remove_breakpoint(debugger_t *debugger, cpu_t *cpu, uint16_t address) {
+	for (uint8_t i = 0; i < debugger->breakpoints_count; i += 1) {
+		if (debugger->breakpoints[i] != address) {
+			continue;
+		}
+
+		/* Keep it patched if it is the target of "until". */
+		debugger->breakpoints_count -= 1;
+		debugger->breakpoints[i] = debugger->breakpoints[debugger->breakpoints_count];
+		if (debugger->run_to != address) {
+			opcode_set_breakpoint(cpu, address, false);
+		}
+		return;
+	}
+
+	reply(debugger, "No breakpoint at %04X\n", address);
+}
+
+static void add_watchpoint(debugger_t *debugger, uint16_t address, uint16_t size) {
+	if (debugger->watchpoints_count >= DEBUG_MAX_WATCHPOINTS) {
+		reply(debugger, "Only %d watchpoints can be set.\n", DEBUG_MAX_WATCHPOINTS);
+		return;
+	}
+
+	debugger->watchpoints[debugger->watchpoints_count] = (watchpoint_t){ address, size };
+	debugger->watchpoints_count += 1;
+	reply(debugger, "Watchpoint at %04X-%04X\n", address, address + size - 1);
+}
+
+static void remove_watchpoint(debugger_t *debugger, uint16_t address) {
+	for (uint8_t i = 0; i < debugger->watchpoints_count; i += 1) {
+		if (debugger->watchpoints[i].address == address) {
+			debugger->watchpoints_count -= 1;
+			debugger->watchpoints[i] = debugger->watchpoints[debugger->watchpoints_count];
+			return;
+		}
+	}
+
+	reply(debugger, "No watchpoint at %04X\n", address);
+}
+
+static bool is_breakpoint(const debugger_t *debugger, uint16_t address) {
+	for (uint8_t i = 0; i < debugger->breakpoints_count; i += 1) {
+		if (debugger->breakpoints[i] == address) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void show_registers(debugger_t *debugger, const cpu_t *cpu) {
+	const uint8_t *V = cpu->V;
+
+	reply(
+		debugger, "PC=%04X I=%06X SP=%X DT=%02X ST=%02X OP=%04X\n", cpu->PC, cpu->I,
+		cpu->SP, cpu->delay_timer, cpu->sound_timer, cpu->opcode
+	);
+	for (uint8_t i = 0; i < V_REGISTERS_COUNT; i += 8) {
+		reply(
+			debugger, "V%X=%02X V%X=%02X V%X=%02X V%X=%02X V%X=%02X V%X=%02X V%X=%02X "
+					  "V%X=%02X\n",
+			i, V[i], i + 1, V[i + 1], i + 2, V[i + 2], i + 3, V[i + 3], i + 4, V[i + 4],
+			i + 5, V[i + 5], i + 6, V[i + 6], i + 7, V[i + 7]
+		);
+	}
+}
+
+static void show_stack(debugger_t *debugger, const cpu_t *cpu) {
+	if (cpu->SP == 0) {
+		reply(debugger, "Stack is empty\n");
+		return;
+	}
+
+	/* Most recent call first. */
+	for (uint16_t i = cpu->SP; i > 0; i -= 1) {
+		reply(debugger, "#%X %04X\n", i - 1, cpu->stack[i - 1]);
+	}
+}
+
+static void show_memory(
+	debugger_t *debugger, const cpu_t *cpu, uint16_t address, uint32_t size
+) {
+	char line[REPLY_SIZE];
+
+	for (uint32_t row = 0; row < size; row += MEMORY_ROW_SIZE) {
+		int32_t length = snprintf(line, sizeof(line), "%04X:", (uint16_t)(address + row));
+
+		for (uint32_t i = row; i < size && i < row + MEMORY_ROW_SIZE; i += 1) {
+			length += snprintf(
+				&line[length], sizeof(line) - length, " %02X",
+				cpu->memory[(uint16_t)(address + i)]
+			);
+		}
+		reply(debugger, "%s\n", line);
+	}
+}
+
+static void show_points(debugger_t *debugger) {
+	for (uint8_t i = 0; i < debugger->breakpoints_count; i += 1) {
+		reply(debugger, "Breakpoint %04X\n", debugger->breakpoints[i]);
+	}
+
+	for (uint8_t i = 0; i < debugger->watchpoints_count; i += 1) {
+		const watchpoint_t *watchpoint = &debugger->watchpoints[i];
+		reply(
+			debugger, "Watchpoint %04X-%04X\n", watchpoint->address,
+			watchpoint->address + watchpoint->size - 1
+		);
+	}
+}
+
+static void reply(debugger_t *debugger, const char *format, ...) {
+	char message[REPLY_SIZE];
+	va_list args;
+
+	va_start(args, format);
+	const int32_t length = vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+
+	if (length <= 0) {
+		return;
+	}
+
+	if (debugger->client != NO_SOCKET) {
+		send(debugger->client, message, strlen(message), MSG_NOSIGNAL);
+	} else {
+		fputs(message, stdout);
+	}
+}
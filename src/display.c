@@ -7,6 +7,7 @@
 #include <SDL_pixels.h>
 #include <SDL_render.h>
 #include <SDL_video.h>
+#include <string.h>
 
 #define WINDOW_TITLE "Chip8 Emulator"
 
@@ -17,7 +18,28 @@ static SDL_RendererFlags renderer_flags = SDL_RENDERER_ACCELERATED |
 static const SDL_PixelFormatEnum texture_pixel_format = SDL_PIXELFORMAT_ABGR32;
 static const SDL_TextureAccess texture_access = SDL_TEXTUREACCESS_STREAMING;
 
-int8_t create_display(display_t *display, int16_t width, int16_t height) {
+/* Upload the screen in screen_area of the cpu texture, through the scaler. */
+static void upload_screen(
+	display_t *display, gfx_plane_t *planes, uint8_t width, uint8_t height
+);
+/* Write the colors of the screen, from the phosphor if it is used. */
+static void write_colors(
+	const display_t *display, gfx_plane_t *planes, uint8_t width, uint8_t height,
+	uint32_t *pixels, int32_t pitch
+);
+static void expand_planes(
+	const display_t *display, gfx_plane_t *planes, uint8_t width, uint8_t height,
+	uint32_t *pixels, int32_t pitch
+);
+
+int8_t create_display(
+	display_t *display, int16_t width, int16_t height, scaler_t scaler, uint8_t phosphor
+) {
+	display->scaler = scaler;
+	display->scale = scaler_factor(scaler);
+	display->has_phosphor = phosphor > 0;
+	phosphor_init(&display->phosphor, phosphor);
+
 	display->window = SDL_CreateWindow(
 		WINDOW_TITLE, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height,
 		window_flags
@@ -35,7 +57,8 @@ int8_t create_display(display_t *display, int16_t width, int16_t height) {
 	}
 
 	display->cpu_screen = SDL_CreateTexture(
-		display->renderer, texture_pixel_format, texture_access, GFX_WIDTH, GFX_HEIGHT
+		display->renderer, texture_pixel_format, texture_access,
+		GFX_WIDTH * display->scale, GFX_HEIGHT * display->scale
 	);
 	if (display->cpu_screen == NULL) {
 		log_error("Unable to create Chip8 render screen: %s", SDL_GetError());
@@ -43,11 +66,61 @@ int8_t create_display(display_t *display, int16_t width, int16_t height) {
 		return STATUS_ERROR;
 	}
 
-	log_info("Display created!");
+	display->mega_screen = SDL_CreateTexture(
+		display->renderer, texture_pixel_format, texture_access, MEGA_WIDTH, MEGA_HEIGHT
+	);
+	if (display->mega_screen == NULL) {
+		log_error("Unable to create MegaChip render screen: %s", SDL_GetError());
+		destroy_display(display);
+		return STATUS_ERROR;
+	}
+	SDL_SetTextureBlendMode(display->mega_screen, SDL_BLENDMODE_BLEND);
+
+	display->format = SDL_AllocFormat(texture_pixel_format);
+	if (display->format == NULL) {
+		log_error("Unable to allocate screen pixel format: %s", SDL_GetError());
+		destroy_display(display);
+		return STATUS_ERROR;
+	}
+
+	/* Map colors once, instead of for each pixel. */
+	SDL_PixelFormat *format = display->format;
+	display->palette[0] = SDL_MapRGBA(format, BACK_R, BACK_G, BACK_B, 0xFF);
+	display->palette[1] = SDL_MapRGBA(format, FORE_R, FORE_G, FORE_B, 0xFF);
+	display->palette[2] = SDL_MapRGBA(format, PLANE2_R, PLANE2_G, PLANE2_B, 0xFF);
+	display->palette[3] = SDL_MapRGBA(format, BLEND_R, BLEND_G, BLEND_B, 0xFF);
+
+	const uint8_t colors[PHOSPHOR_COLORS][3] = {
+		{ BACK_R, BACK_G, BACK_B },
+		{ FORE_R, FORE_G, FORE_B },
+		{ PLANE2_R, PLANE2_G, PLANE2_B },
+		{ BLEND_R, BLEND_G, BLEND_B },
+	};
+	uint8_t ramp[PHOSPHOR_RAMP_SIZE][3];
+	phosphor_ramp(ramp, colors);
+	for (size_t i = 0; i < PHOSPHOR_RAMP_SIZE; i += 1) {
+		display->ramp[i] = SDL_MapRGBA(format, ramp[i][0], ramp[i][1], ramp[i][2], 0xFF);
+	}
+
+	display->active_screen = display->cpu_screen;
+	display->screen_area = (SDL_Rect){
+		0, 0, GFX_LORES_WIDTH * display->scale, GFX_LORES_HEIGHT * display->scale
+	};
+
+	log_info("Display created, screen scaler is %s!", scaler_name(scaler));
 	return STATUS_OK;
 }
 
 void destroy_display(display_t *display) {
+	if (display->format != NULL) {
+		SDL_FreeFormat(display->format);
+	}
+
+	if (display->mega_screen != NULL) {
+		SDL_DestroyTexture(display->mega_screen);
+		log_info("MegaChip render screen destroyed!");
+	}
+
 	if (display->cpu_screen != NULL) {
 		SDL_DestroyTexture(display->cpu_screen);
 		log_info("Chip8 render screen destroyed!");
@@ -81,30 +154,101 @@ int8_t surface_set_pixel(SDL_Surface *surface, uint32_t x, uint32_t y, uint32_t
 	return STATUS_OK;
 }
 
-void display_update_screen(display_t *display, uint8_t *gfx) {
-	uint32_t target_color = 0;
-	SDL_Surface *surface = NULL; /* Screen surface */
-	SDL_Texture *screen = display->cpu_screen;
+void display_update_screen(
+	display_t *display, gfx_plane_t *planes, uint8_t width, uint8_t height
+) {
+	display->active_screen = display->cpu_screen;
+	display->screen_area = (SDL_Rect){
+		0, 0, width * display->scale, height * display->scale
+	};
 
-	SDL_LockTextureToSurface(screen, NULL, &surface);
-	for (size_t x = 0; x < GFX_WIDTH; x += 1) {
-		for (size_t y = 0; y < GFX_HEIGHT; y += 1) {
-			uint8_t pixel = gfx[y * GFX_WIDTH + x];
+	if (display->has_phosphor) {
+		memcpy(display->planes, planes, sizeof(display->planes));
+		display->screen_width = width;
+		display->screen_height = height;
+		display->has_new_screen = true;
+		return; /* Uploaded by display_update_phosphor. */
+	}
 
-			if (pixel == 0x1) {
-				target_color = SDL_MapRGBA(surface->format, FORE_R, FORE_G, FORE_B, 0xFF);
-			} else {
-				target_color = SDL_MapRGBA(surface->format, BACK_R, BACK_G, BACK_B, 0xFF);
-			}
+	upload_screen(display, planes, width, height);
+}
+
+void display_update_phosphor(display_t *display, uint32_t ticks) {
+	if (!display->has_phosphor || display->active_screen != display->cpu_screen) {
+		return;
+	}
+	if (!display->has_new_screen && (ticks == 0 || display->phosphor.is_settled)) {
+		return; /* Nothing has changed. */
+	}
+
+	const uint8_t width = display->screen_width;
+	const uint8_t height = display->screen_height;
+	phosphor_step(&display->phosphor, display->planes, width, height, ticks);
+	display->has_new_screen = false;
+
+	upload_screen(display, display->planes, width, height);
+}
+
+bool display_is_fading(const display_t *display) {
+	return display->has_phosphor
+		&& (display->has_new_screen || !display->phosphor.is_settled);
+}
+
+void display_update_mega(display_t *display, mega_t *mega) {
+	mega_rect_t *dirty = &mega->dirty;
+	void *pixels = NULL;
+	int32_t pitch = 0;
+
+	display->active_screen = display->mega_screen;
+	display->screen_area = (SDL_Rect){0, 0, MEGA_WIDTH, MEGA_HEIGHT};
+	SDL_SetTextureAlphaMod(display->mega_screen, mega->alpha);
 
-			surface_set_pixel(surface, x, y, target_color);
+	/* Remap the palette only when the program loads new colors. */
+	if (mega->has_palette_changed) {
+		for (size_t i = 0; i < MEGA_PALETTE_SIZE; i += 1) {
+			const uint32_t argb = mega->palette[i];
+
+			display->mega_palette[i] = SDL_MapRGBA(
+				display->format, argb >> 16, argb >> 8, argb, argb >> 24
+			);
 		}
+
+		mega->has_palette_changed = false;
+		mega_mark_dirty(mega, 0, 0, MEGA_WIDTH, MEGA_HEIGHT);
 	}
-	SDL_UnlockTexture(screen);
+
+	if (dirty->right == 0) {
+		return; /* Nothing has been drawn. */
+	}
+
+	const SDL_Rect area = {
+		dirty->left, dirty->top, dirty->right - dirty->left, dirty->bottom - dirty->top
+	};
+	if (SDL_LockTexture(display->mega_screen, &area, &pixels, &pitch) < 0) {
+		log_error("Unable to lock MegaChip render screen: %s", SDL_GetError());
+		return;
+	}
+
+	for (int32_t y = 0; y < area.h; y += 1) {
+		const uint8_t *indexes = &mega->gfx[area.y + y][area.x];
+		uint32_t *line = (uint32_t *)((uint8_t *)pixels + y * pitch);
+
+		for (int32_t x = 0; x < area.w; x += 1) {
+			line[x] = display->mega_palette[indexes[x]];
+		}
+	}
+	SDL_UnlockTexture(display->mega_screen);
+
+	*dirty = (mega_rect_t){0, 0, 0, 0};
 }
 
 int8_t display_render_screen(display_t *display, SDL_Rect *srcrect, SDL_Rect *dstrect) {
-	return display_render(display, display->cpu_screen, srcrect, dstrect);
+	/* Only render the area used by the current resolution. */
+	if (srcrect == NULL) {
+		srcrect = &display->screen_area;
+	}
+
+	return display_render(display, display->active_screen, srcrect, dstrect);
 }
 
 int8_t display_render(
@@ -127,3 +271,61 @@ void display_clear(display_t *display, bool *is_running) {
 void display_update(display_t *display) {
 	SDL_RenderPresent(display->renderer);
 }
+
+static void upload_screen(
+	display_t *display, gfx_plane_t *planes, uint8_t width, uint8_t height
+) {
+	void *pixels = NULL;
+	int32_t pitch = 0;
+
+	if (SDL_LockTexture(display->cpu_screen, &display->screen_area, &pixels, &pitch) < 0) {
+		log_error("Unable to lock Chip8 render screen: %s", SDL_GetError());
+		return;
+	}
+
+	if (display->scaler == SCALER_NONE) {
+		write_colors(display, planes, width, height, pixels, pitch);
+	} else {
+		/* Colors are scaled directly, the scaler only compares and copies pixels. */
+		uint32_t colors[GFX_HEIGHT * GFX_WIDTH];
+		const int32_t colors_pitch = width * sizeof(uint32_t);
+
+		write_colors(display, planes, width, height, colors, colors_pitch);
+		scaler_scale(display->scaler, colors, width, height, pixels, pitch);
+	}
+	SDL_UnlockTexture(display->cpu_screen);
+}
+
+static void write_colors(
+	const display_t *display, gfx_plane_t *planes, uint8_t width, uint8_t height,
+	uint32_t *pixels, int32_t pitch
+) {
+	if (display->has_phosphor) {
+		phosphor_colors(&display->phosphor, display->ramp, pixels, pitch);
+	} else {
+		expand_planes(display, planes, width, height, pixels, pitch);
+	}
+}
+
+static void expand_planes(
+	const display_t *display, gfx_plane_t *planes, uint8_t width, uint8_t height,
+	uint32_t *pixels, int32_t pitch
+) {
+	for (uint8_t y = 0; y < height; y += 1) {
+		uint32_t *line = (uint32_t *)((uint8_t *)pixels + y * pitch);
+
+		for (uint8_t word = 0; word * GFX_WORD_BITS < width; word += 1) {
+			const uint64_t first = planes[0][y][word];
+			const uint64_t second = planes[1][y][word];
+
+			/* Palette index is the first plane bit plus the second plane bit * 2. */
+			for (uint8_t bit = 0; bit < GFX_WORD_BITS; bit += 1) {
+				const uint8_t shift = GFX_WORD_BITS - 1 - bit;
+				const uint8_t color = ((first >> shift) & 0x1)
+									| (((second >> shift) & 0x1) << 1);
+
+				line[word * GFX_WORD_BITS + bit] = display->palette[color];
+			}
+		}
+	}
+}
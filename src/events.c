@@ -0,0 +1,37 @@
+#include "events.h"
+
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+
+void event_queue_init(event_queue_t *queue) {
+	SDL_AtomicSet(&queue->head, 0);
+	SDL_AtomicSet(&queue->tail, 0);
+}
+
+bool event_queue_push(event_queue_t *queue, input_event_t event) {
+	const uint32_t tail = SDL_AtomicGet(&queue->tail);
+	const uint32_t head = SDL_AtomicGet(&queue->head);
+
+	if (tail - head >= EVENT_QUEUE_SIZE) {
+		return false;
+	}
+
+	/* The event is written before the tail is published. */
+	queue->events[tail & EVENT_QUEUE_MASK] = event;
+	SDL_AtomicSet(&queue->tail, tail + 1);
+	return true;
+}
+
+const input_event_t *event_queue_peek(event_queue_t *queue) {
+	const uint32_t head = SDL_AtomicGet(&queue->head);
+
+	if (head == (uint32_t)SDL_AtomicGet(&queue->tail)) {
+		return NULL;
+	}
+
+	return &queue->events[head & EVENT_QUEUE_MASK];
+}
+
+void event_queue_pop(event_queue_t *queue) {
+	/* Only the consumer writes the head, the slot is released after being read. */
+	SDL_AtomicAdd(&queue->head, 1);
+}
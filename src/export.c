@@ -0,0 +1,89 @@
+#include "export.h"
+
+#include "log.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+_Static_assert(
+	sizeof(((shared_state_t *)NULL)->gfx) == sizeof(gfx_plane_t) * GFX_PLANES,
+	"Exported planes must have the layout of the cpu planes"
+);
+
+int8_t export_init(export_t *export) {
+	*export = (export_t){ 0 };
+	shared_name(export->name, getpid());
+
+	const int32_t fd = shm_open(export->name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0) {
+		log_error("Unable to create shared memory %s: %s", export->name, strerror(errno));
+		return STATUS_ERROR;
+	}
+
+	void *segment = MAP_FAILED;
+	if (ftruncate(fd, sizeof(shared_segment_t)) == 0) {
+		segment = mmap(
+			NULL, sizeof(shared_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+		);
+	}
+	const int32_t error = errno;
+	close(fd);
+
+	if (segment == MAP_FAILED) {
+		log_error("Unable to map shared memory %s: %s", export->name, strerror(error));
+		shm_unlink(export->name);
+		return STATUS_ERROR;
+	}
+
+	/* Readers check the magic, so it is written once the header is complete. */
+	export->segment = segment;
+	export->segment->version = SHARED_VERSION;
+	export->segment->size = sizeof(shared_segment_t);
+	atomic_thread_fence(memory_order_release);
+	export->segment->magic = SHARED_MAGIC;
+
+	log_info("Exporting the screen to shared memory %s", export->name);
+	return STATUS_OK;
+}
+
+void export_quit(export_t *export) {
+	if (export->segment != NULL) {
+		munmap(export->segment, sizeof(shared_segment_t));
+		shm_unlink(export->name);
+		export->segment = NULL;
+	}
+}
+
+void export_publish(export_t *export, const cpu_t *cpu) {
+	shared_segment_t *segment = export->segment;
+	shared_state_t *state = &segment->state;
+	const uint32_t sequence = atomic_load_explicit(
+		&segment->sequence, memory_order_relaxed
+	);
+
+	/* Readers see an odd sequence before any byte of the state changes. */
+	atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	state->frame += 1;
+	state->instructions = cpu->instructions;
+	memcpy(state->gfx, cpu->gfx, sizeof(state->gfx));
+	memcpy(state->stack, cpu->stack, sizeof(state->stack));
+	memcpy(state->V, cpu->V, sizeof(state->V));
+	state->I = cpu->I;
+	state->PC = cpu->PC;
+	state->SP = cpu->SP;
+	state->opcode = cpu->opcode;
+	state->delay_timer = cpu->delay_timer;
+	state->sound_timer = cpu->sound_timer;
+	state->width = cpu->gfx_width;
+	state->height = cpu->gfx_height;
+	state->is_mega = cpu->is_mega;
+	state->has_exited = cpu->has_exited;
+
+	atomic_store_explicit(&segment->sequence, sequence + 2, memory_order_release);
+}
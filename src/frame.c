@@ -0,0 +1,72 @@
+#include "frame.h"
+
+#include <string.h>
+
+#define FRAME_FRESH		 0x4 /* Set in the middle index when it has not been read yet. */
+#define FRAME_INDEX_MASK 0x3
+
+static void capture_mega(mega_t *frame, mega_t *mega);
+
+void frame_buffer_init(frame_buffer_t *buffer) {
+	memset(buffer->frames, 0, sizeof(buffer->frames));
+
+	buffer->back = 0;
+	SDL_AtomicSet(&buffer->middle, 1);
+	buffer->front = 2;
+}
+
+bool frame_buffer_publish(frame_buffer_t *buffer, cpu_t *cpu) {
+	frame_t *frame = &buffer->frames[buffer->back];
+
+	frame->is_mega = cpu->is_mega;
+	if (cpu->is_mega) {
+		capture_mega(&frame->mega, &cpu->mega);
+	} else {
+		memcpy(frame->gfx, cpu->gfx, sizeof(frame->gfx));
+		frame->width = cpu->gfx_width;
+		frame->height = cpu->gfx_height;
+	}
+
+	/* A frame replaced before being read keeps the time of its older key press. */
+	if (frame->input_time == 0) {
+		frame->input_time = cpu->input_time;
+	}
+	cpu->input_time = 0;
+
+	/* The swap is a full barrier, the frame is written before being published. */
+	const int32_t previous = SDL_AtomicSet(&buffer->middle, buffer->back | FRAME_FRESH);
+	buffer->back = previous & FRAME_INDEX_MASK;
+
+	return (previous & FRAME_FRESH) == 0;
+}
+
+frame_t *frame_buffer_acquire(frame_buffer_t *buffer) {
+	if ((SDL_AtomicGet(&buffer->middle) & FRAME_FRESH) == 0) {
+		return NULL; /* Nothing has been published since the last acquire. */
+	}
+
+	const int32_t previous = SDL_AtomicSet(&buffer->middle, buffer->front);
+	buffer->front = previous & FRAME_INDEX_MASK;
+
+	return &buffer->frames[buffer->front];
+}
+
+static void capture_mega(mega_t *frame, mega_t *mega) {
+	/* A frame replaced before being read still holds its dirty area and palette
+	 * change, which are merged with the new ones. Read frames have them cleared.
+	 */
+	const mega_rect_t dropped = frame->dirty;
+	const bool has_palette_changed = frame->has_palette_changed;
+
+	*frame = *mega;
+	frame->has_palette_changed |= has_palette_changed;
+	if (dropped.right != 0) {
+		mega_mark_dirty(
+			frame, dropped.left, dropped.top, dropped.right - dropped.left,
+			dropped.bottom - dropped.top
+		);
+	}
+
+	mega->has_palette_changed = false;
+	mega->dirty = (mega_rect_t){0, 0, 0, 0};
+}
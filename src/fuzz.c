@@ -0,0 +1,604 @@
+#include "fuzz.h"
+
+#include "log.h"
+#include "opcodes.h"
+#include "utils.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEED_INCREMENT	 0x9E3779B9 /* Golden ratio, spreads the seeds of the lanes. */
+#define PROGRAM_WORDS	 128		/* Instructions of the generated programs. */
+#define MAX_MUTATIONS	 4
+#define MAX_SPLICE_SIZE	 32 /* Bytes copied from another program by a mutation. */
+#define NOP_OPCODE		 0x7000 /* V0 += 0 */
+#define DELAY_LOOP_WORDS 5
+
+#define ENGINE_BIT(engine) (1u << (engine))
+#define SCALAR_ENGINES	   ENGINE_BIT(FUZZ_PREDECODED)
+
+/* Part of cpu_t compared after each block, by the engines setting it. */
+typedef struct {
+	const char *name;
+	size_t offset;
+	size_t size;
+	uint32_t engines;
+} field_t;
+
+#define FIELD(field, engines) \
+	{ #field, offsetof(cpu_t, field), sizeof(((cpu_t *)0)->field), engines }
+
+/* The memory and MegaChip screen are compared apart, the other fields are constant or
+ * only used by the engines. Vector instructions of the lanes do not fetch the opcode
+ * fields, they are left from the last instruction done by the cpu.
+ */
+static const field_t fields[] = {
+	FIELD(stack, FUZZ_ALL_ENGINES),
+	FIELD(V, FUZZ_ALL_ENGINES),
+	FIELD(I, FUZZ_ALL_ENGINES),
+	FIELD(PC, FUZZ_ALL_ENGINES),
+	FIELD(SP, FUZZ_ALL_ENGINES),
+	FIELD(gfx, FUZZ_ALL_ENGINES),
+	FIELD(planes, FUZZ_ALL_ENGINES),
+	FIELD(gfx_width, FUZZ_ALL_ENGINES),
+	FIELD(gfx_height, FUZZ_ALL_ENGINES),
+	FIELD(has_gfx_changed, FUZZ_ALL_ENGINES),
+	FIELD(is_mega, FUZZ_ALL_ENGINES),
+	FIELD(delay_timer, FUZZ_ALL_ENGINES),
+	FIELD(sound_timer, FUZZ_ALL_ENGINES),
+	FIELD(audio_pattern, FUZZ_ALL_ENGINES),
+	FIELD(pitch, FUZZ_ALL_ENGINES),
+	FIELD(has_audio_changed, FUZZ_ALL_ENGINES),
+	FIELD(key_state, FUZZ_ALL_ENGINES),
+	FIELD(rpl, FUZZ_ALL_ENGINES),
+	FIELD(has_exited, FUZZ_ALL_ENGINES),
+	FIELD(random, FUZZ_ALL_ENGINES),
+	FIELD(pending_cpu_cycles, FUZZ_ALL_ENGINES),
+	FIELD(is_idle, FUZZ_ALL_ENGINES),
+	FIELD(is_halted, FUZZ_ALL_ENGINES),
+	FIELD(instructions, FUZZ_ALL_ENGINES),
+	FIELD(opcode, SCALAR_ENGINES),
+	FIELD(addr, SCALAR_ENGINES),
+	FIELD(byte, SCALAR_ENGINES),
+	FIELD(nibble, SCALAR_ENGINES),
+	FIELD(x, SCALAR_ENGINES),
+	FIELD(y, SCALAR_ENGINES),
+};
+
+static const char *engine_names[FUZZ_ENGINE_COUNT] = {
+	[FUZZ_PREDECODED] = "predecoded",
+	[FUZZ_LANES_ENGINE] = "lanes",
+};
+
+static inline uint32_t next_random(uint32_t *random) {
+	*random ^= *random << 13;
+	*random ^= *random >> 17;
+	*random ^= *random << 5;
+	return *random;
+}
+
+/* Cpu of a lane, the reference is side 0 and each engine the side after it. */
+static inline cpu_t *cpu_at(fuzz_t *fuzz, uint8_t side, uint8_t lane) {
+	return &fuzz->cpus[side * FUZZ_LANES + lane];
+}
+
+static void reset_lane(fuzz_t *fuzz, cpu_t *cpu, const fuzz_case_t *test, uint8_t lane);
+/* Set random keys of a lane on every side, as the same key event. */
+static void press_keys(fuzz_t *fuzz, uint32_t engines, uint8_t lane, uint32_t *random);
+/* Do the cycles of a timer tick as cpu_step_tick, but decode each opcode from the
+ * OPCODES table.
+ */
+static int8_t reference_tick(fuzz_t *fuzz, cpu_t *cpu);
+/* Run a tick of the lanes not stopped, and set the failed ones. */
+static void engine_tick(
+	fuzz_t *fuzz, fuzz_engine_t engine, uint32_t stopped, uint8_t count, bool *failed
+);
+/* Return the name of the first field differing from the reference, or NULL. */
+static const char *compare_cpu(
+	const cpu_t *reference, const cpu_t *cpu, uint32_t engine
+);
+
+static void add_corpus(fuzz_t *fuzz, const fuzz_case_t *test);
+static void generate_program(fuzz_t *fuzz, fuzz_case_t *test);
+static void mutate(fuzz_t *fuzz, fuzz_case_t *test);
+/* Return an instruction of the profile with random operands, or sometimes any word.
+ * Jumps and calls mostly go to an instruction of the program.
+ */
+static uint16_t random_instruction(fuzz_t *fuzz, uint16_t words);
+static void write_word(fuzz_case_t *test, uint16_t word_index, uint16_t word);
+static void remove_bytes(fuzz_case_t *test, uint16_t offset, uint16_t size);
+/* Keep the candidate if the engine of the divergence still differs on it. */
+static bool try_candidate(
+	fuzz_t *fuzz, fuzz_case_t *test, const fuzz_case_t *candidate,
+	fuzz_divergence_t *divergence
+);
+
+int8_t fuzz_init(fuzz_t *fuzz, const cpu_t *cpu, uint32_t seed) {
+	memset(fuzz, 0, sizeof(fuzz_t));
+	fuzz->random = seed != 0 ? seed : RANDOM_SEED; /* Xorshift never leaves 0. */
+
+	/* Allocated once, each case clones the initial cpu back in place. */
+	fuzz->cpus = calloc((1 + FUZZ_ENGINE_COUNT) * FUZZ_LANES, sizeof(cpu_t));
+	fuzz->corpus = malloc(FUZZ_CORPUS_SIZE * sizeof(fuzz_case_t));
+	if (fuzz->cpus == NULL || fuzz->corpus == NULL) {
+		log_error("Unable to allocate fuzzing cpus!");
+		fuzz_quit(fuzz);
+		return STATUS_ERROR;
+	}
+
+	if (cpu_init(&fuzz->cpus[0], cpu->clock_speed, cpu->profile) != STATUS_OK) {
+		fuzz_quit(fuzz);
+		return STATUS_ERROR;
+	}
+	fuzz->cpus[0].bounds = cpu->bounds;
+	cpu_fork(&fuzz->initial, &fuzz->cpus[0]);
+
+	while (OPCODES[cpu->profile][fuzz->opcodes_count].handler != NULL) {
+		fuzz->opcodes_count += 1;
+	}
+	return STATUS_OK;
+}
+
+void fuzz_quit(fuzz_t *fuzz) {
+	free(fuzz->cpus);
+	fuzz->cpus = NULL;
+	free(fuzz->corpus);
+	fuzz->corpus = NULL;
+	fuzz->corpus_size = 0;
+}
+
+void fuzz_add_seed(fuzz_t *fuzz, const uint8_t *rom, uint32_t size, fuzz_case_t *test) {
+	test->size = size < FUZZ_ROM_SIZE ? size : FUZZ_ROM_SIZE;
+	memcpy(test->rom, rom, test->size);
+	test->seed = 0;
+	test->lanes = FUZZ_LANES;
+	add_corpus(fuzz, test);
+}
+
+void fuzz_generate(fuzz_t *fuzz, fuzz_case_t *test) {
+	if (fuzz->corpus_size > 0 && next_random(&fuzz->random) % 4 != 0) {
+		const fuzz_case_t *parent = &fuzz->corpus[fuzz->random % fuzz->corpus_size];
+
+		test->size = parent->size;
+		memcpy(test->rom, parent->rom, parent->size);
+		mutate(fuzz, test);
+	} else {
+		generate_program(fuzz, test);
+	}
+
+	/* Programs waiting for keys only go further with inputs. */
+	next_random(&fuzz->random);
+	test->seed = fuzz->random % 4 != 0 ? fuzz->random : 0;
+	test->lanes = FUZZ_LANES;
+}
+
+bool fuzz_run(
+	fuzz_t *fuzz, const fuzz_case_t *test, uint32_t engines,
+	fuzz_divergence_t *divergence
+) {
+	uint32_t inputs[FUZZ_LANES];
+	bool failed[FUZZ_LANES];
+	bool has_failed[FUZZ_LANES];
+	uint32_t stopped = 0; /* Lanes stopped by an error, they are no longer run. */
+	const uint8_t count = test->lanes < FUZZ_LANES ? test->lanes : FUZZ_LANES;
+
+	for (uint8_t side = 0; side <= FUZZ_ENGINE_COUNT; side += 1) {
+		if (side > 0 && (engines & ENGINE_BIT(side - 1)) == 0) {
+			continue;
+		}
+		for (uint8_t lane = 0; lane < count; lane += 1) {
+			reset_lane(fuzz, cpu_at(fuzz, side, lane), test, lane);
+		}
+	}
+	for (uint8_t lane = 0; lane < count; lane += 1) {
+		inputs[lane] = test->seed + lane * SEED_INCREMENT;
+		inputs[lane] = inputs[lane] != 0 ? inputs[lane] : RANDOM_SEED;
+	}
+
+	fuzz->cases += 1;
+	for (uint32_t block = 0; block < FUZZ_BLOCKS; block += 1) {
+		uint32_t running = 0;
+
+		for (uint8_t lane = 0; lane < count; lane += 1) {
+			if ((stopped >> lane) & 1) {
+				continue;
+			}
+			if (test->seed != 0) {
+				press_keys(fuzz, engines, lane, &inputs[lane]);
+			}
+			has_failed[lane] = reference_tick(fuzz, cpu_at(fuzz, 0, lane)) != STATUS_OK;
+		}
+
+		for (fuzz_engine_t engine = 0; engine < FUZZ_ENGINE_COUNT; engine += 1) {
+			if ((engines & ENGINE_BIT(engine)) == 0) {
+				continue;
+			}
+			engine_tick(fuzz, engine, stopped, count, failed);
+
+			for (uint8_t lane = 0; lane < count; lane += 1) {
+				const char *field = NULL;
+
+				if ((stopped >> lane) & 1) {
+					continue;
+				}
+				/* Cycles done before an error are not counted the same way. */
+				if (failed[lane] != has_failed[lane]) {
+					field = "status";
+				} else if (!has_failed[lane]) {
+					field = compare_cpu(
+						cpu_at(fuzz, 0, lane), cpu_at(fuzz, engine + 1, lane),
+						ENGINE_BIT(engine)
+					);
+				}
+
+				if (field != NULL) {
+					*divergence = (fuzz_divergence_t){
+						.engine = engine,
+						.block = block,
+						.lane = lane,
+						.field = field,
+					};
+					return true;
+				}
+			}
+		}
+
+		for (uint8_t lane = 0; lane < count; lane += 1) {
+			if (!((stopped >> lane) & 1) && has_failed[lane]) {
+				stopped |= 1u << lane;
+			}
+			if (!((stopped >> lane) & 1) && !cpu_at(fuzz, 0, lane)->has_exited) {
+				running |= 1u << lane;
+			}
+		}
+		if (running == 0) {
+			break; /* Only the timers would change. */
+		}
+	}
+
+	/* Programs failing in every lane are not worth mutating. */
+	if (!fuzz->is_minimizing && stopped != (1u << count) - 1) {
+		add_corpus(fuzz, test);
+	}
+	return false;
+}
+
+void fuzz_minimize(fuzz_t *fuzz, fuzz_case_t *test, fuzz_divergence_t *divergence) {
+	static fuzz_case_t candidate;
+
+	fuzz->is_minimizing = true;
+
+	candidate = *test;
+	candidate.seed = 0;
+	try_candidate(fuzz, test, &candidate, divergence);
+
+	for (uint8_t lanes = 1; lanes < test->lanes; lanes *= 2) {
+		candidate = *test;
+		candidate.lanes = lanes;
+		if (try_candidate(fuzz, test, &candidate, divergence)) {
+			break;
+		}
+	}
+
+	/* Removing instructions moves the others, so they can be removed once NOPs. */
+	uint16_t size;
+	do {
+		size = test->size;
+
+		/* Remove chunks of instructions, halving them down to single instructions. */
+		for (uint16_t chunk = size / 2 & ~1; chunk >= 2; chunk = chunk / 2 & ~1) {
+			for (uint16_t offset = 0; offset + chunk <= test->size;) {
+				candidate = *test;
+				remove_bytes(&candidate, offset, chunk);
+				if (!try_candidate(fuzz, test, &candidate, divergence)) {
+					offset += chunk;
+				}
+			}
+		}
+
+		/* Instructions needed for their address only are replaced by NOPs. */
+		for (uint16_t word = 0; word < test->size / 2; word += 1) {
+			if ((test->rom[word * 2] << 8 | test->rom[word * 2 + 1]) != NOP_OPCODE) {
+				candidate = *test;
+				write_word(&candidate, word, NOP_OPCODE);
+				try_candidate(fuzz, test, &candidate, divergence);
+			}
+		}
+	} while (test->size < size);
+
+	fuzz->is_minimizing = false;
+}
+
+int8_t fuzz_write_rom(const fuzz_case_t *test, const char *filepath) {
+	FILE *file = fopen(filepath, "wb");
+	if (file == NULL) {
+		log_error("Unable to open reproducer file: %s", filepath);
+		return STATUS_ERROR;
+	}
+
+	const bool is_written = test->size == 0
+						 || fwrite(test->rom, test->size, 1, file) == 1;
+	fclose(file);
+	if (!is_written) {
+		log_error("Unable to write reproducer file: %s", filepath);
+		return STATUS_ERROR;
+	}
+	return STATUS_OK;
+}
+
+const char *fuzz_engine_name(fuzz_engine_t engine) {
+	return engine < FUZZ_ENGINE_COUNT ? engine_names[engine] : "unknown";
+}
+
+static void reset_lane(fuzz_t *fuzz, cpu_t *cpu, const fuzz_case_t *test, uint8_t lane) {
+	/* Only the pages written by the previous case are copied back. */
+	cpu_clone(cpu, &fuzz->initial);
+	if (test->size > 0) {
+		memcpy(cpu->memory + ROM_OFFSET, test->rom, test->size);
+		opcode_invalidate(cpu, ROM_OFFSET, test->size);
+	}
+
+	/* Lanes draw different random values, so they take different paths. */
+	cpu->random = fuzz->initial.random + lane * SEED_INCREMENT;
+	cpu->random = cpu->random != 0 ? cpu->random : RANDOM_SEED;
+}
+
+static void press_keys(fuzz_t *fuzz, uint32_t engines, uint8_t lane, uint32_t *random) {
+	next_random(random);
+	const uint16_t keys = *random & *random >> 16; /* About 4 keys held. */
+
+	for (uint8_t side = 0; side <= FUZZ_ENGINE_COUNT; side += 1) {
+		if (side > 0 && (engines & ENGINE_BIT(side - 1)) == 0) {
+			continue;
+		}
+
+		cpu_t *cpu = cpu_at(fuzz, side, lane);
+		for (uint8_t key = 0; key < KEYS_COUNT; key += 1) {
+			cpu->key_state[key] = (keys >> key) & 1;
+		}
+		cpu->is_halted = false; /* Let 0xFx0A check the keys again. */
+	}
+}
+
+static int8_t reference_tick(fuzz_t *fuzz, cpu_t *cpu) {
+	uint32_t done = 0;
+
+	cpu->pending_cpu_cycles += (double)cpu->clock_speed / TIMER_CLOCK_SPEED;
+	cpu->is_idle = false;
+	if (cpu->delay_timer > 0) {
+		cpu->delay_timer -= 1;
+	}
+	if (cpu->sound_timer > 0) {
+		cpu->sound_timer -= 1;
+	}
+
+	const uint32_t amount = (uint32_t)cpu->pending_cpu_cycles;
+	while (done < amount && !cpu->has_exited && !cpu->is_idle && !cpu->is_halted) {
+		if (cpu->bounds == BOUNDS_TRAP && cpu->PC > RAM_SIZE - 2) {
+			return STATUS_ERROR;
+		}
+
+		opcode_fetch(cpu);
+		if ((cpu->opcode & 0xF0FF) == 0xF007 && cpu_is_delay_loop(cpu)) {
+			cpu->V[cpu->x] = cpu->delay_timer;
+			cpu->is_idle = true;
+			break;
+		}
+
+		if (opcode_decode(cpu) != STATUS_OK) {
+			return STATUS_ERROR;
+		}
+		done += 1;
+	}
+
+	cpu->instructions += done;
+	fuzz->instructions += done;
+	cpu->pending_cpu_cycles = fmod(cpu->pending_cpu_cycles, 1.0);
+	return STATUS_OK;
+}
+
+static void engine_tick(
+	fuzz_t *fuzz, fuzz_engine_t engine, uint32_t stopped, uint8_t count, bool *failed
+) {
+	uint8_t lanes[FUZZ_LANES]; /* Lane of each cpu stepped together. */
+
+	fuzz->lanes.count = 0;
+	for (uint8_t lane = 0; lane < count; lane += 1) {
+		if ((stopped >> lane) & 1) {
+			continue;
+		}
+
+		cpu_t *cpu = cpu_at(fuzz, engine + 1, lane);
+		if (engine == FUZZ_PREDECODED) {
+			failed[lane] = cpu_step_tick(cpu, NULL) != STATUS_OK;
+		} else {
+			lanes[fuzz->lanes.count] = lane;
+			fuzz->lanes.cpus[fuzz->lanes.count] = cpu;
+			fuzz->lanes.count += 1;
+		}
+	}
+
+	if (fuzz->lanes.count > 0) {
+		lanes_step_tick(&fuzz->lanes);
+		for (uint8_t i = 0; i < fuzz->lanes.count; i += 1) {
+			failed[lanes[i]] = fuzz->lanes.has_failed[i];
+		}
+	}
+}
+
+static const char *compare_cpu(
+	const cpu_t *reference, const cpu_t *cpu, uint32_t engine
+) {
+	for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i += 1) {
+		const field_t *field = &fields[i];
+
+		if ((field->engines & engine) != 0
+			&& memcmp(
+				   (const uint8_t *)reference + field->offset,
+				   (const uint8_t *)cpu + field->offset, field->size
+			   ) != 0) {
+			return field->name;
+		}
+	}
+
+	/* Pages written by neither of them are still the ones of the initial cpu. */
+	for (uint16_t word = 0; word < PAGES_COUNT / 64; word += 1) {
+		for (uint64_t pages = reference->written_pages[word] | cpu->written_pages[word];
+			 pages != 0; pages &= pages - 1) {
+			const uint32_t address = (word * 64 + __builtin_ctzll(pages)) * PAGE_SIZE;
+
+			if (memcmp(reference->memory + address, cpu->memory + address, PAGE_SIZE)
+				!= 0) {
+				return "memory";
+			}
+		}
+	}
+
+	/* The MegaChip screen is only drawn once enabled. */
+	const size_t start = reference->is_mega || cpu->is_mega ? 0
+															: offsetof(mega_t, palette);
+	const uint8_t *reference_mega = (const uint8_t *)&reference->mega;
+	const uint8_t *mega = (const uint8_t *)&cpu->mega;
+	if (memcmp(reference_mega + start, mega + start, sizeof(mega_t) - start) != 0) {
+		return "mega";
+	}
+	return NULL;
+}
+
+static void add_corpus(fuzz_t *fuzz, const fuzz_case_t *test) {
+	fuzz_case_t *entry = &fuzz->corpus[fuzz->corpus_next];
+
+	entry->size = test->size;
+	memcpy(entry->rom, test->rom, test->size);
+	entry->seed = 0;
+	entry->lanes = FUZZ_LANES;
+
+	fuzz->corpus_next = (fuzz->corpus_next + 1) % FUZZ_CORPUS_SIZE;
+	if (fuzz->corpus_size < FUZZ_CORPUS_SIZE) {
+		fuzz->corpus_size += 1;
+	}
+}
+
+static void generate_program(fuzz_t *fuzz, fuzz_case_t *test) {
+	const uint16_t words = 2 + next_random(&fuzz->random) % (PROGRAM_WORDS - 1);
+
+	/* Programs loop like games do, instead of running into the empty memory. */
+	test->size = words * 2;
+	for (uint16_t word = 0; word < words - 1; word += 1) {
+		write_word(test, word, random_instruction(fuzz, words));
+	}
+	write_word(test, words - 1, 0x1000 | ROM_OFFSET);
+
+	/* Delay loops are rarely generated, but the engines idle on them. */
+	if (words > DELAY_LOOP_WORDS && next_random(&fuzz->random) % 4 == 0) {
+		const uint16_t word = fuzz->random % (words - DELAY_LOOP_WORDS);
+		const uint16_t address = ROM_OFFSET + (word + 2) * 2;
+		const uint8_t x = (fuzz->random >> 8) & 0xF;
+
+		write_word(test, word, 0x6000 | x << 8 | (fuzz->random >> 16 & 0x0F));
+		write_word(test, word + 1, 0xF015 | x << 8);
+		write_word(test, word + 2, 0xF007 | x << 8);
+		write_word(test, word + 3, 0x3000 | x << 8);
+		write_word(test, word + 4, 0x1000 | address);
+	}
+}
+
+static void mutate(fuzz_t *fuzz, fuzz_case_t *test) {
+	const uint8_t mutations = 1 + next_random(&fuzz->random) % MAX_MUTATIONS;
+
+	for (uint8_t i = 0; i < mutations; i += 1) {
+		const uint32_t random = next_random(&fuzz->random);
+		const uint16_t words = test->size / 2;
+		const uint16_t word = words > 0 ? (random >> 8) % words : 0;
+
+		switch (random % 5) {
+		case 0: /* Flip a bit. */
+			if (test->size > 0) {
+				test->rom[(random >> 8) % test->size] ^= 1 << (random >> 4 & 7);
+			}
+			break;
+		case 1: /* Replace an instruction. */
+			if (words > 0) {
+				write_word(test, word, random_instruction(fuzz, words));
+			}
+			break;
+		case 2: /* Insert an instruction. */
+			if (test->size + 2 <= FUZZ_ROM_SIZE) {
+				memmove(
+					&test->rom[word * 2 + 2], &test->rom[word * 2],
+					test->size - word * 2
+				);
+				test->size += 2;
+				write_word(test, word, random_instruction(fuzz, words + 1));
+			}
+			break;
+		case 3: /* Remove an instruction. */
+			if (words > 1) {
+				remove_bytes(test, word * 2, 2);
+			}
+			break;
+		default: { /* Copy instructions of another program over these ones. */
+			const fuzz_case_t *other = &fuzz->corpus[random % fuzz->corpus_size];
+			const uint16_t start = next_random(&fuzz->random) % (other->size + 1) & ~1;
+			const uint16_t room = FUZZ_ROM_SIZE - word * 2;
+			uint16_t size = other->size - start < room ? other->size - start : room;
+
+			size = size < MAX_SPLICE_SIZE ? size : MAX_SPLICE_SIZE;
+
+			memcpy(&test->rom[word * 2], &other->rom[start], size);
+			if (word * 2 + size > test->size) {
+				test->size = word * 2 + size;
+			}
+			break;
+		}
+		}
+	}
+}
+
+static uint16_t random_instruction(fuzz_t *fuzz, uint16_t words) {
+	const uint32_t random = next_random(&fuzz->random);
+
+	if (random % 64 == 0) {
+		return random >> 16;
+	}
+
+	const opcode_t *entry = &OPCODES[fuzz->initial.profile]
+									[(random >> 4) % fuzz->opcodes_count];
+	const uint16_t target = ROM_OFFSET + (random >> 12) % words * 2;
+	const uint8_t group = entry->opcode >> 12;
+
+	if (entry->mask == 0xF000 && (group == 0x1 || group == 0x2) && random % 8 != 1) {
+		return entry->opcode | target;
+	}
+	return entry->opcode | (next_random(&fuzz->random) & ~entry->mask);
+}
+
+static void write_word(fuzz_case_t *test, uint16_t word_index, uint16_t word) {
+	test->rom[word_index * 2] = word >> 8;
+	test->rom[word_index * 2 + 1] = word & 0xFF;
+}
+
+static void remove_bytes(fuzz_case_t *test, uint16_t offset, uint16_t size) {
+	memmove(
+		&test->rom[offset], &test->rom[offset + size], test->size - offset - size
+	);
+	test->size -= size;
+}
+
+static bool try_candidate(
+	fuzz_t *fuzz, fuzz_case_t *test, const fuzz_case_t *candidate,
+	fuzz_divergence_t *divergence
+) {
+	fuzz_divergence_t found;
+
+	if (!fuzz_run(fuzz, candidate, ENGINE_BIT(divergence->engine), &found)) {
+		return false;
+	}
+
+	*test = *candidate;
+	*divergence = found;
+	return true;
+}
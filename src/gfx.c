@@ -0,0 +1,99 @@
+#include "gfx.h"
+
+#include <string.h>
+
+static inline uint64_t rotate_right(uint64_t word, uint8_t amount);
+
+bool gfx_xor_row(gfx_row_t row, uint16_t bits, uint8_t x, uint8_t width) {
+	/* Align sprite bits to the leftmost pixel of the row. */
+	uint64_t high = (uint64_t)bits << (GFX_WORD_BITS - 16);
+	uint64_t low = 0;
+
+	if (width == GFX_LORES_WIDTH) {
+		high = rotate_right(high, x % GFX_LORES_WIDTH);
+
+		const bool is_erased = (row[0] & high) != 0;
+		row[0] ^= high;
+		return is_erased;
+	}
+
+	/* Rotate the 128 bits row, swapping words first if needed. */
+	uint8_t amount = x % GFX_WIDTH;
+	if (amount >= GFX_WORD_BITS) {
+		low = high;
+		high = 0;
+		amount -= GFX_WORD_BITS;
+	}
+	if (amount > 0) {
+		const uint64_t carry_high = high << (GFX_WORD_BITS - amount);
+		const uint64_t carry_low = low << (GFX_WORD_BITS - amount);
+
+		high = (high >> amount) | carry_low;
+		low = (low >> amount) | carry_high;
+	}
+
+	const bool is_erased = ((row[0] & high) | (row[1] & low)) != 0;
+	row[0] ^= high;
+	row[1] ^= low;
+	return is_erased;
+}
+
+void gfx_scroll_down(gfx_row_t *rows, uint8_t amount, uint8_t height) {
+	if (amount >= height) {
+		memset(rows, 0, height * sizeof(gfx_row_t));
+		return;
+	}
+
+	memmove(rows + amount, rows, (height - amount) * sizeof(gfx_row_t));
+	memset(rows, 0, amount * sizeof(gfx_row_t));
+}
+
+void gfx_scroll_up(gfx_row_t *rows, uint8_t amount, uint8_t height) {
+	if (amount >= height) {
+		memset(rows, 0, height * sizeof(gfx_row_t));
+		return;
+	}
+
+	memmove(rows, rows + amount, (height - amount) * sizeof(gfx_row_t));
+	memset(rows + height - amount, 0, amount * sizeof(gfx_row_t));
+}
+
+void gfx_scroll_right(gfx_row_t *rows, uint8_t amount, uint8_t width, uint8_t height) {
+	if (amount == 0 || amount >= GFX_WORD_BITS) {
+		return; /* Only partial word shifts are supported. */
+	}
+
+	if (width == GFX_LORES_WIDTH) {
+		for (uint8_t y = 0; y < height; y += 1) {
+			rows[y][0] >>= amount;
+		}
+		return;
+	}
+
+	for (uint8_t y = 0; y < height; y += 1) {
+		rows[y][1] = (rows[y][1] >> amount) | (rows[y][0] << (GFX_WORD_BITS - amount));
+		rows[y][0] >>= amount;
+	}
+}
+
+void gfx_scroll_left(gfx_row_t *rows, uint8_t amount, uint8_t width, uint8_t height) {
+	if (amount == 0 || amount >= GFX_WORD_BITS) {
+		return; /* Only partial word shifts are supported. */
+	}
+
+	if (width == GFX_LORES_WIDTH) {
+		for (uint8_t y = 0; y < height; y += 1) {
+			rows[y][0] <<= amount;
+		}
+		return;
+	}
+
+	for (uint8_t y = 0; y < height; y += 1) {
+		rows[y][0] = (rows[y][0] << amount) | (rows[y][1] >> (GFX_WORD_BITS - amount));
+		rows[y][1] <<= amount;
+	}
+}
+
+static inline uint64_t rotate_right(uint64_t word, uint8_t amount) {
+	return (word >> amount) | (word << ((GFX_WORD_BITS - amount) % GFX_WORD_BITS));
+}
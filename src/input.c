@@ -5,6 +5,7 @@
 #include "utils.h"
 
 #include <SDL_keyboard.h>
+#include <SDL_timer.h>
 #include <string.h>
 
 /* Default scancode layout.
@@ -32,20 +33,139 @@ static const SDL_Scancode default_keymap[] = {
 	SDL_SCANCODE_V, /* F */
 };
 
+/* Default gamepad layout, directions are 5, 7, 8 and 9 like most programs. */
+static const SDL_GameControllerButton default_buttons[] = {
+	SDL_CONTROLLER_BUTTON_INVALID,			/* 0 */
+	SDL_CONTROLLER_BUTTON_INVALID,			/* 1 */
+	SDL_CONTROLLER_BUTTON_INVALID,			/* 2 */
+	SDL_CONTROLLER_BUTTON_INVALID,			/* 3 */
+	SDL_CONTROLLER_BUTTON_B,				/* 4 */
+	SDL_CONTROLLER_BUTTON_DPAD_UP,			/* 5 */
+	SDL_CONTROLLER_BUTTON_A,				/* 6 */
+	SDL_CONTROLLER_BUTTON_DPAD_LEFT,		/* 7 */
+	SDL_CONTROLLER_BUTTON_DPAD_DOWN,		/* 8 */
+	SDL_CONTROLLER_BUTTON_DPAD_RIGHT,		/* 9 */
+	SDL_CONTROLLER_BUTTON_X,				/* A */
+	SDL_CONTROLLER_BUTTON_Y,				/* B */
+	SDL_CONTROLLER_BUTTON_LEFTSHOULDER,		/* C */
+	SDL_CONTROLLER_BUTTON_RIGHTSHOULDER,	/* D */
+	SDL_CONTROLLER_BUTTON_BACK,				/* E */
+	SDL_CONTROLLER_BUTTON_START,			/* F */
+};
+
+static bool queue_key(
+	event_queue_t *queue, int8_t key, bool is_pressed, uint32_t timestamp
+);
+static void open_controller(input_t *input, int32_t index);
+
 void input_init(input_t *input) {
-	/* Load default keymap */
-	memcpy(input->cpu_keys, default_keymap, KEYS_COUNT * sizeof(SDL_Scancode));
+	/* Build lookup tables from the default mappings. */
+	memset(input->scancode_keys, INPUT_NO_KEY, sizeof(input->scancode_keys));
+	memset(input->button_keys, INPUT_NO_KEY, sizeof(input->button_keys));
+
+	for (uint8_t key = 0; key < KEYS_COUNT; key += 1) {
+		input->scancode_keys[default_keymap[key]] = key;
+
+		if (default_buttons[key] != SDL_CONTROLLER_BUTTON_INVALID) {
+			input->button_keys[default_buttons[key]] = key;
+		}
+	}
+
+	input->controller = NULL;
 }
 
-void input_update_keystate(SDL_Event *event, input_t map, uint8_t *keystate) {
-	SDL_Scancode scancode = event->key.keysym.scancode;
-	bool is_pressed = event->key.state == SDL_PRESSED;
+void input_quit(input_t *input) {
+	if (input->controller != NULL) {
+		SDL_GameControllerClose(input->controller);
+		input->controller = NULL;
+	}
+}
+
+void input_set_keymap(input_t *input, const uint16_t *scancodes) {
+	for (uint8_t key = 0; key < KEYS_COUNT; key += 1) {
+		const uint16_t new_scancode = scancodes[key];
+		if (new_scancode == SDL_SCANCODE_UNKNOWN || new_scancode >= SDL_NUM_SCANCODES) {
+			continue;
+		}
+
+		/* Unmap the default scancode of the key. */
+		for (uint16_t scancode = 0; scancode < SDL_NUM_SCANCODES; scancode += 1) {
+			if (input->scancode_keys[scancode] == key) {
+				input->scancode_keys[scancode] = INPUT_NO_KEY;
+			}
+		}
+		input->scancode_keys[new_scancode] = key;
+	}
+}
 
-	for (uint8_t i = 0; i < KEYS_COUNT; i += 1) {
-		if (map.cpu_keys[i] == scancode) {
-			/* If key is pressed, set keystate to 1, if not, set it to 0. */
-			keystate[i] = is_pressed ? 1 : 0;
-			break;
+bool input_handle_event(input_t *input, SDL_Event *event, event_queue_t *queue) {
+	switch (event->type) {
+	case SDL_KEYUP: /* FALLTHROUGH. */
+	case SDL_KEYDOWN:
+		if (event->key.repeat == 0) {
+			return queue_key(
+				queue, input->scancode_keys[event->key.keysym.scancode],
+				event->key.state == SDL_PRESSED, event->key.timestamp
+			);
 		}
+		break;
+	case SDL_CONTROLLERBUTTONUP: /* FALLTHROUGH. */
+	case SDL_CONTROLLERBUTTONDOWN:
+		if (event->cbutton.button < SDL_CONTROLLER_BUTTON_MAX) {
+			return queue_key(
+				queue, input->button_keys[event->cbutton.button],
+				event->cbutton.state == SDL_PRESSED, event->cbutton.timestamp
+			);
+		}
+		break;
+	case SDL_CONTROLLERDEVICEADDED:
+		open_controller(input, event->cdevice.which);
+		break;
+	case SDL_CONTROLLERDEVICEREMOVED:
+		/* Only one gamepad is used, reopen any other connected. */
+		input_quit(input);
+		for (int32_t i = 0; i < SDL_NumJoysticks(); i += 1) {
+			open_controller(input, i);
+		}
+		break;
+	}
+
+	return false;
+}
+
+static bool queue_key(
+	event_queue_t *queue, int8_t key, bool is_pressed, uint32_t timestamp
+) {
+	if (key == INPUT_NO_KEY) {
+		return false;
+	}
+
+	/* Event timestamps are the lower 32 bits of SDL_GetTicks64. */
+	const uint64_t now = SDL_GetTicks64();
+	const input_event_t event = {
+		.timestamp = now - (uint32_t)((uint32_t)now - timestamp),
+		.key = key,
+		.is_pressed = is_pressed,
+	};
+
+	if (!event_queue_push(queue, event)) {
+		log_warn("Input queue is full, key %X event dropped!", key);
+		return false;
+	}
+
+	return true;
+}
+
+static void open_controller(input_t *input, int32_t index) {
+	if (input->controller != NULL || !SDL_IsGameController(index)) {
+		return;
+	}
+
+	input->controller = SDL_GameControllerOpen(index);
+	if (input->controller == NULL) {
+		log_error("Unable to open gamepad: %s", SDL_GetError());
+		return;
 	}
+
+	log_info("Gamepad opened: %s", SDL_GameControllerName(input->controller));
 }
@@ -0,0 +1,466 @@
+#include "lanes.h"
+
+#include "quirks.h"
+#include "utils.h"
+
+#include <string.h>
+
+#define NO_LANE			 LANES_COUNT
+#define LONG_LOAD_OPCODE 0xF000 /* XO-CHIP 4 bytes long instruction. */
+
+typedef int8_t lanes_mask_t __attribute__((vector_size(LANES_COUNT)));
+typedef uint64_t lanes_halves_t __attribute__((vector_size(LANES_COUNT)));
+typedef uint8_t registers_t __attribute__((vector_size(V_REGISTERS_COUNT)));
+typedef int8_t registers_mask_t __attribute__((vector_size(V_REGISTERS_COUNT)));
+
+/* Lanes at the same address, running the same instructions until they branch apart. */
+typedef struct {
+	uint32_t lanes; /* Bit of each lane. */
+	lanes_mask_t mask;
+	const uint8_t *memories[LANES_COUNT]; /* Memory of each lane, to compare opcodes. */
+	uint8_t count;
+	uint16_t pc;
+	uint16_t written; /* Bit of each register written by the instructions. */
+	quirks_t quirks;
+	bool is_trapping;
+} group_t;
+
+static void start_tick(lanes_t *lanes);
+static void end_tick(lanes_t *lanes);
+static bool can_run(const lanes_t *lanes, uint8_t lane);
+static uint8_t find_leader(const lanes_t *lanes);
+static void find_group(
+	const lanes_t *lanes, const cpu_t *first, uint16_t opcode, group_t *group
+);
+/* Copy the registers changed by the cpu of each lane to the vectors. */
+static void load_registers(lanes_t *lanes, uint32_t bits);
+/* Copy the registers changed by vector operations to the cpu. */
+static void store_registers(lanes_t *lanes, uint8_t lane);
+
+/* Return true if the instruction is done by vector operations. */
+static bool is_vector(uint16_t opcode);
+static uint16_t written_registers(uint16_t opcode); /* Bit of each register. */
+/* Return true if the word at address is opcode in the memory of every lane. */
+static bool is_shared(const group_t *group, uint16_t address, uint16_t opcode);
+
+/* Run the instructions of the group by vector operations, until they are not vector
+ * instructions, the lanes branch apart or a lane ends its tick.
+ */
+static void execute_vector(lanes_t *lanes, group_t *group, uint16_t opcode);
+/* Return false if the lanes branched apart, their PC are set then. */
+static bool execute_instruction(lanes_t *lanes, group_t *group, uint16_t opcode);
+static bool execute_skip(lanes_t *lanes, group_t *group, lanes_mask_t condition);
+/* Run the instructions of the lane by its cpu, up to the next vector instruction. */
+static void execute_scalar(lanes_t *lanes, uint8_t lane);
+
+/* Write value in the lanes of the mask, the others keep their value. */
+static inline void set_masked(
+	lanes_vector_t *reg, lanes_mask_t mask, lanes_vector_t value
+) {
+	*reg = (*reg & ~(lanes_vector_t)mask) | (value & (lanes_vector_t)mask);
+}
+
+static inline lanes_vector_t splat(uint8_t value) {
+	return (lanes_vector_t){ 0 } + value;
+}
+
+static inline bool is_zero(lanes_mask_t mask) {
+	const lanes_halves_t halves = (lanes_halves_t)mask;
+	return (halves[0] | halves[1]) == 0;
+}
+
+static inline uint16_t read_opcode(const uint8_t *memory, uint16_t address) {
+	return memory[address] << 8 | memory[address + 1]; /* Mirrored. */
+}
+
+int8_t lanes_step_tick(lanes_t *lanes) {
+	start_tick(lanes);
+
+	while (lanes->running != 0) {
+		/* Lanes behind the others run first, so lanes that diverged meet again. */
+		const uint8_t leader = find_leader(lanes);
+		const cpu_t *first = lanes->cpus[leader];
+
+		if (first->bounds == BOUNDS_TRAP && first->PC > RAM_SIZE - 2) {
+			execute_scalar(lanes, leader); /* The error is reported by the cpu. */
+			continue;
+		}
+
+		const uint16_t pc = first->PC;
+		const uint16_t opcode = read_opcode(first->memory, pc);
+		if (!is_vector(opcode)) {
+			for (uint32_t bits = lanes->running; bits != 0; bits &= bits - 1) {
+				const uint8_t lane = __builtin_ctz(bits);
+
+				if (lanes->cpus[lane]->PC == pc) {
+					execute_scalar(lanes, lane);
+				}
+			}
+			continue;
+		}
+
+		group_t group;
+		find_group(lanes, first, opcode, &group);
+		execute_vector(lanes, &group, opcode);
+	}
+
+	end_tick(lanes);
+
+	for (uint8_t lane = 0; lane < lanes->count; lane += 1) {
+		if (lanes->has_failed[lane]) {
+			return STATUS_ERROR;
+		}
+	}
+	return STATUS_OK;
+}
+
+static void start_tick(lanes_t *lanes) {
+	lanes->running = 0;
+	lanes->in_cpu = 0;
+
+	for (uint8_t lane = 0; lane < lanes->count; lane += 1) {
+		const cpu_t *cpu = lanes->cpus[lane];
+
+		lanes->budgets[lane] = cpu_start_tick(lanes->cpus[lane]);
+		lanes->done[lane] = 0;
+		lanes->has_failed[lane] = false;
+
+		for (uint8_t reg = 0; reg < V_REGISTERS_COUNT; reg += 1) {
+			lanes->V[reg][lane] = cpu->V[reg];
+		}
+		lanes->dirty[lane] = 0;
+
+		if (can_run(lanes, lane)) {
+			lanes->running |= 1u << lane;
+		}
+	}
+}
+
+static void end_tick(lanes_t *lanes) {
+	for (uint8_t lane = 0; lane < lanes->count; lane += 1) {
+		store_registers(lanes, lane);
+
+		/* Like cpu_step_tick, which returns at the error. */
+		if (!lanes->has_failed[lane]) {
+			cpu_end_tick(lanes->cpus[lane]);
+		}
+	}
+}
+
+static bool can_run(const lanes_t *lanes, uint8_t lane) {
+	const cpu_t *cpu = lanes->cpus[lane];
+
+	return lanes->done[lane] < lanes->budgets[lane] && !lanes->has_failed[lane]
+		&& !cpu->has_exited && !cpu->is_idle && !cpu->is_halted;
+}
+
+static uint8_t find_leader(const lanes_t *lanes) {
+	uint8_t leader = NO_LANE;
+
+	for (uint32_t bits = lanes->running; bits != 0; bits &= bits - 1) {
+		const uint8_t lane = __builtin_ctz(bits);
+
+		if (leader == NO_LANE || lanes->cpus[lane]->PC < lanes->cpus[leader]->PC) {
+			leader = lane;
+		}
+	}
+
+	return leader;
+}
+
+static void find_group(
+	const lanes_t *lanes, const cpu_t *first, uint16_t opcode, group_t *group
+) {
+	*group = (group_t){
+		.pc = first->PC,
+		.quirks = quirks_of(first->profile),
+		.is_trapping = first->bounds == BOUNDS_TRAP,
+	};
+
+	/* Memory can differ between lanes, the instruction must be the same. */
+	for (uint32_t bits = lanes->running; bits != 0; bits &= bits - 1) {
+		const uint8_t lane = __builtin_ctz(bits);
+		const cpu_t *cpu = lanes->cpus[lane];
+
+		if (cpu->PC == first->PC && cpu->profile == first->profile
+			&& cpu->bounds == first->bounds
+			&& read_opcode(cpu->memory, cpu->PC) == opcode) {
+			group->lanes |= 1u << lane;
+			group->mask[lane] = -1;
+			group->memories[group->count] = cpu->memory;
+			group->count += 1;
+		}
+	}
+}
+
+static void load_registers(lanes_t *lanes, uint32_t bits) {
+	lanes->in_cpu &= ~bits;
+
+	for (; bits != 0; bits &= bits - 1) {
+		const uint8_t lane = __builtin_ctz(bits);
+		const cpu_t *cpu = lanes->cpus[lane];
+		registers_t current;
+		registers_t saved;
+
+		/* Most instructions done by the cpu do not write the registers. */
+		memcpy(&current, cpu->V, sizeof(current));
+		memcpy(&saved, lanes->saved[lane], sizeof(saved));
+		const registers_mask_t changed = (registers_mask_t)(current != saved);
+		if (is_zero((lanes_mask_t)changed)) {
+			continue;
+		}
+
+		for (uint8_t reg = 0; reg < V_REGISTERS_COUNT; reg += 1) {
+			if (changed[reg] != 0) {
+				lanes->V[reg][lane] = cpu->V[reg];
+			}
+		}
+	}
+}
+
+static void store_registers(lanes_t *lanes, uint8_t lane) {
+	cpu_t *cpu = lanes->cpus[lane];
+
+	for (uint32_t regs = lanes->dirty[lane]; regs != 0; regs &= regs - 1) {
+		const uint8_t reg = __builtin_ctz(regs);
+
+		cpu->V[reg] = lanes->V[reg][lane];
+	}
+	lanes->dirty[lane] = 0;
+}
+
+static bool is_vector(uint16_t opcode) {
+	switch (opcode >> 12) {
+	case 0x1: /* JMP */
+	case 0x3: /* SE */
+	case 0x4: /* SNE */
+	case 0x6: /* LDIMM */
+	case 0x7: /* ADDIMM */
+	case 0xA: /* LDI */
+		return true;
+	case 0x5: /* SEREG */
+	case 0x9: /* SNEREG */
+		return (opcode & 0xF) == 0;
+	case 0x8: /* LDV to SUBN, SHL */
+		return (opcode & 0xF) <= 0x7 || (opcode & 0xF) == 0xE;
+	default:
+		return false;
+	}
+}
+
+static uint16_t written_registers(uint16_t opcode) {
+	const uint8_t x = (opcode >> 8) & 0xF;
+
+	switch (opcode >> 12) {
+	case 0x6: /* LDIMM */
+	case 0x7: /* ADDIMM */
+		return 1u << x;
+	case 0x8: /* VF is only kept by LDV, or by logic without vf_reset. */
+		return 1u << x | 1u << 0xF;
+	default:
+		return 0;
+	}
+}
+
+static bool is_shared(const group_t *group, uint16_t address, uint16_t opcode) {
+	for (uint8_t i = 1; i < group->count; i += 1) {
+		if (read_opcode(group->memories[i], address) != opcode) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void execute_vector(lanes_t *lanes, group_t *group, uint16_t opcode) {
+	uint32_t steps = UINT32_MAX; /* Cycles left to the lane ending its tick first. */
+	uint32_t count = 0;
+	bool is_together = true;
+	uint16_t last;
+
+	for (uint32_t bits = group->lanes; bits != 0; bits &= bits - 1) {
+		const uint8_t lane = __builtin_ctz(bits);
+		const uint32_t left = lanes->budgets[lane] - lanes->done[lane];
+
+		steps = left < steps ? left : steps;
+	}
+
+	do {
+		/* Jumps and LDI are done without the registers. */
+		if ((lanes->in_cpu & group->lanes) != 0 && opcode >> 12 != 0x1
+			&& opcode >> 12 != 0xA) {
+			load_registers(lanes, lanes->in_cpu & group->lanes);
+		}
+
+		last = opcode;
+		group->written |= written_registers(opcode);
+		is_together = execute_instruction(lanes, group, opcode);
+		count += 1;
+		if (!is_together || count == steps) {
+			break;
+		}
+		if (group->is_trapping && group->pc > RAM_SIZE - 2) {
+			break; /* The error is reported by the cpu. */
+		}
+
+		opcode = read_opcode(group->memories[0], group->pc);
+	} while (is_vector(opcode) && is_shared(group, group->pc, opcode));
+
+	for (uint32_t bits = group->lanes; bits != 0; bits &= bits - 1) {
+		const uint8_t lane = __builtin_ctz(bits);
+		cpu_t *cpu = lanes->cpus[lane];
+
+		if (is_together) {
+			cpu->PC = group->pc;
+		}
+		cpu->opcode = last;
+		cpu->instructions += count;
+		lanes->dirty[lane] |= group->written;
+		lanes->done[lane] += count;
+		if (lanes->done[lane] >= lanes->budgets[lane]) {
+			lanes->running &= ~(1u << lane);
+		}
+	}
+	lanes->vector_instructions += count * group->count;
+}
+
+static bool execute_instruction(lanes_t *lanes, group_t *group, uint16_t opcode) {
+	const uint8_t x = (opcode >> 8) & 0xF;
+	const uint8_t y = (opcode >> 4) & 0xF;
+	const uint8_t byte = opcode & 0xFF;
+	const uint16_t address = opcode & 0xFFF;
+	const lanes_mask_t mask = group->mask;
+	const quirks_t quirks = group->quirks;
+	lanes_vector_t *V = lanes->V;
+	const lanes_vector_t vx = V[x];
+	const lanes_vector_t vy = V[y];
+	const lanes_vector_t one = splat(1);
+
+	switch (opcode >> 12) {
+	case 0x1: /* JMP */
+		group->pc = address;
+		return true;
+	case 0x3: /* SE */
+		return execute_skip(lanes, group, (lanes_mask_t)(vx == splat(byte)));
+	case 0x4: /* SNE */
+		return execute_skip(lanes, group, (lanes_mask_t)(vx != splat(byte)));
+	case 0x5: /* SEREG */
+		return execute_skip(lanes, group, (lanes_mask_t)(vx == vy));
+	case 0x9: /* SNEREG */
+		return execute_skip(lanes, group, (lanes_mask_t)(vx != vy));
+	case 0x6: /* LDIMM */
+		set_masked(&V[x], mask, splat(byte));
+		break;
+	case 0x7: /* ADDIMM */
+		set_masked(&V[x], mask, vx + byte);
+		break;
+	case 0x8:
+		/* Like the handlers, VF is written first by ADD and SUB, and last by shifts. */
+		switch (opcode & 0xF) {
+		case 0x0: /* LDV */
+			set_masked(&V[x], mask, vy);
+			break;
+		case 0x1: /* OR */
+			set_masked(&V[x], mask, vx | vy);
+			break;
+		case 0x2: /* AND */
+			set_masked(&V[x], mask, vx & vy);
+			break;
+		case 0x3: /* XOR */
+			set_masked(&V[x], mask, vx ^ vy);
+			break;
+		case 0x4: /* ADD */
+			set_masked(&V[0xF], mask, (lanes_vector_t)((vx + vy) < vx) & one);
+			set_masked(&V[x], mask, V[x] + vy);
+			break;
+		case 0x5: /* SUB */
+			set_masked(&V[0xF], mask, (lanes_vector_t)(vx > vy) & one);
+			set_masked(&V[x], mask, V[x] - vy);
+			break;
+		case 0x7: /* SUBN */
+			set_masked(&V[0xF], mask, (lanes_vector_t)(vy > vx) & one);
+			set_masked(&V[x], mask, vy - V[x]);
+			break;
+		case 0x6: /* SHR */
+			set_masked(&V[x], mask, (quirks.shift_vy ? vy : vx) >> 1);
+			set_masked(&V[0xF], mask, (quirks.shift_vy ? vy : vx) & one);
+			break;
+		case 0xE: /* SHL */
+			set_masked(&V[x], mask, (quirks.shift_vy ? vy : vx) << 1);
+			set_masked(&V[0xF], mask, (quirks.shift_vy ? vy : vx) >> 7);
+			break;
+		}
+
+		/* COSMAC VIP logic instructions set VF to 0. */
+		if (quirks.vf_reset && (opcode & 0xF) >= 0x1 && (opcode & 0xF) <= 0x3) {
+			set_masked(&V[0xF], mask, splat(0));
+		}
+		break;
+	case 0xA: /* LDI */
+		for (uint32_t bits = group->lanes; bits != 0; bits &= bits - 1) {
+			lanes->cpus[__builtin_ctz(bits)]->I = address;
+		}
+		break;
+	}
+
+	group->pc += 2;
+	return true;
+}
+
+static bool execute_skip(lanes_t *lanes, group_t *group, lanes_mask_t condition) {
+	const lanes_mask_t taken = condition & group->mask;
+	const uint16_t next = read_opcode(group->memories[0], group->pc + 2);
+	/* XO-CHIP skips the whole long instruction. */
+	const uint16_t length
+		= group->quirks.long_skip && next == LONG_LOAD_OPCODE ? 6 : 4;
+
+	if (!group->quirks.long_skip || is_shared(group, group->pc + 2, next)) {
+		if (is_zero(taken)) {
+			group->pc += 2;
+			return true;
+		}
+		if (is_zero(taken ^ group->mask)) {
+			group->pc += length;
+			return true;
+		}
+	}
+
+	for (uint32_t bits = group->lanes; bits != 0; bits &= bits - 1) {
+		const uint8_t lane = __builtin_ctz(bits);
+		cpu_t *cpu = lanes->cpus[lane];
+
+		if (condition[lane] == 0) {
+			cpu->PC = group->pc + 2;
+		} else if (group->quirks.long_skip
+				   && read_opcode(cpu->memory, group->pc + 2) == LONG_LOAD_OPCODE) {
+			cpu->PC = group->pc + 6;
+		} else {
+			cpu->PC = group->pc + 4;
+		}
+	}
+
+	return false;
+}
+
+static void execute_scalar(lanes_t *lanes, uint8_t lane) {
+	cpu_t *cpu = lanes->cpus[lane];
+	const uint64_t instructions = cpu->instructions;
+	const uint32_t done = lanes->done[lane];
+
+	if (((lanes->in_cpu >> lane) & 1) == 0) {
+		store_registers(lanes, lane);
+		memcpy(lanes->saved[lane], cpu->V, V_REGISTERS_COUNT);
+		lanes->in_cpu |= 1u << lane;
+	}
+
+	/* Idle delay loops do no cycle, they end the tick of the lane. */
+	do {
+		lanes->has_failed[lane] = cpu_step(cpu) != STATUS_OK;
+		lanes->done[lane] = done + (cpu->instructions - instructions);
+	} while (can_run(lanes, lane) && !is_vector(read_opcode(cpu->memory, cpu->PC)));
+
+	lanes->scalar_instructions += cpu->instructions - instructions;
+	if (!can_run(lanes, lane)) {
+		lanes->running &= ~(1u << lane);
+	}
+}
@@ -0,0 +1,58 @@
+#include "latency.h"
+
+#include <stdio.h>
+
+#define BAR_WIDTH 40 /* Characters of the largest bucket bar. */
+
+void latency_add(latency_t *latency, uint32_t time) {
+	const uint32_t bucket = time / LATENCY_BUCKET_SIZE;
+
+	latency->buckets[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1] += 1;
+	latency->count += 1;
+	latency->total += time;
+	if (time > latency->slowest) {
+		latency->slowest = time;
+	}
+}
+
+void latency_report(const latency_t *latency) {
+	uint8_t first = LATENCY_BUCKETS;
+	uint8_t last = 0;
+	uint32_t largest = 0;
+
+	if (latency->count == 0) {
+		return;
+	}
+
+	/* Only the range of buckets with samples is shown. */
+	for (uint8_t i = 0; i < LATENCY_BUCKETS; i += 1) {
+		if (latency->buckets[i] == 0) {
+			continue;
+		}
+
+		first = i < first ? i : first;
+		last = i;
+		largest = latency->buckets[i] > largest ? latency->buckets[i] : largest;
+	}
+
+	printf(
+		"Input latency: %u samples, average %.1f ms, slowest %u ms\n", latency->count,
+		(double)latency->total / latency->count, latency->slowest
+	);
+	for (uint8_t i = first; i <= last; i += 1) {
+		const uint32_t bar = latency->buckets[i] * BAR_WIDTH / largest;
+
+		if (i == LATENCY_BUCKETS - 1) {
+			printf("%3u+    ms |", i * LATENCY_BUCKET_SIZE);
+		} else {
+			printf(
+				"%3u-%3u ms |", i * LATENCY_BUCKET_SIZE,
+				(i + 1) * LATENCY_BUCKET_SIZE - 1
+			);
+		}
+		for (uint32_t j = 0; j < bar; j += 1) {
+			putchar('#');
+		}
+		printf(" %u\n", latency->buckets[i]);
+	}
+}
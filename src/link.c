@@ -0,0 +1,309 @@
+#include "link.h"
+
+#include "log.h"
+#include "utils.h"
+
+#include <SDL_timer.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define NO_SOCKET	 -1
+#define HISTORY_MASK (LINK_HISTORY - 1)
+
+/* Packets hold a magic byte, the newest frame, the first frame whose remote keys are
+ * missing, and the local keys of the frames before the newest one, newest first.
+ * Every frame is sent again by the next ones, and when packets were lost, the keys
+ * are sent from the first frame the peer misses, so the session goes on.
+ */
+#define PACKET_MAGIC 0xC8
+#define PACKET_SIZE	 (1 + 4 + 4 + LINK_MAX_ROLLBACK * 2)
+
+static void read_key_events(link_t *link, cpu_t *cpu, event_queue_t *events);
+static int8_t receive_keys(link_t *link, cpu_t *cpu);
+static void receive_packet(link_t *link, const uint8_t *packet, uint32_t *mismatch);
+static void send_keys(link_t *link);
+static uint32_t read_frame(const uint8_t *bytes);
+static void write_frame(uint8_t *bytes, uint32_t frame);
+
+static int8_t run_frame(link_t *link, cpu_t *cpu);
+static int8_t rollback(link_t *link, cpu_t *cpu, uint32_t frame);
+static uint64_t frame_time(const link_t *link, uint32_t frame); /* In milliseconds. */
+
+int8_t link_init(link_t *link, const char *address) {
+	uint16_t port = 0;
+	uint16_t peer_port = 0;
+
+	*link = (link_t){ .socket = NO_SOCKET };
+
+	if (sscanf(address, "%hu:%hu", &port, &peer_port) != 2) {
+		log_error("Invalid link address, expected <port>:<peer port>: %s", address);
+		return STATUS_ERROR;
+	}
+
+	link->snapshots = malloc(sizeof(cpu_t) * LINK_HISTORY);
+	if (link->snapshots == NULL) {
+		log_error("Unable to allocate link snapshots!");
+		return STATUS_ERROR;
+	}
+
+	/* Both players run on the same machine. */
+	const struct sockaddr_in local = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	link->peer = local;
+	link->peer.sin_port = htons(peer_port);
+
+	link->socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (link->socket == NO_SOCKET) {
+		log_error("Unable to create link socket: %s", strerror(errno));
+		return STATUS_ERROR;
+	}
+
+	if (bind(link->socket, (const struct sockaddr *)&local, sizeof(local)) != 0
+		|| fcntl(link->socket, F_SETFL, O_NONBLOCK) != 0) {
+		log_error("Unable to bind link port %u: %s", port, strerror(errno));
+		close(link->socket);
+		link->socket = NO_SOCKET;
+		return STATUS_ERROR;
+	}
+
+	log_info("Linked at port %u with port %u", port, peer_port);
+	return STATUS_OK;
+}
+
+void link_quit(link_t *link) {
+	if (link->socket != NO_SOCKET) {
+		close(link->socket);
+		link->socket = NO_SOCKET;
+
+		log_info(
+			"Link ran %u frames with %u rollbacks of %u frames, slowest took %u us.",
+			link->frame, link->rollbacks, link->rollback_frames, link->slowest_rollback
+		);
+	}
+
+	free(link->snapshots);
+	link->snapshots = NULL;
+}
+
+int8_t link_update(link_t *link, cpu_t *cpu, event_queue_t *events) {
+	const uint64_t now = SDL_GetTicks64();
+
+	link->has_run_frame = false;
+	read_key_events(link, cpu, events);
+	if (receive_keys(link, cpu) != STATUS_OK) {
+		return STATUS_ERROR;
+	}
+
+	if (link->start_time == 0) {
+		link->start_time = now;
+	}
+
+	/* Wait for the remote player, and start counting frame times again after. */
+	if (link->frame >= link->remote_frame + LINK_MAX_ROLLBACK) {
+		link->is_stalled = true;
+		send_keys(link); /* The last packets may have been lost. */
+		return STATUS_OK;
+	}
+	if (link->is_stalled) {
+		link->is_stalled = false;
+		link->start_time = now - (uint64_t)link->frame * 1000 / TIMER_CLOCK_SPEED;
+	}
+
+	if (now < frame_time(link, link->frame)) {
+		return STATUS_OK;
+	}
+
+	link->local_keys[link->frame & HISTORY_MASK] = link->keys | link->pressed;
+	link->pressed = 0;
+
+	const int8_t status = run_frame(link, cpu);
+	link->has_run_frame = true;
+	send_keys(link);
+	return status;
+}
+
+uint32_t link_next_delay(const link_t *link) {
+	const uint64_t now = SDL_GetTicks64();
+	const uint64_t next_time = frame_time(link, link->frame);
+
+	if (link->is_stalled) {
+		return 1; /* Check received keys again soon. */
+	}
+
+	return next_time > now ? next_time - now : 0;
+}
+
+static void read_key_events(link_t *link, cpu_t *cpu, event_queue_t *events) {
+	const input_event_t *event = NULL;
+
+	while ((event = event_queue_peek(events)) != NULL) {
+		const uint16_t key = 1 << event->key;
+
+		if (event->is_pressed) {
+			link->keys |= key;
+			link->pressed |= key;
+			if (cpu->input_time == 0) {
+				cpu->input_time = event->timestamp; /* Measured until it is presented. */
+			}
+		} else {
+			link->keys &= ~key;
+		}
+
+		event_queue_pop(events);
+	}
+}
+
+static int8_t receive_keys(link_t *link, cpu_t *cpu) {
+	uint8_t packet[PACKET_SIZE];
+	uint32_t mismatch = link->frame; /* First frame run with a wrong prediction. */
+	ssize_t size = 0;
+
+	while ((size = recv(link->socket, packet, sizeof(packet), 0)) >= 0) {
+		if (size == PACKET_SIZE && packet[0] == PACKET_MAGIC) {
+			receive_packet(link, packet, &mismatch);
+		}
+	}
+
+	if (mismatch < link->frame) {
+		return rollback(link, cpu, mismatch);
+	}
+
+	return STATUS_OK;
+}
+
+static void receive_packet(link_t *link, const uint8_t *packet, uint32_t *mismatch) {
+	const uint32_t newest = read_frame(packet + 1);
+	const uint32_t peer_frame = read_frame(packet + 5);
+
+	if (peer_frame > link->peer_frame) {
+		link->peer_frame = peer_frame;
+	}
+
+	/* Packets received late, or after a gap of lost packets, are skipped. */
+	if (newest < link->remote_frame || newest >= link->remote_frame + LINK_MAX_ROLLBACK) {
+		return;
+	}
+
+	for (uint32_t frame = link->remote_frame; frame <= newest; frame += 1) {
+		const uint8_t *keys = packet + 9 + (newest - frame) * 2;
+		const uint16_t remote_keys = keys[0] | keys[1] << 8;
+		uint16_t *predicted = &link->remote_keys[frame & HISTORY_MASK];
+
+		if (frame < link->frame && *predicted != remote_keys && frame < *mismatch) {
+			*mismatch = frame;
+		}
+		*predicted = remote_keys;
+	}
+
+	link->remote_frame = newest + 1;
+}
+
+static void send_keys(link_t *link) {
+	uint8_t packet[PACKET_SIZE] = { PACKET_MAGIC };
+
+	if (link->frame == 0) {
+		return; /* Nothing has been run yet. */
+	}
+
+	/* The peer skips the frames after a gap, so start from the first one it misses. */
+	const uint32_t newest = link->frame - 1 < link->peer_frame + LINK_MAX_ROLLBACK - 1
+							  ? link->frame - 1
+							  : link->peer_frame + LINK_MAX_ROLLBACK - 1;
+	write_frame(packet + 1, newest);
+	write_frame(packet + 5, link->remote_frame);
+
+	for (uint32_t age = 0; age < LINK_MAX_ROLLBACK && age <= newest; age += 1) {
+		const uint16_t keys = link->local_keys[(newest - age) & HISTORY_MASK];
+
+		packet[9 + age * 2] = keys & 0xFF;
+		packet[10 + age * 2] = keys >> 8;
+	}
+
+	/* Nothing to do if the peer is not running yet, the packet is sent again. */
+	sendto(
+		link->socket, packet, sizeof(packet), 0, (const struct sockaddr *)&link->peer,
+		sizeof(link->peer)
+	);
+}
+
+static uint32_t read_frame(const uint8_t *bytes) {
+	return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static void write_frame(uint8_t *bytes, uint32_t frame) {
+	bytes[0] = frame & 0xFF;
+	bytes[1] = (frame >> 8) & 0xFF;
+	bytes[2] = (frame >> 16) & 0xFF;
+	bytes[3] = frame >> 24;
+}
+
+static int8_t run_frame(link_t *link, cpu_t *cpu) {
+	const uint32_t index = link->frame & HISTORY_MASK;
+	const uint32_t previous = (link->frame - 1) & HISTORY_MASK;
+
+	/* Remote keys not received yet are predicted to be the last received ones. */
+	if (link->frame >= link->remote_frame) {
+		link->remote_keys[index] = link->remote_frame > 0
+									 ? link->remote_keys[(link->remote_frame - 1)
+														 & HISTORY_MASK]
+									 : 0;
+	}
+
+	const uint16_t keys = link->local_keys[index] | link->remote_keys[index];
+	const uint16_t previous_keys = link->frame > 0 ? link->local_keys[previous]
+														 | link->remote_keys[previous]
+												   : 0;
+
+	cpu_snapshot(&link->snapshots[index], cpu);
+	for (uint8_t key = 0; key < KEYS_COUNT; key += 1) {
+		cpu->key_state[key] = (keys >> key) & 1;
+	}
+	if (keys != previous_keys) {
+		cpu->is_halted = false; /* Let 0xFx0A check the keys again. */
+	}
+
+	link->frame += 1;
+	return cpu_step_tick(cpu, NULL);
+}
+
+static int8_t rollback(link_t *link, cpu_t *cpu, uint32_t frame) {
+	const uint64_t start = SDL_GetPerformanceCounter();
+	const uint32_t last = link->frame;
+	const bool is_muted = cpu->is_muted;
+
+	cpu_restore(cpu, &link->snapshots[frame & HISTORY_MASK]);
+	link->frame = frame;
+
+	/* The sound of the frames run again has been played already. */
+	cpu->is_muted = true;
+	while (link->frame < last) {
+		if (run_frame(link, cpu) != STATUS_OK) {
+			cpu->is_muted = is_muted;
+			return STATUS_ERROR;
+		}
+	}
+	cpu->is_muted = is_muted;
+
+	const uint32_t time = (SDL_GetPerformanceCounter() - start) * 1000000
+						/ SDL_GetPerformanceFrequency();
+	link->rollbacks += 1;
+	link->rollback_frames += last - frame;
+	if (time > link->slowest_rollback) {
+		link->slowest_rollback = time;
+	}
+
+	return STATUS_OK;
+}
+
+static uint64_t frame_time(const link_t *link, uint32_t frame) {
+	return link->start_time + (uint64_t)frame * 1000 / TIMER_CLOCK_SPEED;
+}
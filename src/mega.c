@@ -0,0 +1,98 @@
+#include "mega.h"
+
+#include <string.h>
+
+#define DEFAULT_SPRITE_SIZE 8
+
+void mega_reset(mega_t *mega) {
+	memset(mega->palette, 0, sizeof(mega->palette));
+	mega->palette[0] = 0xFF000000; /* Opaque black background. */
+	mega->has_palette_changed = true;
+
+	mega->sprite_width = DEFAULT_SPRITE_SIZE;
+	mega->sprite_height = DEFAULT_SPRITE_SIZE;
+	mega->alpha = 0xFF;
+	mega->blend_mode = 0;
+	mega->collision_color = 0;
+
+	mega_clear(mega);
+}
+
+void mega_clear(mega_t *mega) {
+	memset(mega->gfx, 0, sizeof(mega->gfx));
+	mega_mark_dirty(mega, 0, 0, MEGA_WIDTH, MEGA_HEIGHT);
+}
+
+bool mega_blit_row(
+	uint8_t *restrict dst, const uint8_t *restrict src, uint16_t count, uint8_t collision
+) {
+	uint8_t hit = 0;
+
+	/* Branchless select, so the compiler can vectorize the loop. */
+	for (uint16_t i = 0; i < count; i += 1) {
+		const uint8_t opaque = -(uint8_t)(src[i] != 0);
+
+		hit |= opaque & -(uint8_t)(dst[i] == collision);
+		dst[i] = (src[i] & opaque) | (dst[i] & ~opaque);
+	}
+
+	return hit != 0;
+}
+
+void mega_mark_dirty(mega_t *mega, uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+	const uint16_t right = x + width < MEGA_WIDTH ? x + width : MEGA_WIDTH;
+	const uint16_t bottom = y + height < MEGA_HEIGHT ? y + height : MEGA_HEIGHT;
+	mega_rect_t *dirty = &mega->dirty;
+
+	if (x >= right || y >= bottom) {
+		return;
+	}
+
+	if (dirty->right == 0) {
+		*dirty = (mega_rect_t){x, y, right, bottom};
+		return;
+	}
+
+	dirty->left = x < dirty->left ? x : dirty->left;
+	dirty->top = y < dirty->top ? y : dirty->top;
+	dirty->right = right > dirty->right ? right : dirty->right;
+	dirty->bottom = bottom > dirty->bottom ? bottom : dirty->bottom;
+}
+
+void mega_scroll_down(mega_t *mega, uint8_t amount) {
+	if (amount >= MEGA_HEIGHT) {
+		mega_clear(mega);
+		return;
+	}
+
+	memmove(mega->gfx[amount], mega->gfx[0], (MEGA_HEIGHT - amount) * MEGA_WIDTH);
+	memset(mega->gfx[0], 0, amount * MEGA_WIDTH);
+	mega_mark_dirty(mega, 0, 0, MEGA_WIDTH, MEGA_HEIGHT);
+}
+
+void mega_scroll_up(mega_t *mega, uint8_t amount) {
+	if (amount >= MEGA_HEIGHT) {
+		mega_clear(mega);
+		return;
+	}
+
+	memmove(mega->gfx[0], mega->gfx[amount], (MEGA_HEIGHT - amount) * MEGA_WIDTH);
+	memset(mega->gfx[MEGA_HEIGHT - amount], 0, amount * MEGA_WIDTH);
+	mega_mark_dirty(mega, 0, 0, MEGA_WIDTH, MEGA_HEIGHT);
+}
+
+void mega_scroll_right(mega_t *mega, uint8_t amount) {
+	for (uint16_t y = 0; y < MEGA_HEIGHT; y += 1) {
+		memmove(&mega->gfx[y][amount], mega->gfx[y], MEGA_WIDTH - amount);
+		memset(mega->gfx[y], 0, amount);
+	}
+	mega_mark_dirty(mega, 0, 0, MEGA_WIDTH, MEGA_HEIGHT);
+}
+
+void mega_scroll_left(mega_t *mega, uint8_t amount) {
+	for (uint16_t y = 0; y < MEGA_HEIGHT; y += 1) {
+		memmove(mega->gfx[y], &mega->gfx[y][amount], MEGA_WIDTH - amount);
+		memset(&mega->gfx[y][MEGA_WIDTH - amount], 0, amount);
+	}
+	mega_mark_dirty(mega, 0, 0, MEGA_WIDTH, MEGA_HEIGHT);
+}
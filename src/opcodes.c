@@ -1,126 +1,586 @@
 #include "opcodes.h"
 
 #include "cpu.h"
+#include "debug.h"
 #include "log.h"
 #include "utils.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #define NEXT_PC cpu->PC + 2 /* Go to next instruction. */
-#define SKIP_PC cpu->PC + 4 /* Skip next instruction. */
+#define SKIP_PC skip_pc(cpu, quirks) /* Skip next instruction. */
 
-/* Set true if error occurried. */
-static bool has_error = false;
+#define LONG_LOAD_OPCODE 0xF000 /* XO-CHIP 4 bytes long instruction. */
 
+#define SCROLL_AMOUNT 4 /* Pixels scrolled by 0x00FB and 0x00FC. */
+#define BIG_SPRITE_SIZE 16 /* Dxy0 draws 16x16 sprites. */
+
+#define FUSED_MAX_LENGTH 3 /* Longest sequence of fused instructions. */
+
+/* Values of cpu->decoded, opcodes table indices are stored plus one.
+ * The breakpoint bit is kept when the instruction is decoded again.
+ */
+#define DECODED_NONE  0
+#define DECODED_FUSED (MAX_OPCODES + 1) /* First fused sequence. */
+#define DECODED_BREAK 0x80
+
+/* Set true if error occurried. Each thread running cpus has its own. */
+static _Thread_local bool has_error = false;
+
+/* Sequences of instructions executed by a single handler. */
+typedef enum {
+	FUSED_LDI_DRAW,		/* Annn, Dxyn */
+	FUSED_LDIMM2,		/* 6xkk, 6ykk */
+	FUSED_LDIMM3,		/* 6xkk, 6ykk, 6zkk */
+	FUSED_DELAY_LOOP,	/* Fx07, 3x00, 1nnn */
+	FUSED_COUNTER_LOOP, /* 7xkk, 3xkk, 1nnn */
+	FUSED_SE_JMP,		/* 3xkk, 1nnn */
+	FUSED_SNE_JMP,		/* 4xkk, 1nnn */
+	FUSED_COUNT,
+} fused_kind_t;
+
+/* Fused handlers add the instructions done after the first one to cycles. */
+typedef uint16_t (*fused_handler_t)(cpu_t *cpu, uint32_t *cycles);
+
+typedef struct {
+	fused_handler_t handler;
+	uint8_t length; /* Instructions in the sequence. */
+} fused_t;
+
+static uint16_t opcode_MEGAOFF(cpu_t *cpu);	 /* 0x0010 */
+static uint16_t opcode_MEGAON(cpu_t *cpu);	 /* 0x0011 */
+static uint16_t opcode_LDHI(cpu_t *cpu);	 /* 0x01nn */
+static uint16_t opcode_LDPAL(cpu_t *cpu);	 /* 0x02nn */
+static uint16_t opcode_SPRW(cpu_t *cpu);	 /* 0x03nn */
+static uint16_t opcode_SPRH(cpu_t *cpu);	 /* 0x04nn */
+static uint16_t opcode_ALPHA(cpu_t *cpu);	 /* 0x05nn */
+static uint16_t opcode_DIGISND(cpu_t *cpu);	 /* 0x060n */
+static uint16_t opcode_STOPSND(cpu_t *cpu);	 /* 0x0700 */
+static uint16_t opcode_BMODE(cpu_t *cpu);	 /* 0x080n */
+static uint16_t opcode_CCOL(cpu_t *cpu);	 /* 0x09nn */
+static uint16_t opcode_SCUMEGA(cpu_t *cpu);	 /* 0x00Bn */
+static uint16_t opcode_SCD(cpu_t *cpu);		 /* 0x00Cn */
+static uint16_t opcode_SCU(cpu_t *cpu);		 /* 0x00Dn */
 static uint16_t opcode_CLS(cpu_t *cpu);		 /* 0x00E0 */
 static uint16_t opcode_RET(cpu_t *cpu);		 /* 0x00EE */
+static uint16_t opcode_SCR(cpu_t *cpu);		 /* 0x00FB */
+static uint16_t opcode_SCL(cpu_t *cpu);		 /* 0x00FC */
+static uint16_t opcode_EXIT(cpu_t *cpu);	 /* 0x00FD */
+static uint16_t opcode_LOW(cpu_t *cpu);		 /* 0x00FE */
+static uint16_t opcode_HIGH(cpu_t *cpu);	 /* 0x00FF */
 static uint16_t opcode_JMP(cpu_t *cpu);		 /* 0x1nnn */
 static uint16_t opcode_CALL(cpu_t *cpu);	 /* 0x2nnn */
-static uint16_t opcode_SE(cpu_t *cpu);		 /* 0x3xkk */
-static uint16_t opcode_SNE(cpu_t *cpu);		 /* 0x4xkk */
-static uint16_t opcode_SEREG(cpu_t *cpu);	 /* 0x5xy0 */
+static uint16_t opcode_STRANGE(cpu_t *cpu);	 /* 0x5xy2 */
+static uint16_t opcode_LDRANGE(cpu_t *cpu);	 /* 0x5xy3 */
 static uint16_t opcode_LDIMM(cpu_t *cpu);	 /* 0x6xkk */
 static uint16_t opcode_ADDIMM(cpu_t *cpu);	 /* 0x7xkk */
 static uint16_t opcode_LDV(cpu_t *cpu);		 /* 0x8xy0 */
-static uint16_t opcode_OR(cpu_t *cpu);		 /* 0x8xy1 */
-static uint16_t opcode_AND(cpu_t *cpu);		 /* 0x8xy2 */
-static uint16_t opcode_XOR(cpu_t *cpu);		 /* 0x8xy3 */
 static uint16_t opcode_ADD(cpu_t *cpu);		 /* 0x8xy4 */
 static uint16_t opcode_SUB(cpu_t *cpu);		 /* 0x8xy5 */
-static uint16_t opcode_SHR(cpu_t *cpu);		 /* 0x8xy6 */
 static uint16_t opcode_SUBN(cpu_t *cpu);	 /* 0x8xy7 */
-static uint16_t opcode_SHL(cpu_t *cpu);		 /* 0x8xyE */
-static uint16_t opcode_SNEREG(cpu_t *cpu);	 /* 0x9xy0 */
 static uint16_t opcode_LDI(cpu_t *cpu);		 /* 0xAnnn */
-static uint16_t opcode_JMPREG(cpu_t *cpu);	 /* 0xBnnn */
 static uint16_t opcode_RAND(cpu_t *cpu);	 /* 0xCxkk */
-static uint16_t opcode_DRAW(cpu_t *cpu);	 /* 0xDxyn */
-static uint16_t opcode_SKEY(cpu_t *cpu);	 /* 0xEx9E */
-static uint16_t opcode_SNKEY(cpu_t *cpu);	 /* 0xExA1 */
+static uint16_t opcode_LDILONG(cpu_t *cpu);	 /* 0xF000 */
+static uint16_t opcode_PLANE(cpu_t *cpu);	 /* 0xFn01 */
+static uint16_t opcode_LDAUDIO(cpu_t *cpu);	 /* 0xF002 */
 static uint16_t opcode_RDELAY(cpu_t *cpu);	 /* 0xFx07 */
 static uint16_t opcode_WAITKEY(cpu_t *cpu);	 /* 0xFx0A */
 static uint16_t opcode_WDELAY(cpu_t *cpu);	 /* 0xFx15 */
 static uint16_t opcode_WSOUND(cpu_t *cpu);	 /* 0xFx18 */
 static uint16_t opcode_ADDI(cpu_t *cpu);	 /* 0xFx1E */
 static uint16_t opcode_LDSPRITE(cpu_t *cpu); /* 0xFx29 */
+static uint16_t opcode_LDBIGSPRITE(cpu_t *cpu); /* 0xFx30 */
 static uint16_t opcode_STBCD(cpu_t *cpu);	 /* 0xFx33 */
-static uint16_t opcode_STREG(cpu_t *cpu);	 /* 0xFx55 */
-static uint16_t opcode_LDREG(cpu_t *cpu);	 /* 0xFx65 */
+static uint16_t opcode_PITCH(cpu_t *cpu);	 /* 0xFx3A */
+static uint16_t opcode_STFLAGS(cpu_t *cpu);	 /* 0xFx75 */
+static uint16_t opcode_LDFLAGS(cpu_t *cpu);	 /* 0xFx85 */
+
+/* Quirk dependent opcodes. They are specialized for each profile below. */
+static inline uint16_t opcode_SE(cpu_t *cpu, quirks_t quirks);		/* 0x3xkk */
+static inline uint16_t opcode_SNE(cpu_t *cpu, quirks_t quirks);		/* 0x4xkk */
+static inline uint16_t opcode_SEREG(cpu_t *cpu, quirks_t quirks);	/* 0x5xy0 */
+static inline uint16_t opcode_OR(cpu_t *cpu, quirks_t quirks);		/* 0x8xy1 */
+static inline uint16_t opcode_AND(cpu_t *cpu, quirks_t quirks);		/* 0x8xy2 */
+static inline uint16_t opcode_XOR(cpu_t *cpu, quirks_t quirks);		/* 0x8xy3 */
+static inline uint16_t opcode_SHR(cpu_t *cpu, quirks_t quirks);		/* 0x8xy6 */
+static inline uint16_t opcode_SHL(cpu_t *cpu, quirks_t quirks);		/* 0x8xyE */
+static inline uint16_t opcode_SNEREG(cpu_t *cpu, quirks_t quirks);	/* 0x9xy0 */
+static inline uint16_t opcode_JMPREG(cpu_t *cpu, quirks_t quirks);	/* 0xBnnn */
+static inline uint16_t opcode_DRAWBIG(cpu_t *cpu, quirks_t quirks); /* 0xDxy0 */
+static inline uint16_t opcode_DRAW(cpu_t *cpu, quirks_t quirks);	/* 0xDxyn */
+static inline uint16_t opcode_SKEY(cpu_t *cpu, quirks_t quirks);	/* 0xEx9E */
+static inline uint16_t opcode_SNKEY(cpu_t *cpu, quirks_t quirks);	/* 0xExA1 */
+static inline uint16_t opcode_STREG(cpu_t *cpu, quirks_t quirks);	/* 0xFx55 */
+static inline uint16_t opcode_LDREG(cpu_t *cpu, quirks_t quirks);	/* 0xFx65 */
+
+/* Fused sequences, the result is the same as executing each instruction. */
+static uint16_t fused_LDIMM2(cpu_t *cpu, uint32_t *cycles);
+static uint16_t fused_LDIMM3(cpu_t *cpu, uint32_t *cycles);
+static inline uint16_t fused_LDI_DRAW(cpu_t *cpu, quirks_t quirks, uint32_t *cycles);
+static inline uint16_t fused_DELAY_LOOP(cpu_t *cpu, quirks_t quirks, uint32_t *cycles);
+static inline uint16_t fused_COUNTER_LOOP(cpu_t *cpu, quirks_t quirks, uint32_t *cycles);
+static inline uint16_t fused_SE_JMP(cpu_t *cpu, quirks_t quirks, uint32_t *cycles);
+static inline uint16_t fused_SNE_JMP(cpu_t *cpu, quirks_t quirks, uint32_t *cycles);
+
+/* Set the pages written for cpu_clone. */
+static void mark_written(cpu_t *cpu, uint16_t address, uint32_t size);
+/* Return the DECODED_* value of the instruction at address, DECODED_NONE if unknown. */
+static uint8_t predecode(const cpu_t *cpu, uint16_t address);
+/* Return the opcodes table index of opcode plus one, DECODED_NONE if unknown. */
+static uint8_t find_opcode(profile_t profile, uint16_t opcode);
+/* Go to the next instruction of a fused sequence, like a cpu cycle does. */
+static inline void fetch_next(cpu_t *cpu, uint16_t pc, uint32_t *cycles);
+
+/* Return the address after the next instruction, which can be 4 bytes long. */
+static inline uint16_t skip_pc(cpu_t *cpu, quirks_t quirks);
+/* Return true and set the error flag if the size bytes at I cross the end of memory
+ * while the cpu traps them. Otherwise they wrap around, reads go through the mirror.
+ */
+static inline bool is_out_of_bounds(cpu_t *cpu, uint32_t size);
+
+/* XOR rows of sprite data at I into the selected planes, set VF = collision. */
+static inline void draw_sprite(cpu_t *cpu, uint8_t rows, uint8_t width, quirks_t quirks);
+static void clear_planes(cpu_t *cpu, uint8_t planes);
+/* Copy a sprite_width x sprite_height color sprite at I to the MegaChip screen. */
+static void draw_mega_sprite(cpu_t *cpu);
+
+/* Generate a handler calling the opcode with the constant quirks of a profile. */
+#define DEFINE_HANDLER(name, profile)                    \
+	static uint16_t opcode_##name##_##profile(cpu_t *cpu) { \
+		return opcode_##name(cpu, QUIRKS_##profile);        \
+	}
+
+#define DEFINE_PROFILE_HANDLERS(profile) \
+	DEFINE_HANDLER(SE, profile)          \
+	DEFINE_HANDLER(SNE, profile)         \
+	DEFINE_HANDLER(SEREG, profile)       \
+	DEFINE_HANDLER(OR, profile)          \
+	DEFINE_HANDLER(AND, profile)         \
+	DEFINE_HANDLER(XOR, profile)         \
+	DEFINE_HANDLER(SHR, profile)         \
+	DEFINE_HANDLER(SHL, profile)         \
+	DEFINE_HANDLER(SNEREG, profile)      \
+	DEFINE_HANDLER(JMPREG, profile)      \
+	DEFINE_HANDLER(DRAW, profile)        \
+	DEFINE_HANDLER(SKEY, profile)        \
+	DEFINE_HANDLER(SNKEY, profile)       \
+	DEFINE_HANDLER(STREG, profile)       \
+	DEFINE_HANDLER(LDREG, profile)
+
+DEFINE_PROFILE_HANDLERS(VIP)
+DEFINE_PROFILE_HANDLERS(CHIP48)
+DEFINE_PROFILE_HANDLERS(SCHIP)
+DEFINE_PROFILE_HANDLERS(XOCHIP)
+DEFINE_PROFILE_HANDLERS(MEGACHIP)
+
+/* Only the profiles with SCHIP_OPCODES draw 16x16 sprites. */
+DEFINE_HANDLER(DRAWBIG, SCHIP)
+DEFINE_HANDLER(DRAWBIG, XOCHIP)
+DEFINE_HANDLER(DRAWBIG, MEGACHIP)
+
+#define DEFINE_FUSED(name, profile)                                          \
+	static uint16_t fused_##name##_##profile(cpu_t *cpu, uint32_t *cycles) { \
+		return fused_##name(cpu, QUIRKS_##profile, cycles);                  \
+	}
+
+#define DEFINE_PROFILE_FUSED(profile)    \
+	DEFINE_FUSED(LDI_DRAW, profile)      \
+	DEFINE_FUSED(DELAY_LOOP, profile)    \
+	DEFINE_FUSED(COUNTER_LOOP, profile) \
+	DEFINE_FUSED(SE_JMP, profile)        \
+	DEFINE_FUSED(SNE_JMP, profile)
+
+DEFINE_PROFILE_FUSED(VIP)
+DEFINE_PROFILE_FUSED(CHIP48)
+DEFINE_PROFILE_FUSED(SCHIP)
+DEFINE_PROFILE_FUSED(XOCHIP)
+DEFINE_PROFILE_FUSED(MEGACHIP)
 
 /* Generate OPCODES. */
 /* clang-format off */
-const opcode_t OPCODES[MAX_OPCODES] = {
-	{ opcode_CLS,      0x00E0, 0xF0FF },
-	{ opcode_RET,      0x00EE, 0xF0FF },
-	{ opcode_JMP,      0x1000, 0xF000 },
-	{ opcode_CALL,     0x2000, 0xF000 },
-	{ opcode_SE,       0x3000, 0xF000 },
-	{ opcode_SNE,      0x4000, 0xF000 },
-	{ opcode_SEREG,    0x5000, 0xF00F },
-	{ opcode_LDIMM,    0x6000, 0xF000 },
-	{ opcode_ADDIMM,   0x7000, 0xF000 },
-	{ opcode_LDV,      0x8000, 0xF00F },
-	{ opcode_OR,       0x8001, 0xF00F },
-	{ opcode_AND,      0x8002, 0xF00F },
-	{ opcode_XOR,      0x8003, 0xF00F },
-	{ opcode_ADD,      0x8004, 0xF00F },
-	{ opcode_SUB,      0x8005, 0xF00F },
-	{ opcode_SHR,      0x8006, 0xF00F },
-	{ opcode_SUBN,     0x8007, 0xF00F },
-	{ opcode_SHL,      0x800E, 0xF00F },
-	{ opcode_SNEREG,   0x9000, 0xF000 },
-	{ opcode_LDI,      0xA000, 0xF000 },
-	{ opcode_JMPREG,   0xB000, 0xF000 },
-	{ opcode_RAND,     0xC000, 0xF000 },
-	{ opcode_DRAW,     0xD000, 0xF000 },
-	{ opcode_SKEY,     0xE09E, 0xF0FF },
-	{ opcode_SNKEY,    0xE0A1, 0xF0FF },
-	{ opcode_RDELAY,   0xF007, 0xF0FF },
-	{ opcode_WAITKEY,  0xF00A, 0xF0FF },
-	{ opcode_WDELAY,   0xF015, 0xF0FF },
-	{ opcode_WSOUND,   0xF018, 0xF0FF },
-	{ opcode_ADDI,     0xF01E, 0xF0FF },
-	{ opcode_LDSPRITE, 0xF029, 0xF0FF },
-	{ opcode_STBCD,    0xF033, 0xF0FF },
-	{ opcode_STREG,    0xF055, 0xF0FF },
-	{ opcode_LDREG,    0xF065, 0xF0FF },
+#define CHIP8_OPCODES(profile) \
+	{ opcode_CLS,                 0x00E0, 0xFFFF }, \
+	{ opcode_RET,                 0x00EE, 0xFFFF }, \
+	{ opcode_JMP,                 0x1000, 0xF000 }, \
+	{ opcode_CALL,                0x2000, 0xF000 }, \
+	{ opcode_SE_##profile,        0x3000, 0xF000 }, \
+	{ opcode_SNE_##profile,       0x4000, 0xF000 }, \
+	{ opcode_SEREG_##profile,     0x5000, 0xF00F }, \
+	{ opcode_LDIMM,               0x6000, 0xF000 }, \
+	{ opcode_ADDIMM,              0x7000, 0xF000 }, \
+	{ opcode_LDV,                 0x8000, 0xF00F }, \
+	{ opcode_OR_##profile,        0x8001, 0xF00F }, \
+	{ opcode_AND_##profile,       0x8002, 0xF00F }, \
+	{ opcode_XOR_##profile,       0x8003, 0xF00F }, \
+	{ opcode_ADD,                 0x8004, 0xF00F }, \
+	{ opcode_SUB,                 0x8005, 0xF00F }, \
+	{ opcode_SHR_##profile,       0x8006, 0xF00F }, \
+	{ opcode_SUBN,                0x8007, 0xF00F }, \
+	{ opcode_SHL_##profile,       0x800E, 0xF00F }, \
+	{ opcode_SNEREG_##profile,    0x9000, 0xF000 }, \
+	{ opcode_LDI,                 0xA000, 0xF000 }, \
+	{ opcode_JMPREG_##profile,    0xB000, 0xF000 }, \
+	{ opcode_RAND,                0xC000, 0xF000 }, \
+	{ opcode_DRAW_##profile,      0xD000, 0xF000 }, \
+	{ opcode_SKEY_##profile,      0xE09E, 0xF0FF }, \
+	{ opcode_SNKEY_##profile,     0xE0A1, 0xF0FF }, \
+	{ opcode_RDELAY,              0xF007, 0xF0FF }, \
+	{ opcode_WAITKEY,             0xF00A, 0xF0FF }, \
+	{ opcode_WDELAY,              0xF015, 0xF0FF }, \
+	{ opcode_WSOUND,              0xF018, 0xF0FF }, \
+	{ opcode_ADDI,                0xF01E, 0xF0FF }, \
+	{ opcode_LDSPRITE,            0xF029, 0xF0FF }, \
+	{ opcode_STBCD,               0xF033, 0xF0FF }, \
+	{ opcode_STREG_##profile,     0xF055, 0xF0FF }, \
+	{ opcode_LDREG_##profile,     0xF065, 0xF0FF }
+
+/* Listed before CHIP8_OPCODES, so Dxy0 is matched before Dxyn. */
+#define SCHIP_OPCODES(profile) \
+	{ opcode_DRAWBIG_##profile,   0xD000, 0xF00F }, \
+	{ opcode_SCD,                 0x00C0, 0xFFF0 }, \
+	{ opcode_SCR,                 0x00FB, 0xFFFF }, \
+	{ opcode_SCL,                 0x00FC, 0xFFFF }, \
+	{ opcode_EXIT,                0x00FD, 0xFFFF }, \
+	{ opcode_LOW,                 0x00FE, 0xFFFF }, \
+	{ opcode_HIGH,                0x00FF, 0xFFFF }, \
+	{ opcode_LDBIGSPRITE,         0xF030, 0xF0FF }, \
+	{ opcode_STFLAGS,             0xF075, 0xF0FF }, \
+	{ opcode_LDFLAGS,             0xF085, 0xF0FF }
+
+#define XOCHIP_OPCODES \
+	{ opcode_SCU,                 0x00D0, 0xFFF0 }, \
+	{ opcode_STRANGE,             0x5002, 0xF00F }, \
+	{ opcode_LDRANGE,             0x5003, 0xF00F }, \
+	{ opcode_LDILONG,             0xF000, 0xFFFF }, \
+	{ opcode_PLANE,               0xF001, 0xF0FF }, \
+	{ opcode_LDAUDIO,             0xF002, 0xFFFF }, \
+	{ opcode_PITCH,               0xF03A, 0xF0FF }
+
+#define MEGACHIP_OPCODES \
+	{ opcode_MEGAOFF,             0x0010, 0xFFFF }, \
+	{ opcode_MEGAON,              0x0011, 0xFFFF }, \
+	{ opcode_LDHI,                0x0100, 0xFF00 }, \
+	{ opcode_LDPAL,               0x0200, 0xFF00 }, \
+	{ opcode_SPRW,                0x0300, 0xFF00 }, \
+	{ opcode_SPRH,                0x0400, 0xFF00 }, \
+	{ opcode_ALPHA,               0x0500, 0xFF00 }, \
+	{ opcode_DIGISND,             0x0600, 0xFFF0 }, \
+	{ opcode_STOPSND,             0x0700, 0xFFFF }, \
+	{ opcode_BMODE,               0x0800, 0xFFF0 }, \
+	{ opcode_CCOL,                0x0900, 0xFF00 }, \
+	{ opcode_SCUMEGA,             0x00B0, 0xFFF0 }
+
+/* Tables are terminated by a NULL handler. */
+const opcode_t OPCODES[PROFILE_COUNT][MAX_OPCODES] = {
+	[PROFILE_VIP] = { CHIP8_OPCODES(VIP) },
+	[PROFILE_CHIP48] = { CHIP8_OPCODES(CHIP48) },
+	[PROFILE_SCHIP] = { SCHIP_OPCODES(SCHIP), CHIP8_OPCODES(SCHIP) },
+	[PROFILE_XOCHIP] = { SCHIP_OPCODES(XOCHIP), CHIP8_OPCODES(XOCHIP), XOCHIP_OPCODES },
+	[PROFILE_MEGACHIP] = {
+		SCHIP_OPCODES(MEGACHIP), CHIP8_OPCODES(MEGACHIP), MEGACHIP_OPCODES
+	},
+};
+
+#define FUSED_HANDLERS(profile) \
+	[FUSED_LDI_DRAW]     = { fused_LDI_DRAW_##profile,     2 }, \
+	[FUSED_LDIMM2]       = { fused_LDIMM2,                 2 }, \
+	[FUSED_LDIMM3]       = { fused_LDIMM3,                 3 }, \
+	[FUSED_DELAY_LOOP]   = { fused_DELAY_LOOP_##profile,   3 }, \
+	[FUSED_COUNTER_LOOP] = { fused_COUNTER_LOOP_##profile, 3 }, \
+	[FUSED_SE_JMP]       = { fused_SE_JMP_##profile,       2 }, \
+	[FUSED_SNE_JMP]      = { fused_SNE_JMP_##profile,      2 }
+
+static const fused_t FUSED[PROFILE_COUNT][FUSED_COUNT] = {
+	[PROFILE_VIP] = { FUSED_HANDLERS(VIP) },
+	[PROFILE_CHIP48] = { FUSED_HANDLERS(CHIP48) },
+	[PROFILE_SCHIP] = { FUSED_HANDLERS(SCHIP) },
+	[PROFILE_XOCHIP] = { FUSED_HANDLERS(XOCHIP) },
+	[PROFILE_MEGACHIP] = { FUSED_HANDLERS(MEGACHIP) },
 };
 /* clang-format on */
 
-/* Decode current opcode using the mask and execute handler if match. */
+void opcode_fetch(cpu_t *cpu) {
+	cpu->opcode = cpu->memory[cpu->PC] << 8 | cpu->memory[cpu->PC + 1];
+	cpu->addr = cpu->opcode & 0x0FFF;
+	cpu->byte = cpu->opcode & 0x00FF;
+	cpu->nibble = cpu->opcode & 0x000F;
+	cpu->x = (cpu->opcode & 0x0F00) >> 8;
+	cpu->y = (cpu->opcode & 0x00F0) >> 4;
+}
+
+/* Decode current opcode using the mask of the cpu profile table and execute handler
+ * if match.
+ */
 int8_t opcode_decode(cpu_t *cpu) {
+	const uint8_t index = find_opcode(cpu->profile, cpu->opcode);
 	has_error = false; /* Reset error. */
 
-	for (size_t i = 0; i < MAX_OPCODES; i += 1) {
-		opcode_t opcode = OPCODES[i];
+	if (index == DECODED_NONE) {
+		log_error("Unknown opcode: 0x%X", cpu->opcode);
+		return STATUS_ERROR;
+	}
 
-		if ((cpu->opcode & opcode.mask) == opcode.opcode) {
-			/* Execute handler if current opcode match. */
-			if (opcode.handler != NULL) {
-				cpu->PC = opcode.handler(cpu);
-			}
+	/* Execute handler of the matching opcode. */
+	cpu->PC = OPCODES[cpu->profile][index - 1].handler(cpu);
 
-			/* Verify if the opcode handler setted the error flag to true. */
-			if (has_error) {
-				log_error("An error occurried while execute opcode: %X", cpu->opcode);
-				return STATUS_ERROR;
-			}
+	/* Verify if the opcode handler setted the error flag to true. */
+	if (has_error) {
+		log_error("An error occurried while execute opcode: %X", cpu->opcode);
+		return STATUS_ERROR;
+	}
+
+	return STATUS_OK;
+}
 
-			return STATUS_OK;
+/* The opcode at PC must be fetched already, fused handlers fetch the next ones. */
+int8_t opcode_execute(cpu_t *cpu, uint32_t budget, uint32_t *cycles) {
+	uint8_t decoded = cpu->decoded[cpu->PC];
+
+	if (decoded == DECODED_NONE) {
+		decoded = predecode(cpu, cpu->PC);
+		cpu->decoded[cpu->PC] = decoded;
+	}
+
+	if (decoded < DECODED_FUSED) {
+		if (decoded == DECODED_NONE) {
+			log_error("Unknown opcode: 0x%X", cpu->opcode);
+			return STATUS_ERROR;
+		}
+
+		*cycles += 1;
+		has_error = false; /* Reset error. */
+		cpu->PC = OPCODES[cpu->profile][decoded - 1].handler(cpu);
+	} else if (decoded & DECODED_BREAK) {
+		/* Snapshots have no debugger, they run through the breakpoints. */
+		if (cpu->debugger == NULL) {
+			*cycles += 1;
+			return opcode_decode(cpu);
+		}
+
+		debug_break(cpu->debugger, cpu); /* The instruction is done by the debugger. */
+		return STATUS_OK;
+	} else {
+		const fused_t *fused = &FUSED[cpu->profile][decoded - DECODED_FUSED];
+
+		/* Keep the cycles exact, the end of the budget is done one by one. */
+		*cycles += 1;
+		if (fused->length > budget) {
+			return opcode_decode(cpu);
 		}
+
+		has_error = false; /* Reset error. */
+		cpu->PC = fused->handler(cpu, cycles);
+	}
+
+	if (has_error) {
+		log_error("An error occurried while execute opcode: %X", cpu->opcode);
+		return STATUS_ERROR;
 	}
 
-	log_error("Unknown opcode: 0x%X", cpu->opcode);
-	return STATUS_ERROR;
+	return STATUS_OK;
 }
 
-/* 0x00E0 - CLS: Clear display. */
-static uint16_t opcode_CLS(cpu_t *cpu) {
-	memset(cpu->gfx, 0, GFX_WIDTH * GFX_HEIGHT * sizeof(uint8_t));
+void opcode_invalidate(cpu_t *cpu, uint16_t address, uint32_t size) {
+	opcode_clear_decoded(cpu, address, size);
+	mark_written(cpu, address, size);
+	cpu_mirror_memory(cpu, address, size);
+
+	if (cpu->debugger != NULL) {
+		debug_check_write(cpu->debugger, cpu, address, size);
+	}
+}
+
+void opcode_clear_decoded(cpu_t *cpu, uint16_t address, uint32_t size) {
+	/* A fused sequence starting before the address can include these bytes. */
+	const uint16_t first = address - (FUSED_MAX_LENGTH * 2 - 1);
+	const uint32_t count = size + FUSED_MAX_LENGTH * 2 - 1;
+
+	for (uint32_t i = 0; i < count && i < RAM_SIZE; i += 1) {
+		cpu->decoded[(uint16_t)(first + i)] &= DECODED_BREAK;
+	}
+}
+
+void opcode_set_breakpoint(cpu_t *cpu, uint16_t address, bool is_set) {
+	/* Fused sequences before the address are decoded again, to stop at it. */
+	opcode_clear_decoded(cpu, address, 1);
+	cpu->decoded[address] = is_set ? DECODED_BREAK : DECODED_NONE;
+}
+
+bool opcode_has_breakpoint(const cpu_t *cpu, uint16_t address) {
+	return (cpu->decoded[address] & DECODED_BREAK) != 0;
+}
+
+/* 0x0010 - MEGAOFF: Disable MegaChip mode.
+ * MegaChip extension. The planes are used for drawing again.
+ */
+static uint16_t opcode_MEGAOFF(cpu_t *cpu) {
+	cpu->is_mega = false;
+	cpu->has_gfx_changed = true;
+	return NEXT_PC;
+}
+
+/* 0x0011 - MEGAON: Enable MegaChip mode.
+ * MegaChip extension. Screen is set to 256x192 with 8 bits indexed colors.
+ */
+static uint16_t opcode_MEGAON(cpu_t *cpu) {
+	cpu->is_mega = true;
+	mega_clear(&cpu->mega);
+	cpu->has_gfx_changed = true;
+	return NEXT_PC;
+}
+
+/* 0x01nn nnnn - LDHI: Set I = nnnnnn.
+ * MegaChip extension. The low 16 bits of the address are read from the next 2 bytes,
+ * so this instruction is 4 bytes long.
+ */
+static uint16_t opcode_LDHI(cpu_t *cpu) {
+	const uint8_t *operand = &cpu->memory[(uint16_t)(cpu->PC + 2)];
+	const uint16_t low = operand[0] << 8 | operand[1];
+
+	cpu->I = (uint32_t)cpu->byte << 16 | low;
+	return cpu->PC + 4;
+}
+
+/* 0x02nn - LDPAL: Load nn colors from memory location I into the palette.
+ * MegaChip extension. Each color is 4 bytes long in ARGB order, they are loaded
+ * starting at palette index 1, since index 0 is transparent.
+ */
+static uint16_t opcode_LDPAL(cpu_t *cpu) {
+	for (uint16_t color = 0; color < cpu->byte; color += 1) {
+		const uint32_t address = cpu->I + color * 4;
+		uint32_t argb = 0;
+
+		for (uint8_t i = 0; i < 4; i += 1) {
+			argb = argb << 8 | cpu_read_byte(cpu, address + i);
+		}
+		cpu->mega.palette[color + 1] = argb;
+	}
+
+	cpu->mega.has_palette_changed = true;
+	cpu->has_gfx_changed = true;
+	return NEXT_PC;
+}
+
+/* 0x03nn - SPRW: Set sprite width to nn.
+ * MegaChip extension. A width of 0 means 256 pixels.
+ */
+static uint16_t opcode_SPRW(cpu_t *cpu) {
+	cpu->mega.sprite_width = cpu->byte == 0 ? MEGA_WIDTH : cpu->byte;
+	return NEXT_PC;
+}
+
+/* 0x04nn - SPRH: Set sprite height to nn.
+ * MegaChip extension. A height of 0 means 256 pixels.
+ */
+static uint16_t opcode_SPRH(cpu_t *cpu) {
+	cpu->mega.sprite_height = cpu->byte == 0 ? MEGA_WIDTH : cpu->byte;
+	return NEXT_PC;
+}
+
+/* 0x05nn - ALPHA: Set screen alpha to nn.
+ * MegaChip extension. Used by programs to fade the screen.
+ */
+static uint16_t opcode_ALPHA(cpu_t *cpu) {
+	cpu->mega.alpha = cpu->byte;
 	cpu->has_gfx_changed = true;
 	return NEXT_PC;
 }
 
+/* 0x060n - DIGISND: Play digitised sound at memory location I.
+ * MegaChip extension.
+ * WARN: Digitised sound is not supported, the instruction is skipped.
+ */
+static uint16_t opcode_DIGISND(cpu_t *cpu) {
+	return NEXT_PC;
+}
+
+/* 0x0700 - STOPSND: Stop digitised sound.
+ * MegaChip extension.
+ */
+static uint16_t opcode_STOPSND(cpu_t *cpu) {
+	return NEXT_PC;
+}
+
+/* 0x080n - BMODE: Set sprite blend mode to n.
+ * MegaChip extension. Modes are normal, 25%, 50%, 75%, additive and multiply.
+ * WARN: Screen pixels are palette indexes, so sprites are always drawn as normal.
+ */
+static uint16_t opcode_BMODE(cpu_t *cpu) {
+	cpu->mega.blend_mode = cpu->nibble;
+	return NEXT_PC;
+}
+
+/* 0x09nn - CCOL: Set collision color to palette index nn.
+ * MegaChip extension. DRAW sets VF if a sprite pixel covers a pixel of this color.
+ */
+static uint16_t opcode_CCOL(cpu_t *cpu) {
+	cpu->mega.collision_color = cpu->byte;
+	return NEXT_PC;
+}
+
+/* 0x00Bn - SCUMEGA: Scroll display n pixels up.
+ * MegaChip extension. Rows scrolled out of the screen are lost.
+ */
+static uint16_t opcode_SCUMEGA(cpu_t *cpu) {
+	if (cpu->is_mega) {
+		mega_scroll_up(&cpu->mega, cpu->nibble);
+	} else {
+		gfx_scroll_up(cpu->gfx[0], cpu->nibble, cpu->gfx_height);
+	}
+
+	cpu->has_gfx_changed = true;
+	return NEXT_PC;
+}
+
+/* 0x00Cn - SCD: Scroll display n pixels down.
+ * SUPER-CHIP extension. Rows scrolled out of the screen are lost.
+ */
+static uint16_t opcode_SCD(cpu_t *cpu) {
+	if (cpu->is_mega) {
+		mega_scroll_down(&cpu->mega, cpu->nibble);
+		cpu->has_gfx_changed = true;
+		return NEXT_PC;
+	}
+
+	for (uint8_t plane = 0; plane < GFX_PLANES; plane += 1) {
+		if (cpu->planes & (1 << plane)) {
+			gfx_scroll_down(cpu->gfx[plane], cpu->nibble, cpu->gfx_height);
+		}
+	}
+
+	cpu->has_gfx_changed = true;
+	return NEXT_PC;
+}
+
+/* 0x00Dn - SCU: Scroll display n pixels up.
+ * XO-CHIP extension. Rows scrolled out of the screen are lost.
+ */
+static uint16_t opcode_SCU(cpu_t *cpu) {
+	for (uint8_t plane = 0; plane < GFX_PLANES; plane += 1) {
+		if (cpu->planes & (1 << plane)) {
+			gfx_scroll_up(cpu->gfx[plane], cpu->nibble, cpu->gfx_height);
+		}
+	}
+
+	cpu->has_gfx_changed = true;
+	return NEXT_PC;
+}
+
+/* 0x00E0 - CLS: Clear display.
+ * Only the selected XO-CHIP planes are cleared.
+ */
+static uint16_t opcode_CLS(cpu_t *cpu) {
+	if (cpu->is_mega) {
+		mega_clear(&cpu->mega);
+		cpu->has_gfx_changed = true;
+		return NEXT_PC;
+	}
+
+	clear_planes(cpu, cpu->planes);
+	return NEXT_PC;
+}
+
 /* 0x00EE - RET: Return from a subroutine.
  * The interpreter sets the program counter to the address at the top of the stack,
  * then subtracts 1 from the stack pointer.
@@ -137,6 +597,80 @@ static uint16_t opcode_RET(cpu_t *cpu) {
 	return cpu->stack[cpu->SP] + 2;
 }
 
+/* 0x00FB - SCR: Scroll display 4 pixels right.
+ * SUPER-CHIP extension.
+ */
+static uint16_t opcode_SCR(cpu_t *cpu) {
+	if (cpu->is_mega) {
+		mega_scroll_right(&cpu->mega, SCROLL_AMOUNT);
+		cpu->has_gfx_changed = true;
+		return NEXT_PC;
+	}
+
+	for (uint8_t plane = 0; plane < GFX_PLANES; plane += 1) {
+		if (cpu->planes & (1 << plane)) {
+			gfx_scroll_right(
+				cpu->gfx[plane], SCROLL_AMOUNT, cpu->gfx_width, cpu->gfx_height
+			);
+		}
+	}
+
+	cpu->has_gfx_changed = true;
+	return NEXT_PC;
+}
+
+/* 0x00FC - SCL: Scroll display 4 pixels left.
+ * SUPER-CHIP extension.
+ */
+static uint16_t opcode_SCL(cpu_t *cpu) {
+	if (cpu->is_mega) {
+		mega_scroll_left(&cpu->mega, SCROLL_AMOUNT);
+		cpu->has_gfx_changed = true;
+		return NEXT_PC;
+	}
+
+	for (uint8_t plane = 0; plane < GFX_PLANES; plane += 1) {
+		if (cpu->planes & (1 << plane)) {
+			gfx_scroll_left(
+				cpu->gfx[plane], SCROLL_AMOUNT, cpu->gfx_width, cpu->gfx_height
+			);
+		}
+	}
+
+	cpu->has_gfx_changed = true;
+	return NEXT_PC;
+}
+
+/* 0x00FD - EXIT: Exit interpreter.
+ * SUPER-CHIP extension. The program counter is kept at this instruction.
+ */
+static uint16_t opcode_EXIT(cpu_t *cpu) {
+	cpu->has_exited = true;
+	return cpu->PC;
+}
+
+/* 0x00FE - LOW: Disable high resolution mode, screen is 64x32.
+ * SUPER-CHIP extension. All planes are cleared on resolution change.
+ */
+static uint16_t opcode_LOW(cpu_t *cpu) {
+	cpu->gfx_width = GFX_LORES_WIDTH;
+	cpu->gfx_height = GFX_LORES_HEIGHT;
+
+	clear_planes(cpu, GFX_PLANES_MASK);
+	return NEXT_PC;
+}
+
+/* 0x00FF - HIGH: Enable high resolution mode, screen is 128x64.
+ * SUPER-CHIP extension. All planes are cleared on resolution change.
+ */
+static uint16_t opcode_HIGH(cpu_t *cpu) {
+	cpu->gfx_width = GFX_WIDTH;
+	cpu->gfx_height = GFX_HEIGHT;
+
+	clear_planes(cpu, GFX_PLANES_MASK);
+	return NEXT_PC;
+}
+
 /* 0x1nnn - JMP: Jump to location nnn.
  * The interpreter sets the program counter to nnn.
  */
@@ -166,7 +700,7 @@ static uint16_t opcode_CALL(cpu_t *cpu) {
  * The interpreter compares register Vx to kk, and if they are equal,
  * increments the program counter by 2, otherwise, increments the program counter by 4.
  */
-static uint16_t opcode_SE(cpu_t *cpu) {
+static inline uint16_t opcode_SE(cpu_t *cpu, quirks_t quirks) {
 	const uint8_t val = cpu->byte;
 	const uint8_t reg = cpu->V[cpu->x];
 
@@ -177,7 +711,7 @@ static uint16_t opcode_SE(cpu_t *cpu) {
  * The interpreter compares register Vx to kk, and if they are NOT equal,
  * increments the program counter by 2.
  */
-static uint16_t opcode_SNE(cpu_t *cpu) {
+static inline uint16_t opcode_SNE(cpu_t *cpu, quirks_t quirks) {
 	const uint8_t val = cpu->byte;
 	const uint8_t reg = cpu->V[cpu->x];
 
@@ -188,13 +722,51 @@ static uint16_t opcode_SNE(cpu_t *cpu) {
  * The interpreter compares register Vx to register Vy, and if they are equal,
  * increments the program counter by 2.
  */
-static uint16_t opcode_SEREG(cpu_t *cpu) {
+static inline uint16_t opcode_SEREG(cpu_t *cpu, quirks_t quirks) {
 	const uint8_t reg_x = cpu->V[cpu->x];
 	const uint8_t reg_y = cpu->V[cpu->y];
 
 	return reg_x == reg_y ? SKIP_PC : NEXT_PC;
 }
 
+/* 0x5xy2 - STRANGE: Store registers Vx through Vy in memory starting at location I.
+ * XO-CHIP extension. Registers are stored in reverse order if x > y.
+ * I is not modified.
+ */
+static uint16_t opcode_STRANGE(cpu_t *cpu) {
+	const int8_t step = cpu->x <= cpu->y ? 1 : -1;
+	const uint8_t count = abs(cpu->x - cpu->y) + 1;
+
+	if (is_out_of_bounds(cpu, count)) {
+		return NEXT_PC;
+	}
+	for (uint8_t i = 0; i < count; i += 1) {
+		cpu->memory[(uint16_t)(cpu->I + i)] = cpu->V[cpu->x + i * step];
+	}
+	opcode_invalidate(cpu, cpu->I, count);
+
+	return NEXT_PC;
+}
+
+/* 0x5xy3 - LDRANGE: Read registers Vx through Vy from memory starting at location I.
+ * XO-CHIP extension. Registers are loaded in reverse order if x > y.
+ * I is not modified.
+ */
+static uint16_t opcode_LDRANGE(cpu_t *cpu) {
+	const int8_t step = cpu->x <= cpu->y ? 1 : -1;
+	const uint8_t count = abs(cpu->x - cpu->y) + 1;
+	const uint8_t *source = &cpu->memory[cpu->I & RAM_MASK];
+
+	if (is_out_of_bounds(cpu, count)) {
+		return NEXT_PC;
+	}
+	for (uint8_t i = 0; i < count; i += 1) {
+		cpu->V[cpu->x + i * step] = source[i];
+	}
+
+	return NEXT_PC;
+}
+
 /* 0x6xkk - LDIMM: Set Vx = kk.
  * The interpreter puts the value kk into register Vx.
  */
@@ -233,12 +805,16 @@ static uint16_t opcode_LDV(cpu_t *cpu) {
  * The interpreter performs a bitwise OR on the values of Vx and Vy, then stores the
  * result in Vx. A bitwise OR compares the corresponding bits from two values, and if
  * either bit is 1, then the same bit in the result is also 1. Otherwise, it is 0.
+ * Quirk: COSMAC VIP sets VF to 0.
  */
-static uint16_t opcode_OR(cpu_t *cpu) {
+static inline uint16_t opcode_OR(cpu_t *cpu, quirks_t quirks) {
 	const uint8_t reg_y = cpu->V[cpu->y];
 	uint8_t *reg_x = &cpu->V[cpu->x];
 
 	*reg_x |= reg_y;
+	if (quirks.vf_reset) {
+		cpu->V[0xF] = 0;
+	}
 	return NEXT_PC;
 }
 
@@ -246,12 +822,16 @@ static uint16_t opcode_OR(cpu_t *cpu) {
  * The interpreter performs a bitwise AND on the values of Vx and Vy, then stores the
  * result in Vx. A bitwise AND compares the corresponding bits from two values, and if
  * both bits are 1, then the same bit in the result is also 1. Otherwise, it is 0.
+ * Quirk: COSMAC VIP sets VF to 0.
  */
-static uint16_t opcode_AND(cpu_t *cpu) {
+static inline uint16_t opcode_AND(cpu_t *cpu, quirks_t quirks) {
 	const uint8_t reg_y = cpu->V[cpu->y];
 	uint8_t *reg_x = &cpu->V[cpu->x];
 
 	*reg_x &= reg_y;
+	if (quirks.vf_reset) {
+		cpu->V[0xF] = 0;
+	}
 	return NEXT_PC;
 }
 
@@ -260,12 +840,16 @@ static uint16_t opcode_AND(cpu_t *cpu) {
  * the result in Vx. An exclusive OR compares the corresponding bits from two values, and
  * if the bits are not both the same, then the corresponding bit in the result is set
  * to 1. Otherwise, it is 0.
+ * Quirk: COSMAC VIP sets VF to 0.
  */
-static uint16_t opcode_XOR(cpu_t *cpu) {
+static inline uint16_t opcode_XOR(cpu_t *cpu, quirks_t quirks) {
 	const uint8_t reg_y = cpu->V[cpu->y];
 	uint8_t *reg_x = &cpu->V[cpu->x];
 
 	*reg_x ^= reg_y;
+	if (quirks.vf_reset) {
+		cpu->V[0xF] = 0;
+	}
 	return NEXT_PC;
 }
 
@@ -303,12 +887,13 @@ static uint16_t opcode_SUB(cpu_t *cpu) {
  * Legacy:
  * 		Shift Vy to RIGHT and store result in Vx.
  * 		Interpreter set VF to the least-significant bit of Vy.
+ * Quirk: Legacy is used by COSMAC VIP and XO-CHIP.
  */
-static uint16_t opcode_SHR(cpu_t *cpu) {
-	uint8_t *reg_x = &cpu->V[cpu->x];
+static inline uint16_t opcode_SHR(cpu_t *cpu, quirks_t quirks) {
+	const uint8_t reg = quirks.shift_vy ? cpu->V[cpu->y] : cpu->V[cpu->x];
 
-	cpu->V[0xF] = *reg_x & 0x1;
-	*reg_x = *reg_x >> 1;
+	cpu->V[cpu->x] = reg >> 1;
+	cpu->V[0xF] = reg & 0x1;
 	return NEXT_PC;
 }
 
@@ -331,13 +916,14 @@ static uint16_t opcode_SUBN(cpu_t *cpu) {
  * 		Interpreter set VF to the least-significant bit of Vx.
  * Legacy:
  * 		Shift Vy to LEFT and store result in Vx.
- * 		Interpreter set VF to the least-significant bit of Vy.
+ * 		Interpreter set VF to the most-significant bit of Vy.
+ * Quirk: Legacy is used by COSMAC VIP and XO-CHIP.
  */
-static uint16_t opcode_SHL(cpu_t *cpu) {
-	uint8_t *reg_x = &cpu->V[cpu->x];
+static inline uint16_t opcode_SHL(cpu_t *cpu, quirks_t quirks) {
+	const uint8_t reg = quirks.shift_vy ? cpu->V[cpu->y] : cpu->V[cpu->x];
 
-	cpu->V[0xF] = (*reg_x >> 7) & 0x1;
-	*reg_x = *reg_x << 1;
+	cpu->V[cpu->x] = reg << 1;
+	cpu->V[0xF] = (reg >> 7) & 0x1;
 	return NEXT_PC;
 }
 
@@ -346,7 +932,7 @@ static uint16_t opcode_SHL(cpu_t *cpu) {
  * the program counter is increased by 2,
  * otherwise, the program counter is increased by 4.
  */
-static uint16_t opcode_SNEREG(cpu_t *cpu) {
+static inline uint16_t opcode_SNEREG(cpu_t *cpu, quirks_t quirks) {
 	const uint8_t reg_x = cpu->V[cpu->x];
 	const uint8_t reg_y = cpu->V[cpu->y];
 
@@ -363,11 +949,10 @@ static uint16_t opcode_LDI(cpu_t *cpu) {
 
 /* 0xBnnn - JMPREG: Jump to location nnn + V0.
  * Interpreter set PC to nnn plus the value of V0.
- * WARN: Ambiguous opcode.
- * TODO: This opcode also can be read as 0xBxnn, make this configurable.
+ * Quirk: CHIP-48 and SUPER-CHIP read it as 0xBxnn, jumping to xnn plus the value of Vx.
  */
-static uint16_t opcode_JMPREG(cpu_t *cpu) {
-	return cpu->addr + cpu->V[0];
+static inline uint16_t opcode_JMPREG(cpu_t *cpu, quirks_t quirks) {
+	return cpu->addr + cpu->V[quirks.jump_vx ? cpu->x : 0];
 }
 
 /* 0xCxkk - RAND: Set Vx = random_byte AND kk;
@@ -378,7 +963,20 @@ static uint16_t opcode_RAND(cpu_t *cpu) {
 	const uint8_t byte = cpu->byte;
 	uint8_t *reg = &cpu->V[cpu->x];
 
-	*reg = (rand() % 256) & byte;
+	/* Xorshift32, the state is never 0. */
+	cpu->random ^= cpu->random << 13;
+	cpu->random ^= cpu->random >> 17;
+	cpu->random ^= cpu->random << 5;
+	*reg = (cpu->random & 0xFF) & byte;
+	return NEXT_PC;
+}
+
+/* 0xDxy0 - DRAWBIG: Display 16x16 sprite starting at memory location I at (Vx, Vy),
+ * set VF = collision.
+ * SUPER-CHIP extension. Each sprite row is 2 bytes long, 32 bytes are read from memory.
+ */
+static inline uint16_t opcode_DRAWBIG(cpu_t *cpu, quirks_t quirks) {
+	draw_sprite(cpu, BIG_SPRITE_SIZE, BIG_SPRITE_SIZE, quirks);
 	return NEXT_PC;
 }
 
@@ -390,37 +988,10 @@ static uint16_t opcode_RAND(cpu_t *cpu) {
  * If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
  * If the sprite is positioned so part of it is outside the coordinates of the display,
  * it wraps around to the opposite side of the screen.
+ * Quirk: All profiles but XO-CHIP clip the sprite instead of wrapping it.
  */
-static uint16_t opcode_DRAW(cpu_t *cpu) {
-	const uint8_t x = cpu->V[cpu->x];
-	const uint8_t y = cpu->V[cpu->y];
-	const uint8_t n = cpu->nibble;
-
-	/* Copy sprite from the memory. */
-	uint8_t sprite[n];
-	memcpy(sprite, &cpu->memory[cpu->I], n);
-
-	cpu->V[0xF] = 0; /* Set pixel erased flag to 0. */
-	for (uint8_t byte_index = 0; byte_index < n; byte_index += 1) {
-		for (uint8_t bit_index = 0; bit_index < 8; bit_index += 1) {
-			/* Calculate pixel position. Wrap if going beyond screen boundaries. */
-			const uint8_t x_pos = (x + bit_index) % GFX_WIDTH;
-			const uint8_t y_pos = (y + byte_index) % GFX_HEIGHT;
-
-			/* Calculate pixel value */
-			const uint8_t bit = (sprite[byte_index] >> (7 - bit_index)) & 1;
-			uint8_t *pixel = &cpu->gfx[x_pos + y_pos * GFX_WIDTH];
-
-			/* If pixel is ereased, set flag to 1. */
-			if (bit == 0x1 && *pixel == 0x1) {
-				cpu->V[0xF] = 1;
-			}
-
-			*pixel ^= bit; /* Effectively XOR with the sprite pixel */
-		}
-	}
-
-	cpu->has_gfx_changed = true;
+static inline uint16_t opcode_DRAW(cpu_t *cpu, quirks_t quirks) {
+	draw_sprite(cpu, cpu->nibble, 8, quirks);
 	return NEXT_PC;
 }
 
@@ -428,9 +999,9 @@ static uint16_t opcode_DRAW(cpu_t *cpu) {
  * Checks the keyboard state , and if the key corresponding to the value of Vx is
  * currently in the down position, PC is increased by 2, otherwise, PC is increased by 4.
  */
-static uint16_t opcode_SKEY(cpu_t *cpu) {
-	const uint8_t reg = cpu->V[cpu->x];
-	const uint8_t key_state = cpu->key_state[reg];
+static inline uint16_t opcode_SKEY(cpu_t *cpu, quirks_t quirks) {
+	const uint8_t key = cpu->V[cpu->x] & 0xF; /* Only the low nibble selects a key. */
+	const uint8_t key_state = cpu->key_state[key];
 
 	return key_state == 1 ? SKIP_PC : NEXT_PC;
 }
@@ -439,13 +1010,45 @@ static uint16_t opcode_SKEY(cpu_t *cpu) {
  * Checks the keyboard state , and if the key corresponding to the value of Vx is
  * currently in the up position, PC is increased by 2, otherwise, PC is increased by 4.
  */
-static uint16_t opcode_SNKEY(cpu_t *cpu) {
-	const uint8_t reg = cpu->V[cpu->x];
-	const uint8_t key_state = cpu->key_state[reg];
+static inline uint16_t opcode_SNKEY(cpu_t *cpu, quirks_t quirks) {
+	const uint8_t key = cpu->V[cpu->x] & 0xF; /* Only the low nibble selects a key. */
+	const uint8_t key_state = cpu->key_state[key];
 
 	return key_state == 0 ? SKIP_PC : NEXT_PC;
 }
 
+/* 0xF000 nnnn - LDILONG: Set I = nnnn.
+ * XO-CHIP extension. The 16 bits address is read from the next 2 bytes, so this
+ * instruction is 4 bytes long.
+ */
+static uint16_t opcode_LDILONG(cpu_t *cpu) {
+	const uint8_t *operand = &cpu->memory[(uint16_t)(cpu->PC + 2)];
+
+	cpu->I = operand[0] << 8 | operand[1];
+	return cpu->PC + 4;
+}
+
+/* 0xFn01 - PLANE: Select bitplanes n for drawing.
+ * XO-CHIP extension. Bit 0 selects the first plane and bit 1 selects the second one.
+ */
+static uint16_t opcode_PLANE(cpu_t *cpu) {
+	cpu->planes = cpu->x & GFX_PLANES_MASK;
+	return NEXT_PC;
+}
+
+/* 0xF002 - LDAUDIO: Load 16 bytes audio pattern buffer from memory location I.
+ * XO-CHIP extension. The pattern is a sequence of 128 1-bit samples, played while the
+ * sound timer is active.
+ */
+static uint16_t opcode_LDAUDIO(cpu_t *cpu) {
+	if (is_out_of_bounds(cpu, AUDIO_PATTERN_SIZE)) {
+		return NEXT_PC;
+	}
+	memcpy(cpu->audio_pattern, &cpu->memory[cpu->I & RAM_MASK], AUDIO_PATTERN_SIZE);
+	cpu->has_audio_changed = true;
+	return NEXT_PC;
+}
+
 /* 0xFx07 - RDELAY: Set Vx = delay timer value.
  * Interpreter copy the value of delay timer into Vx.
  */
@@ -459,6 +1062,7 @@ static uint16_t opcode_RDELAY(cpu_t *cpu) {
 /* 0xFx0A - WAITKEY: Wait for a key press, store the value of the key in Vx.
  * All execution stops until a key is pressed,
  * then the value of that key is stored in Vx.
+ * The cpu is halted until the next key event, instead of reexecuting it every cycle.
  */
 static uint16_t opcode_WAITKEY(cpu_t *cpu) {
 	for (uint8_t key = 0; key < KEYS_COUNT; key += 1) {
@@ -468,7 +1072,8 @@ static uint16_t opcode_WAITKEY(cpu_t *cpu) {
 		}
 	}
 
-	return cpu->PC; /* Reexecute this instruction. */
+	cpu->is_halted = true;
+	return cpu->PC; /* Reexecute this instruction after a key event. */
 }
 
 /* 0xFx15 - STDELAY: Set delay timer = Vx.
@@ -514,6 +1119,17 @@ static uint16_t opcode_LDSPRITE(cpu_t *cpu) {
 	return NEXT_PC;
 }
 
+/* 0xFx30 - LDBIGSPRITE: Set I = location of big sprite for digit Vx.
+ * SUPER-CHIP extension. The value of I is set to the location for the 8x10
+ * hexadecimal sprite corresponding to the value of Vx.
+ */
+static uint16_t opcode_LDBIGSPRITE(cpu_t *cpu) {
+	const uint8_t reg = cpu->V[cpu->x];
+
+	cpu->I = BIG_FONT_ADDRESS + (BIG_FONT_SIZE * reg);
+	return NEXT_PC;
+}
+
 /* 0xFx33 - STBCD: Store BCD representation of Vx in memory locations I, I+1, and I+2.
  * The interpreter takes the decimal value of Vx, and places the hundreds digit in
  * memory at location in I, the tens digit at location I+1,
@@ -525,9 +1141,23 @@ static uint16_t opcode_STBCD(cpu_t *cpu) {
 	const uint8_t tens = (value / 10) % 10;
 	const uint8_t hundreds = (value / 100) % 10;
 
-	cpu->memory[cpu->I + 0] = hundreds;
-	cpu->memory[cpu->I + 1] = tens;
-	cpu->memory[cpu->I + 2] = ones;
+	if (is_out_of_bounds(cpu, 3)) {
+		return NEXT_PC;
+	}
+	cpu->memory[(uint16_t)(cpu->I + 0)] = hundreds;
+	cpu->memory[(uint16_t)(cpu->I + 1)] = tens;
+	cpu->memory[(uint16_t)(cpu->I + 2)] = ones;
+	opcode_invalidate(cpu, cpu->I, 3);
+	return NEXT_PC;
+}
+
+/* 0xFx3A - PITCH: Set audio pitch = Vx.
+ * XO-CHIP extension. The pattern buffer is played at 4000 * 2 ^ ((Vx - 64) / 48)
+ * bits per second.
+ */
+static uint16_t opcode_PITCH(cpu_t *cpu) {
+	cpu->pitch = cpu->V[cpu->x];
+	cpu->has_audio_changed = true;
 	return NEXT_PC;
 }
 
@@ -535,15 +1165,24 @@ static uint16_t opcode_STBCD(cpu_t *cpu) {
  * The interpreter copies the values of registers V0 through Vx into memory,
  * starting at the address in I.
  * I is set to 'I + X + 1' after operation.
+ * Quirk: CHIP-48 sets I to 'I + X', SUPER-CHIP and MegaChip don't modify I.
  */
-static uint16_t opcode_STREG(cpu_t *cpu) {
+static inline uint16_t opcode_STREG(cpu_t *cpu, quirks_t quirks) {
 	const uint8_t reg = cpu->x;
 
+	if (is_out_of_bounds(cpu, reg + 1)) {
+		return NEXT_PC;
+	}
 	for (size_t i = 0; i <= reg; i += 1) {
-		cpu->memory[cpu->I + i] = cpu->V[i];
+		cpu->memory[(uint16_t)(cpu->I + i)] = cpu->V[i];
 	}
+	opcode_invalidate(cpu, cpu->I, reg + 1);
 
-	cpu->I += cpu->x + 1;
+	if (quirks.memory == MEMORY_INCREMENT_X1) {
+		cpu->I += cpu->x + 1;
+	} else if (quirks.memory == MEMORY_INCREMENT_X) {
+		cpu->I += cpu->x;
+	}
 	return NEXT_PC;
 }
 
@@ -551,14 +1190,302 @@ static uint16_t opcode_STREG(cpu_t *cpu) {
  * The interpreter reads values from memory starting at location I into
  * registers V0 through Vx.
  * I is set to 'I + X + 1' after operation.
+ * Quirk: CHIP-48 sets I to 'I + X', SUPER-CHIP and MegaChip don't modify I.
  */
-static uint16_t opcode_LDREG(cpu_t *cpu) {
+static inline uint16_t opcode_LDREG(cpu_t *cpu, quirks_t quirks) {
 	const uint8_t reg = cpu->x;
+	const uint8_t *source = &cpu->memory[cpu->I & RAM_MASK];
 
+	if (is_out_of_bounds(cpu, reg + 1)) {
+		return NEXT_PC;
+	}
 	for (size_t i = 0; i <= reg; i += 1) {
-		cpu->V[i] = cpu->memory[cpu->I + i];
+		cpu->V[i] = source[i];
+	}
+
+	if (quirks.memory == MEMORY_INCREMENT_X1) {
+		cpu->I += cpu->x + 1;
+	} else if (quirks.memory == MEMORY_INCREMENT_X) {
+		cpu->I += cpu->x;
 	}
+	return NEXT_PC;
+}
 
-	cpu->I += cpu->x + 1;
+/* 0xFx75 - STFLAGS: Store registers V0 through Vx in RPL user flags.
+ * SUPER-CHIP extension.
+ */
+static uint16_t opcode_STFLAGS(cpu_t *cpu) {
+	memcpy(cpu->rpl, cpu->V, cpu->x + 1);
 	return NEXT_PC;
 }
+
+/* 0xFx85 - LDFLAGS: Read registers V0 through Vx from RPL user flags.
+ * SUPER-CHIP extension.
+ */
+static uint16_t opcode_LDFLAGS(cpu_t *cpu) {
+	memcpy(cpu->V, cpu->rpl, cpu->x + 1);
+	return NEXT_PC;
+}
+
+/* Annn, Dxyn - Draw a sprite loaded just before. */
+static inline uint16_t fused_LDI_DRAW(cpu_t *cpu, quirks_t quirks, uint32_t *cycles) {
+	fetch_next(cpu, opcode_LDI(cpu), cycles);
+	return opcode_DRAW(cpu, quirks);
+}
+
+/* 6xkk, 6ykk - Load two registers. */
+static uint16_t fused_LDIMM2(cpu_t *cpu, uint32_t *cycles) {
+	fetch_next(cpu, opcode_LDIMM(cpu), cycles);
+	return opcode_LDIMM(cpu);
+}
+
+/* 6xkk, 6ykk, 6zkk - Load three registers. */
+static uint16_t fused_LDIMM3(cpu_t *cpu, uint32_t *cycles) {
+	fetch_next(cpu, opcode_LDIMM(cpu), cycles);
+	return fused_LDIMM2(cpu, cycles);
+}
+
+/* Fx07, 3x00, 1nnn - Loop until the delay timer reaches 0. */
+static inline uint16_t fused_DELAY_LOOP(cpu_t *cpu, quirks_t quirks, uint32_t *cycles) {
+	fetch_next(cpu, opcode_RDELAY(cpu), cycles);
+	return fused_SE_JMP(cpu, quirks, cycles);
+}
+
+/* 7xkk, 3xkk, 1nnn - Loop until the counter Vx reaches kk. */
+static inline uint16_t fused_COUNTER_LOOP(cpu_t *cpu, quirks_t quirks, uint32_t *cycles) {
+	fetch_next(cpu, opcode_ADDIMM(cpu), cycles);
+	return fused_SE_JMP(cpu, quirks, cycles);
+}
+
+/* 3xkk, 1nnn - Jump if Vx != kk. */
+static inline uint16_t fused_SE_JMP(cpu_t *cpu, quirks_t quirks, uint32_t *cycles) {
+	const uint16_t pc = opcode_SE(cpu, quirks);
+
+	if (pc != NEXT_PC) {
+		return pc; /* The jump is skipped. */
+	}
+
+	fetch_next(cpu, pc, cycles);
+	return opcode_JMP(cpu);
+}
+
+/* 4xkk, 1nnn - Jump if Vx == kk. */
+static inline uint16_t fused_SNE_JMP(cpu_t *cpu, quirks_t quirks, uint32_t *cycles) {
+	const uint16_t pc = opcode_SNE(cpu, quirks);
+
+	if (pc != NEXT_PC) {
+		return pc; /* The jump is skipped. */
+	}
+
+	fetch_next(cpu, pc, cycles);
+	return opcode_JMP(cpu);
+}
+
+static void mark_written(cpu_t *cpu, uint16_t address, uint32_t size) {
+	if (size == 0) {
+		return;
+	}
+
+	/* Addresses wrap around, like the writes. */
+	const uint8_t last = (uint16_t)(address + size - 1) / PAGE_SIZE;
+	for (uint8_t page = address / PAGE_SIZE;; page += 1) {
+		cpu->written_pages[page / 64] |= 1ull << (page % 64);
+		if (page == last) {
+			break;
+		}
+	}
+}
+
+static uint8_t predecode(const cpu_t *cpu, uint16_t address) {
+	const uint16_t first = cpu->memory[address] << 8 | cpu->memory[address + 1];
+	uint16_t second = 0;
+	uint16_t third = 0;
+
+	/* Sequences are only fused if all of their instructions are in RAM, and they
+	 * don't go over a breakpoint.
+	 */
+	if (address <= RAM_SIZE - 4 && (cpu->decoded[address + 2] & DECODED_BREAK) == 0) {
+		second = cpu->memory[address + 2] << 8 | cpu->memory[address + 3];
+	}
+	if (second != 0 && address <= RAM_SIZE - 6
+		&& (cpu->decoded[address + 4] & DECODED_BREAK) == 0) {
+		third = cpu->memory[address + 4] << 8 | cpu->memory[address + 5];
+	}
+
+	const uint8_t x = (first & 0x0F00) >> 8;
+	const bool is_same_x = ((second & 0x0F00) >> 8) == x;
+	const bool is_jump = (third & 0xF000) == 0x1000;
+
+	switch (first & 0xF000) {
+	case 0x3000: /* The skipped jump is 2 bytes long, the skip quirk doesn't matter. */
+		if ((second & 0xF000) == 0x1000) {
+			return DECODED_FUSED + FUSED_SE_JMP;
+		}
+		break;
+	case 0x4000:
+		if ((second & 0xF000) == 0x1000) {
+			return DECODED_FUSED + FUSED_SNE_JMP;
+		}
+		break;
+	case 0x6000:
+		if ((second & 0xF000) == 0x6000) {
+			return (third & 0xF000) == 0x6000 ? DECODED_FUSED + FUSED_LDIMM3
+											  : DECODED_FUSED + FUSED_LDIMM2;
+		}
+		break;
+	case 0x7000:
+		if ((second & 0xF000) == 0x3000 && is_same_x && is_jump) {
+			return DECODED_FUSED + FUSED_COUNTER_LOOP;
+		}
+		break;
+	case 0xA000: /* Dxy0 is a different instruction in SUPER-CHIP. */
+		if ((second & 0xF000) == 0xD000 && (second & 0x000F) != 0) {
+			return DECODED_FUSED + FUSED_LDI_DRAW;
+		}
+		break;
+	case 0xF000:
+		if ((first & 0x00FF) == 0x07 && (second & 0xF0FF) == 0x3000 && is_same_x
+			&& is_jump) {
+			return DECODED_FUSED + FUSED_DELAY_LOOP;
+		}
+		break;
+	}
+
+	return find_opcode(cpu->profile, first);
+}
+
+static uint8_t find_opcode(profile_t profile, uint16_t opcode) {
+	const opcode_t *opcodes = OPCODES[profile];
+
+	for (uint8_t i = 0; i < MAX_OPCODES && opcodes[i].handler != NULL; i += 1) {
+		if ((opcode & opcodes[i].mask) == opcodes[i].opcode) {
+			return i + 1;
+		}
+	}
+
+	return DECODED_NONE;
+}
+
+static inline void fetch_next(cpu_t *cpu, uint16_t pc, uint32_t *cycles) {
+	cpu->PC = pc;
+	opcode_fetch(cpu);
+	*cycles += 1;
+}
+
+static inline uint16_t skip_pc(cpu_t *cpu, quirks_t quirks) {
+	if (!quirks.long_skip) {
+		return cpu->PC + 4;
+	}
+
+	const uint8_t *next = &cpu->memory[(uint16_t)(NEXT_PC)];
+	const uint16_t opcode = next[0] << 8 | next[1];
+
+	return opcode == LONG_LOAD_OPCODE ? cpu->PC + 6 : cpu->PC + 4;
+}
+
+static inline bool is_out_of_bounds(cpu_t *cpu, uint32_t size) {
+	if (cpu->bounds == BOUNDS_TRAP && cpu->I + size > RAM_SIZE) {
+		has_error = true;
+		return true;
+	}
+	return false;
+}
+
+static inline void draw_sprite(cpu_t *cpu, uint8_t rows, uint8_t width, quirks_t quirks) {
+	if (quirks.mega && cpu->is_mega) {
+		draw_mega_sprite(cpu);
+		return;
+	}
+
+	const uint8_t x = cpu->V[cpu->x] % cpu->gfx_width;
+	const uint8_t y = cpu->V[cpu->y] % cpu->gfx_height;
+	const uint8_t bytes_per_row = width / 8;
+	const uint16_t sprite_size = rows * bytes_per_row;
+
+	/* Pixels beyond the right edge are masked out when clipping. */
+	const uint8_t visible = cpu->gfx_width - x;
+	const uint16_t mask = quirks.clip && visible < 16 ? 0xFFFF << (16 - visible) : 0xFFFF;
+
+	/* Rows beyond the bottom edge are skipped when clipping. */
+	if (quirks.clip && y + rows > cpu->gfx_height) {
+		rows = cpu->gfx_height - y;
+	}
+
+	if (is_out_of_bounds(cpu, sprite_size * __builtin_popcount(cpu->planes))) {
+		return;
+	}
+
+	/* Both planes of a sprite fit in the mirror, the rows are read without wrapping. */
+	const uint8_t *sprite = &cpu->memory[cpu->I & RAM_MASK];
+	cpu->V[0xF] = 0; /* Set pixel erased flag to 0. */
+	for (uint8_t plane = 0; plane < GFX_PLANES; plane += 1) {
+		if ((cpu->planes & (1 << plane)) == 0) {
+			continue;
+		}
+
+		/* Each selected plane uses the sprite data following the previous one. */
+		for (uint8_t row = 0; row < rows; row += 1) {
+			const uint8_t *row_data = &sprite[row * bytes_per_row];
+			const uint8_t high = row_data[0];
+			const uint8_t low = bytes_per_row == 2 ? row_data[1] : 0;
+
+			/* Wrap if going beyond screen boundaries. */
+			gfx_row_t *pixels = &cpu->gfx[plane][(y + row) % cpu->gfx_height];
+			if (gfx_xor_row(*pixels, (high << 8 | low) & mask, x, cpu->gfx_width)) {
+				cpu->V[0xF] = 1; /* If pixel is ereased, set flag to 1. */
+			}
+		}
+		sprite += sprite_size;
+	}
+
+	cpu->has_gfx_changed = true;
+}
+
+static void clear_planes(cpu_t *cpu, uint8_t planes) {
+	for (uint8_t plane = 0; plane < GFX_PLANES; plane += 1) {
+		if (planes & (1 << plane)) {
+			memset(cpu->gfx[plane], 0, sizeof(gfx_plane_t));
+		}
+	}
+
+	cpu->has_gfx_changed = true;
+}
+
+static void draw_mega_sprite(cpu_t *cpu) {
+	mega_t *mega = &cpu->mega;
+	const uint8_t x = cpu->V[cpu->x];
+	const uint8_t y = cpu->V[cpu->y];
+
+	/* Sprites are clipped at the screen boundaries. */
+	const uint16_t width = x + mega->sprite_width < MEGA_WIDTH ? mega->sprite_width
+															  : MEGA_WIDTH - x;
+	const uint16_t rows_left = y < MEGA_HEIGHT ? MEGA_HEIGHT - y : 0; /* Vy can be 255. */
+	const uint16_t height = mega->sprite_height < rows_left ? mega->sprite_height
+															: rows_left;
+	uint8_t buffer[MEGA_WIDTH]; /* Used if a row crosses the end of the RAM. */
+
+	cpu->V[0xF] = 0;
+	for (uint16_t row = 0; row < height; row += 1) {
+		const uint32_t address = cpu->I + row * mega->sprite_width;
+		const uint32_t offset = address - ROM_OFFSET;
+		const uint8_t *pixels = buffer;
+
+		if (address + width <= RAM_SIZE) {
+			pixels = &cpu->memory[address];
+		} else if (address >= RAM_SIZE && cpu->rom != NULL
+				   && offset + width <= cpu->rom->size) {
+			pixels = &cpu->rom->content[offset];
+		} else {
+			for (uint16_t i = 0; i < width; i += 1) {
+				buffer[i] = cpu_read_byte(cpu, address + i);
+			}
+		}
+
+		if (mega_blit_row(&mega->gfx[y + row][x], pixels, width, mega->collision_color)) {
+			cpu->V[0xF] = 1;
+		}
+	}
+
+	mega_mark_dirty(mega, x, y, width, height);
+	cpu->has_gfx_changed = true;
+}
@@ -0,0 +1,224 @@
+#include "overlay.h"
+
+#include "log.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GLYPH_WIDTH	  3
+#define GLYPH_HEIGHT  5
+#define CHAR_WIDTH	  (GLYPH_WIDTH + 1)
+#define LINE_HEIGHT	  (GLYPH_HEIGHT + 1)
+#define MARGIN		  2
+#define OVERLAY_SCALE 2 /* Texture pixels are scaled on the screen. */
+#define OVERLAY_X	  4 /* Position on the screen. */
+#define OVERLAY_Y	  4
+
+#define TEXTURE_WIDTH  (MARGIN * 2 + (OVERLAY_LINE_SIZE - 1) * CHAR_WIDTH)
+#define TEXTURE_HEIGHT (MARGIN * 2 + OVERLAY_LINES * LINE_HEIGHT)
+
+#define PERIOD_TIME 1000000 /* Statistics are updated each second. */
+
+/* Text and background colors. */
+#define TEXT_R		 0xFF
+#define TEXT_G		 0xFF
+#define TEXT_B		 0x00
+#define BACKGROUND_A 0xB0
+
+/* Glyphs of the characters used by the statistics, the 3 high bits of each row are
+ * the pixels. Other characters are blank.
+ */
+static const uint8_t font[128][GLYPH_HEIGHT] = {
+	['0'] = { 0xE0, 0xA0, 0xA0, 0xA0, 0xE0 },
+	['1'] = { 0x40, 0xC0, 0x40, 0x40, 0xE0 },
+	['2'] = { 0xE0, 0x20, 0xE0, 0x80, 0xE0 },
+	['3'] = { 0xE0, 0x20, 0xE0, 0x20, 0xE0 },
+	['4'] = { 0xA0, 0xA0, 0xE0, 0x20, 0x20 },
+	['5'] = { 0xE0, 0x80, 0xE0, 0x20, 0xE0 },
+	['6'] = { 0xE0, 0x80, 0xE0, 0xA0, 0xE0 },
+	['7'] = { 0xE0, 0x20, 0x20, 0x40, 0x40 },
+	['8'] = { 0xE0, 0xA0, 0xE0, 0xA0, 0xE0 },
+	['9'] = { 0xE0, 0xA0, 0xE0, 0x20, 0xE0 },
+	['.'] = { 0x00, 0x00, 0x00, 0x00, 0x40 },
+	['%'] = { 0xA0, 0x20, 0x40, 0x80, 0xA0 },
+	['C'] = { 0xE0, 0x80, 0x80, 0x80, 0xE0 },
+	['F'] = { 0xE0, 0x80, 0xE0, 0x80, 0x80 },
+	['I'] = { 0xE0, 0x40, 0x40, 0x40, 0xE0 },
+	['K'] = { 0xA0, 0xA0, 0xC0, 0xA0, 0xA0 },
+	['L'] = { 0x80, 0x80, 0x80, 0x80, 0xE0 },
+	['M'] = { 0xA0, 0xE0, 0xE0, 0xA0, 0xA0 },
+	['P'] = { 0xE0, 0xA0, 0xE0, 0x80, 0x80 },
+	['R'] = { 0xE0, 0xA0, 0xC0, 0xA0, 0xA0 },
+	['S'] = { 0xE0, 0x80, 0xE0, 0x20, 0xE0 },
+	['U'] = { 0xA0, 0xA0, 0xA0, 0xA0, 0xE0 },
+};
+
+static void update_statistics(overlay_t *overlay);
+static int8_t draw_text(overlay_t *overlay);
+static int32_t compare_times(const void *first, const void *second);
+/* Percentage of the period time. */
+static uint32_t percent(const overlay_t *overlay, uint64_t time);
+
+int8_t overlay_init(overlay_t *overlay, display_t *display) {
+	*overlay = (overlay_t){ 0 };
+
+	overlay->texture = SDL_CreateTexture(
+		display->renderer, display->format->format, SDL_TEXTUREACCESS_STREAMING,
+		TEXTURE_WIDTH, TEXTURE_HEIGHT
+	);
+	if (overlay->texture == NULL) {
+		log_error("Unable to create overlay texture: %s", SDL_GetError());
+		return STATUS_ERROR;
+	}
+	SDL_SetTextureBlendMode(overlay->texture, SDL_BLENDMODE_BLEND);
+
+	overlay->text_color = SDL_MapRGBA(display->format, TEXT_R, TEXT_G, TEXT_B, 0xFF);
+	overlay->background_color = SDL_MapRGBA(
+		display->format, BACK_R, BACK_G, BACK_B, BACKGROUND_A
+	);
+	overlay->has_changed = true;
+	return STATUS_OK;
+}
+
+void overlay_quit(overlay_t *overlay) {
+	if (overlay->texture != NULL) {
+		SDL_DestroyTexture(overlay->texture);
+		overlay->texture = NULL;
+	}
+}
+
+void overlay_toggle(overlay_t *overlay) {
+	overlay->is_visible = !overlay->is_visible;
+}
+
+void overlay_add_frame(
+	overlay_t *overlay, uint32_t frame_time, uint32_t upload_time, uint32_t present_time
+) {
+	/* The most recent samples are kept if there are too many frames. */
+	overlay->frame_times[overlay->frames_count % OVERLAY_SAMPLES] = frame_time;
+	overlay->frames_count += 1;
+	overlay->period_time += frame_time;
+	overlay->upload_time += upload_time;
+	overlay->present_time += present_time;
+
+	if (overlay->period_time >= PERIOD_TIME) {
+		update_statistics(overlay);
+	}
+}
+
+void overlay_add_cpu(overlay_t *overlay, uint32_t cpu_time, uint32_t instructions) {
+	overlay->cpu_time += cpu_time;
+	overlay->instructions += instructions;
+}
+
+int8_t overlay_render(overlay_t *overlay, display_t *display) {
+	if (!overlay->is_visible || overlay->texture == NULL) {
+		return STATUS_OK;
+	}
+
+	if (overlay->has_changed && draw_text(overlay) != STATUS_OK) {
+		return STATUS_ERROR;
+	}
+
+	SDL_Rect area = { OVERLAY_X, OVERLAY_Y, TEXTURE_WIDTH, TEXTURE_HEIGHT };
+	area.w *= OVERLAY_SCALE;
+	area.h *= OVERLAY_SCALE;
+	return display_render(display, overlay->texture, NULL, &area);
+}
+
+static void update_statistics(overlay_t *overlay) {
+	const uint32_t samples = overlay->frames_count < OVERLAY_SAMPLES
+							   ? overlay->frames_count
+							   : OVERLAY_SAMPLES;
+	const uint64_t rate = overlay->instructions * PERIOD_TIME / overlay->period_time;
+
+	qsort(overlay->frame_times, samples, sizeof(uint32_t), compare_times);
+	const uint32_t median = overlay->frame_times[samples / 2];
+	const uint32_t slowest = overlay->frame_times[samples * 99 / 100];
+
+	snprintf(
+		overlay->lines[0], OVERLAY_LINE_SIZE, "FPS %u",
+		(uint32_t)(overlay->frames_count * PERIOD_TIME / overlay->period_time)
+	);
+	if (rate >= 1000000) {
+		snprintf(overlay->lines[1], OVERLAY_LINE_SIZE, "IPS %.2fM", rate / 1000000.0);
+	} else if (rate >= 1000) {
+		snprintf(
+			overlay->lines[1], OVERLAY_LINE_SIZE, "IPS %uK", (uint32_t)(rate / 1000)
+		);
+	} else {
+		snprintf(overlay->lines[1], OVERLAY_LINE_SIZE, "IPS %u", (uint32_t)rate);
+	}
+	/* Frame times are shown in milliseconds. */
+	snprintf(
+		overlay->lines[2], OVERLAY_LINE_SIZE, "P50 %.1f P99 %.1f", median / 1000.0,
+		slowest / 1000.0
+	);
+	snprintf(
+		overlay->lines[3], OVERLAY_LINE_SIZE, "CPU %u%% UPL %u%% PRS %u%%",
+		percent(overlay, overlay->cpu_time), percent(overlay, overlay->upload_time),
+		percent(overlay, overlay->present_time)
+	);
+
+	overlay->frames_count = 0;
+	overlay->period_time = 0;
+	overlay->cpu_time = 0;
+	overlay->upload_time = 0;
+	overlay->present_time = 0;
+	overlay->instructions = 0;
+	overlay->has_changed = true;
+}
+
+static int8_t draw_text(overlay_t *overlay) {
+	void *pixels = NULL;
+	int32_t pitch = 0;
+
+	if (SDL_LockTexture(overlay->texture, NULL, &pixels, &pitch) < 0) {
+		log_error("Unable to lock overlay texture: %s", SDL_GetError());
+		return STATUS_ERROR;
+	}
+
+	for (int32_t y = 0; y < TEXTURE_HEIGHT; y += 1) {
+		uint32_t *row = (uint32_t *)((uint8_t *)pixels + y * pitch);
+
+		for (int32_t x = 0; x < TEXTURE_WIDTH; x += 1) {
+			row[x] = overlay->background_color;
+		}
+	}
+
+	for (uint8_t line = 0; line < OVERLAY_LINES; line += 1) {
+		const char *text = overlay->lines[line];
+
+		for (uint8_t i = 0; text[i] != '\0'; i += 1) {
+			const uint8_t *glyph = font[text[i] & 0x7F];
+
+			for (uint8_t y = 0; y < GLYPH_HEIGHT; y += 1) {
+				const int32_t top = MARGIN + line * LINE_HEIGHT + y;
+				uint32_t *row = (uint32_t *)((uint8_t *)pixels + top * pitch);
+
+				for (uint8_t x = 0; x < GLYPH_WIDTH; x += 1) {
+					if (glyph[y] & (0x80 >> x)) {
+						row[MARGIN + i * CHAR_WIDTH + x] = overlay->text_color;
+					}
+				}
+			}
+		}
+	}
+	SDL_UnlockTexture(overlay->texture);
+
+	overlay->has_changed = false;
+	return STATUS_OK;
+}
+
+static int32_t compare_times(const void *first, const void *second) {
+	const uint32_t a = *(const uint32_t *)first;
+	const uint32_t b = *(const uint32_t *)second;
+
+	return (a > b) - (a < b);
+}
+
+static uint32_t percent(const overlay_t *overlay, uint64_t time) {
+	return time * 100 / overlay->period_time;
+}
@@ -0,0 +1,133 @@
+#include "phosphor.h"
+
+#include <string.h>
+
+#define VECTOR_PIXELS 16 /* Intensities in a SSE2 or NEON register. */
+#define FULL_LEVEL	  (PHOSPHOR_LEVELS - 1)
+#define BYTES_ONES	  0x0101010101010101ull /* Multiplier repeating a byte. */
+
+typedef uint8_t bytes_t __attribute__((vector_size(VECTOR_PIXELS)));
+typedef uint16_t words_t __attribute__((vector_size(VECTOR_PIXELS * 2)));
+typedef uint64_t halves_t __attribute__((vector_size(VECTOR_PIXELS)));
+
+/* Bit of each pixel in the byte of the planes holding it, leftmost pixel first. */
+static const bytes_t pixel_bits = {
+	0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+	0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+};
+
+static inline bytes_t load(const uint8_t *bytes) {
+	bytes_t vector;
+
+	memcpy(&vector, bytes, sizeof(vector));
+	return vector;
+}
+
+static inline void store(uint8_t *bytes, bytes_t vector) {
+	memcpy(bytes, &vector, sizeof(vector));
+}
+
+/* Return 0xFF for the pixels set in the 16 bits, leftmost pixel in the high bit. */
+static inline bytes_t expand_bits(uint16_t bits) {
+	const halves_t halves = { (bits >> 8) * BYTES_ONES, (bits & 0xFF) * BYTES_ONES };
+	const bytes_t bytes = (bytes_t)halves;
+
+	return (bytes_t)((bytes & pixel_bits) != 0);
+}
+
+void phosphor_init(phosphor_t *phosphor, uint8_t percent) {
+	percent = percent > 99 ? 99 : percent;
+	*phosphor = (phosphor_t){
+		.width = GFX_LORES_WIDTH,
+		.height = GFX_LORES_HEIGHT,
+		.decay = percent * 256 / 100,
+		.is_settled = true,
+	};
+}
+
+void phosphor_step(
+	phosphor_t *phosphor, gfx_plane_t *planes, uint8_t width, uint8_t height,
+	uint32_t ticks
+) {
+	bytes_t fading = { 0 }; /* Pixels neither dark nor fully lit. */
+	uint16_t kept = 256;
+
+	if (width != phosphor->width || height != phosphor->height) {
+		memset(phosphor->intensity, 0, sizeof(phosphor->intensity));
+		phosphor->width = width;
+		phosphor->height = height;
+	}
+
+	/* Decay of all the ticks at once, it is 0 after a few of them. */
+	for (uint32_t tick = 0; tick < ticks && kept > 0; tick += 1) {
+		kept = kept * phosphor->decay / 256;
+	}
+
+	for (uint8_t plane = 0; plane < GFX_PLANES; plane += 1) {
+		for (uint8_t y = 0; y < height; y += 1) {
+			uint8_t *line = phosphor->intensity[plane][y];
+
+			for (uint8_t x = 0; x < width; x += VECTOR_PIXELS) {
+				const uint8_t shift = GFX_WORD_BITS - VECTOR_PIXELS - x % GFX_WORD_BITS;
+				const uint64_t word = planes[plane][y][x / GFX_WORD_BITS];
+				const words_t wide = __builtin_convertvector(load(line + x), words_t);
+				const words_t faded = (wide * kept) >> 8;
+				const bytes_t lit = expand_bits(word >> shift);
+				const bytes_t intensity = __builtin_convertvector(faded, bytes_t) | lit;
+
+				fading |= (bytes_t)((intensity != 0) & (intensity != 0xFF));
+				store(line + x, intensity);
+			}
+		}
+	}
+
+	const halves_t halves = (halves_t)fading;
+	phosphor->is_settled = (halves[0] | halves[1]) == 0;
+}
+
+void phosphor_colors(
+	const phosphor_t *phosphor, const uint32_t ramp[PHOSPHOR_RAMP_SIZE],
+	uint32_t *pixels, int32_t pitch
+) {
+	for (uint8_t y = 0; y < phosphor->height; y += 1) {
+		const uint8_t *first = phosphor->intensity[0][y];
+		const uint8_t *second = phosphor->intensity[1][y];
+		uint32_t *line = (uint32_t *)((uint8_t *)pixels + y * pitch);
+
+		for (uint8_t x = 0; x < phosphor->width; x += VECTOR_PIXELS) {
+			const bytes_t indexes = (load(first + x) >> 4) | (load(second + x) & 0xF0);
+
+			for (uint8_t i = 0; i < VECTOR_PIXELS; i += 1) {
+				line[x + i] = ramp[indexes[i]];
+			}
+		}
+	}
+}
+
+void phosphor_ramp(
+	uint8_t ramp[PHOSPHOR_RAMP_SIZE][3], const uint8_t colors[PHOSPHOR_COLORS][3]
+) {
+	const uint32_t total = FULL_LEVEL * FULL_LEVEL;
+
+	for (uint32_t second = 0; second < PHOSPHOR_LEVELS; second += 1) {
+		for (uint32_t first = 0; first < PHOSPHOR_LEVELS; first += 1) {
+			/* Bilinear blend, each color is weighted by the levels of its planes. */
+			const uint32_t weights[PHOSPHOR_COLORS] = {
+				(FULL_LEVEL - first) * (FULL_LEVEL - second),
+				first * (FULL_LEVEL - second),
+				(FULL_LEVEL - first) * second,
+				first * second,
+			};
+			uint8_t *color = ramp[first + second * PHOSPHOR_LEVELS];
+
+			for (uint8_t component = 0; component < 3; component += 1) {
+				uint32_t sum = total / 2;
+
+				for (uint8_t i = 0; i < PHOSPHOR_COLORS; i += 1) {
+					sum += weights[i] * colors[i][component];
+				}
+				color[component] = sum / total;
+			}
+		}
+	}
+}
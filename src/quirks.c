@@ -0,0 +1,40 @@
+#include "quirks.h"
+
+#include <string.h>
+
+static const char *profile_names[PROFILE_COUNT] = {
+	[PROFILE_VIP] = "vip",
+	[PROFILE_CHIP48] = "chip48",
+	[PROFILE_SCHIP] = "schip",
+	[PROFILE_XOCHIP] = "xochip",
+	[PROFILE_MEGACHIP] = "megachip",
+};
+
+profile_t quirks_find_profile(const char *name) {
+	for (profile_t profile = 0; profile < PROFILE_COUNT; profile += 1) {
+		if (strcmp(profile_names[profile], name) == 0) {
+			return profile;
+		}
+	}
+
+	return PROFILE_COUNT;
+}
+
+const char *quirks_profile_name(profile_t profile) {
+	return profile < PROFILE_COUNT ? profile_names[profile] : "unknown";
+}
+
+quirks_t quirks_of(profile_t profile) {
+	switch (profile) {
+	case PROFILE_VIP:
+		return QUIRKS_VIP;
+	case PROFILE_CHIP48:
+		return QUIRKS_CHIP48;
+	case PROFILE_SCHIP:
+		return QUIRKS_SCHIP;
+	case PROFILE_MEGACHIP:
+		return QUIRKS_MEGACHIP;
+	default:
+		return QUIRKS_XOCHIP;
+	}
+}
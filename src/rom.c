@@ -0,0 +1,185 @@
+#include "rom.h"
+
+#include "log.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#define STREAM_CHUNK_SIZE 0x10000 /* 64 KiB */
+
+static rom_t *create_rom(const uint8_t *content, uint32_t size, rom_source_t source);
+#ifndef _WIN32
+static rom_t *map_file(const char *filepath);
+#endif
+static rom_t *read_stream(FILE *stream);
+
+rom_t *rom_open(const char *filepath) {
+	if (strcmp(filepath, ROM_STDIN) == 0) {
+		return read_stream(stdin);
+	}
+
+#ifndef _WIN32
+	return map_file(filepath);
+#else
+	FILE *file = fopen(filepath, "rb");
+	if (file == NULL) {
+		log_error("Unable to open rom: %s", filepath);
+		return NULL;
+	}
+
+	rom_t *rom = read_stream(file);
+	fclose(file);
+	return rom;
+#endif
+}
+
+rom_t *rom_from_buffer(const uint8_t *buffer, uint32_t size) {
+	if (size > ROM_MAX_SIZE) {
+		log_error("Rom size is bigger than max rom size!");
+		return NULL;
+	}
+
+	return create_rom(buffer, size, ROM_BORROWED);
+}
+
+rom_t *rom_retain(rom_t *rom) {
+	SDL_AtomicAdd(&rom->references, 1);
+	return rom;
+}
+
+void rom_release(rom_t *rom) {
+	if (rom == NULL || SDL_AtomicAdd(&rom->references, -1) != 1) {
+		return; /* Still used by someone else. */
+	}
+
+	switch (rom->source) {
+	case ROM_MAPPED:
+#ifndef _WIN32
+		munmap((void *)rom->content, rom->mapped_size);
+#endif
+		break;
+	case ROM_ALLOCATED:
+		free((void *)rom->content);
+		break;
+	case ROM_BORROWED:
+		break;
+	}
+
+	free(rom);
+}
+
+static rom_t *create_rom(const uint8_t *content, uint32_t size, rom_source_t source) {
+	rom_t *rom = malloc(sizeof(rom_t));
+	if (rom == NULL) {
+		log_error("Unable to allocate memory for rom.");
+		return NULL;
+	}
+
+	rom->content = content;
+	rom->size = size;
+	rom->source = source;
+	rom->mapped_size = 0;
+	SDL_AtomicSet(&rom->references, 1);
+	return rom;
+}
+
+#ifndef _WIN32
+static rom_t *map_file(const char *filepath) {
+	const int32_t fd = open(filepath, O_RDONLY);
+	struct stat info;
+
+	if (fd < 0) {
+		log_error("Unable to open rom: %s", filepath);
+		return NULL;
+	}
+
+	if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) {
+		/* Pipes and devices can't be mapped, read them like the standard input. */
+		FILE *stream = fdopen(fd, "rb");
+		rom_t *rom = stream != NULL ? read_stream(stream) : NULL;
+		if (stream != NULL) {
+			fclose(stream);
+		} else {
+			close(fd);
+		}
+		return rom;
+	}
+
+	if (info.st_size > ROM_MAX_SIZE) {
+		log_error("Rom file size is bigger than max rom size!");
+		close(fd);
+		return NULL;
+	}
+
+	/* Empty files can't be mapped. */
+	if (info.st_size == 0) {
+		close(fd);
+		return create_rom(NULL, 0, ROM_BORROWED);
+	}
+
+	void *content = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); /* The mapping keeps the file open. */
+	if (content == MAP_FAILED) {
+		log_error("Unable to map rom: %s", filepath);
+		return NULL;
+	}
+
+	rom_t *rom = create_rom(content, info.st_size, ROM_MAPPED);
+	if (rom == NULL) {
+		munmap(content, info.st_size);
+		return NULL;
+	}
+
+	rom->mapped_size = info.st_size;
+	return rom;
+}
+#endif
+
+static rom_t *read_stream(FILE *stream) {
+	uint8_t *content = NULL;
+	size_t capacity = 0;
+	size_t size = 0;
+
+	/* Capacity is doubled, so the content is reallocated only a few times. */
+	while (!feof(stream) && size <= ROM_MAX_SIZE) {
+		if (size == capacity) {
+			capacity = capacity == 0 ? STREAM_CHUNK_SIZE : capacity * 2;
+
+			uint8_t *new_content = realloc(content, capacity);
+			if (new_content == NULL) {
+				log_error("Cannot realloc memory for: %zu bytes", capacity);
+				free(content);
+				return NULL;
+			}
+			content = new_content;
+		}
+
+		size += fread(content + size, sizeof(uint8_t), capacity - size, stream);
+		if (ferror(stream) != 0) {
+			log_error("An error occurried while reading rom.");
+			free(content);
+			return NULL;
+		}
+	}
+
+	if (size > ROM_MAX_SIZE) {
+		log_error("Rom size is bigger than max rom size!");
+		free(content);
+		return NULL;
+	}
+
+	rom_t *rom = create_rom(content, size, ROM_ALLOCATED);
+	if (rom == NULL) {
+		free(content);
+	}
+	return rom;
+}
@@ -0,0 +1,129 @@
+#include "romdb.h"
+
+#include "log.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325
+#define FNV_PRIME		 0x100000001B3
+
+static romdb_entry_t *entries = NULL; /* Sorted by hash. */
+static uint32_t entries_count = 0;
+
+static uint16_t read_u16(const uint8_t *bytes);
+static uint32_t read_u32(const uint8_t *bytes);
+static uint64_t read_u64(const uint8_t *bytes);
+static int32_t compare_entries(const void *first, const void *second);
+
+int8_t romdb_load(const char *filepath) {
+	uint8_t header[ROMDB_HEADER_SIZE];
+	uint8_t record[ROMDB_ENTRY_SIZE];
+	FILE *file = fopen(filepath, "rb");
+
+	if (file == NULL) {
+		log_info("No rom database found at: %s", filepath);
+		return STATUS_ERROR;
+	}
+
+	if (fread(header, sizeof(header), 1, file) != 1
+		|| memcmp(header, ROMDB_MAGIC, 4) != 0 || read_u16(&header[4]) != ROMDB_VERSION) {
+		log_error("Invalid rom database: %s", filepath);
+		fclose(file);
+		return STATUS_ERROR;
+	}
+
+	const uint32_t count = read_u32(&header[8]);
+	romdb_entry_t *loaded = calloc(count, sizeof(romdb_entry_t));
+	if (loaded == NULL && count > 0) {
+		log_error("Unable to allocate memory for %d rom database entries.", count);
+		fclose(file);
+		return STATUS_ERROR;
+	}
+
+	for (uint32_t i = 0; i < count; i += 1) {
+		if (fread(record, sizeof(record), 1, file) != 1) {
+			log_error("Rom database is truncated: %s", filepath);
+			free(loaded);
+			fclose(file);
+			return STATUS_ERROR;
+		}
+
+		romdb_entry_t *entry = &loaded[i];
+		entry->hash = read_u64(&record[0]);
+		entry->profile = record[8] < PROFILE_COUNT ? record[8] : DEFAULT_PROFILE;
+		entry->clock_speed = read_u16(&record[10]);
+		for (uint8_t key = 0; key < KEYS_COUNT; key += 1) {
+			entry->keymap[key] = read_u16(&record[12 + key * 2]);
+		}
+	}
+	fclose(file);
+
+	/* The index should already be sorted, then this is cheap. */
+	qsort(loaded, count, sizeof(romdb_entry_t), compare_entries);
+
+	romdb_free();
+	entries = loaded;
+	entries_count = count;
+
+	log_info("Loaded %d entries from rom database.", count);
+	return STATUS_OK;
+}
+
+void romdb_free(void) {
+	free(entries);
+	entries = NULL;
+	entries_count = 0;
+}
+
+const romdb_entry_t *romdb_find(uint64_t hash) {
+	uint32_t low = 0;
+	uint32_t high = entries_count;
+
+	/* Binary search. */
+	while (low < high) {
+		const uint32_t middle = low + (high - low) / 2;
+
+		if (entries[middle].hash == hash) {
+			return &entries[middle];
+		} else if (entries[middle].hash < hash) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return NULL;
+}
+
+uint64_t romdb_hash(const uint8_t *content, uint32_t size) {
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	for (uint32_t i = 0; i < size; i += 1) {
+		hash ^= content[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+static uint16_t read_u16(const uint8_t *bytes) {
+	return bytes[0] | bytes[1] << 8;
+}
+
+static uint32_t read_u32(const uint8_t *bytes) {
+	return read_u16(bytes) | (uint32_t)read_u16(&bytes[2]) << 16;
+}
+
+static uint64_t read_u64(const uint8_t *bytes) {
+	return read_u32(bytes) | (uint64_t)read_u32(&bytes[4]) << 32;
+}
+
+static int32_t compare_entries(const void *first, const void *second) {
+	const uint64_t first_hash = ((const romdb_entry_t *)first)->hash;
+	const uint64_t second_hash = ((const romdb_entry_t *)second)->hash;
+
+	return (first_hash > second_hash) - (first_hash < second_hash);
+}
@@ -0,0 +1,216 @@
+#include "scaler.h"
+
+#include <string.h>
+
+#define VECTOR_PIXELS 4 /* Pixels in a SSE2 or NEON register. */
+#define BORDER		  VECTOR_PIXELS /* Keeps the image rows aligned. */
+#define IMAGE_PITCH	  (GFX_WIDTH + BORDER * 2)
+#define NEAREST_SIZE  4
+
+typedef uint32_t vector_t __attribute__((vector_size(VECTOR_PIXELS * 4)));
+typedef int32_t mask_t __attribute__((vector_size(VECTOR_PIXELS * 4)));
+
+/* Neighbours of 4 pixels, named as in the Scale2x description:
+ * A B C
+ * D E F
+ * G H I
+ */
+typedef struct {
+	vector_t a, b, c, d, e, f, g, h, i;
+} neighbours_t;
+
+typedef void (*kernel_t)(const neighbours_t *n, uint32_t *output, int32_t pitch);
+
+static const char *scaler_names[SCALER_COUNT] = {
+	[SCALER_NONE] = "none",
+	[SCALER_NEAREST] = "nearest",
+	[SCALER_SCALE2X] = "scale2x",
+	[SCALER_SCALE3X] = "scale3x",
+	[SCALER_EPX] = "epx",
+};
+
+static const uint8_t scaler_factors[SCALER_COUNT] = {
+	[SCALER_NONE] = 1,
+	[SCALER_NEAREST] = NEAREST_SIZE,
+	[SCALER_SCALE2X] = 2,
+	[SCALER_SCALE3X] = 3,
+	[SCALER_EPX] = 2,
+};
+
+/* Write the scaled pixels of the neighbourhood centers, from the first output row. */
+static void scale_nearest(const neighbours_t *n, uint32_t *output, int32_t pitch);
+static void scale_2x(const neighbours_t *n, uint32_t *output, int32_t pitch);
+static void scale_3x(const neighbours_t *n, uint32_t *output, int32_t pitch);
+static void scale_epx(const neighbours_t *n, uint32_t *output, int32_t pitch);
+
+static const kernel_t kernels[SCALER_COUNT] = {
+	[SCALER_NEAREST] = scale_nearest,
+	[SCALER_SCALE2X] = scale_2x,
+	[SCALER_SCALE3X] = scale_3x,
+	[SCALER_EPX] = scale_epx,
+};
+
+static inline vector_t load(const uint32_t *pixels) {
+	vector_t vector;
+
+	memcpy(&vector, pixels, sizeof(vector)); /* Unaligned load. */
+	return vector;
+}
+
+static inline void store(uint32_t *pixels, vector_t vector) {
+	memcpy(pixels, &vector, sizeof(vector));
+}
+
+static inline vector_t pick(mask_t mask, vector_t a, vector_t b) {
+	return (a & (vector_t)mask) | (b & ~(vector_t)mask);
+}
+
+static inline uint32_t *row_at(uint32_t *output, int32_t pitch, uint32_t row) {
+	return (uint32_t *)((uint8_t *)output + row * pitch);
+}
+
+scaler_t scaler_find(const char *name) {
+	for (scaler_t scaler = 0; scaler < SCALER_COUNT; scaler += 1) {
+		if (strcmp(scaler_names[scaler], name) == 0) {
+			return scaler;
+		}
+	}
+
+	return SCALER_COUNT;
+}
+
+const char *scaler_name(scaler_t scaler) {
+	return scaler < SCALER_COUNT ? scaler_names[scaler] : "unknown";
+}
+
+uint8_t scaler_factor(scaler_t scaler) {
+	return scaler < SCALER_COUNT ? scaler_factors[scaler] : 1;
+}
+
+void scaler_scale(
+	scaler_t scaler, const uint32_t *pixels, uint8_t width, uint8_t height,
+	uint32_t *output, int32_t pitch
+) {
+	/* Copy with a border of edge pixels, so neighbours are loaded without checks. */
+	uint32_t image[GFX_HEIGHT + 2][IMAGE_PITCH];
+	const uint8_t factor = scaler_factor(scaler);
+	const kernel_t kernel = kernels[scaler < SCALER_COUNT ? scaler : SCALER_NONE];
+
+	for (uint8_t y = 0; y < height; y += 1) {
+		uint32_t *row = &image[y + 1][BORDER];
+
+		memcpy(row, &pixels[y * width], width * sizeof(uint32_t));
+		row[-1] = row[0];
+		row[width] = row[width - 1];
+	}
+	memcpy(image[0], image[1], sizeof(image[0]));
+	memcpy(image[height + 1], image[height], sizeof(image[0]));
+
+	for (uint8_t y = 0; y < height; y += 1) {
+		uint32_t *line = row_at(output, pitch, y * factor);
+
+		for (uint8_t x = 0; x < width; x += VECTOR_PIXELS) {
+			const uint32_t *above = &image[y][BORDER + x];
+			const uint32_t *center = &image[y + 1][BORDER + x];
+			const uint32_t *below = &image[y + 2][BORDER + x];
+
+			if (kernel == NULL) {
+				store(line + x, load(center));
+				continue;
+			}
+
+			const neighbours_t n = {
+				load(above - 1),  load(above),	load(above + 1),
+				load(center - 1), load(center), load(center + 1),
+				load(below - 1),  load(below),	load(below + 1),
+			};
+			kernel(&n, line + x * factor, pitch);
+		}
+	}
+}
+
+static void scale_nearest(const neighbours_t *n, uint32_t *output, int32_t pitch) {
+	const vector_t e = n->e;
+
+	store(output, __builtin_shufflevector(e, e, 0, 0, 0, 0));
+	store(output + 4, __builtin_shufflevector(e, e, 1, 1, 1, 1));
+	store(output + 8, __builtin_shufflevector(e, e, 2, 2, 2, 2));
+	store(output + 12, __builtin_shufflevector(e, e, 3, 3, 3, 3));
+
+	for (uint8_t row = 1; row < NEAREST_SIZE; row += 1) {
+		memcpy(row_at(output, pitch, row), output, NEAREST_SIZE * VECTOR_PIXELS * 4);
+	}
+}
+
+/* Interleave the pixels of 2 or 3 vectors, as they are next to each other. */
+static inline void store_2(uint32_t *output, vector_t first, vector_t second) {
+	store(output, __builtin_shufflevector(first, second, 0, 4, 1, 5));
+	store(output + 4, __builtin_shufflevector(first, second, 2, 6, 3, 7));
+}
+
+static inline void store_3(
+	uint32_t *output, vector_t first, vector_t second, vector_t third
+) {
+	const vector_t low = __builtin_shufflevector(first, second, 0, 4, 1, 5);
+	const vector_t high = __builtin_shufflevector(first, second, 2, 6, 3, 7);
+	const vector_t middle = __builtin_shufflevector(low, high, 3, 3, 4, 5);
+
+	store(output, __builtin_shufflevector(low, third, 0, 1, 4, 2));
+	store(output + 4, __builtin_shufflevector(middle, third, 0, 5, 2, 3));
+	store(output + 8, __builtin_shufflevector(high, third, 6, 2, 3, 7));
+}
+
+static void scale_2x(const neighbours_t *n, uint32_t *output, int32_t pitch) {
+	const mask_t top_left = (n->d == n->b) & (n->b != n->f) & (n->d != n->h);
+	const mask_t top_right = (n->b == n->f) & (n->b != n->d) & (n->f != n->h);
+	const mask_t bottom_left = (n->d == n->h) & (n->d != n->b) & (n->h != n->f);
+	const mask_t bottom_right = (n->h == n->f) & (n->d != n->h) & (n->b != n->f);
+
+	store_2(output, pick(top_left, n->d, n->e), pick(top_right, n->f, n->e));
+	store_2(
+		row_at(output, pitch, 1), pick(bottom_left, n->d, n->e),
+		pick(bottom_right, n->f, n->e)
+	);
+}
+
+static void scale_3x(const neighbours_t *n, uint32_t *output, int32_t pitch) {
+	const vector_t e = n->e;
+	const mask_t top_left = (n->d == n->b) & (n->d != n->h) & (n->b != n->f);
+	const mask_t top_right = (n->b == n->f) & (n->b != n->d) & (n->f != n->h);
+	const mask_t bottom_left = (n->d == n->h) & (n->d != n->b) & (n->h != n->f);
+	const mask_t bottom_right = (n->h == n->f) & (n->d != n->h) & (n->b != n->f);
+
+	/* Edges take the neighbour color only if it does not cut a corner. */
+	const mask_t top = (top_left & (e != n->c)) | (top_right & (e != n->a));
+	const mask_t left = (top_left & (e != n->g)) | (bottom_left & (e != n->a));
+	const mask_t right = (top_right & (e != n->i)) | (bottom_right & (e != n->c));
+	const mask_t bottom = (bottom_left & (e != n->i)) | (bottom_right & (e != n->g));
+
+	store_3(
+		output, pick(top_left, n->d, e), pick(top, n->b, e), pick(top_right, n->f, e)
+	);
+	store_3(row_at(output, pitch, 1), pick(left, n->d, e), e, pick(right, n->f, e));
+	store_3(
+		row_at(output, pitch, 2), pick(bottom_left, n->d, e), pick(bottom, n->h, e),
+		pick(bottom_right, n->f, e)
+	);
+}
+
+static void scale_epx(const neighbours_t *n, uint32_t *output, int32_t pitch) {
+	const vector_t e = n->e;
+
+	/* Where 3 or 4 of the neighbours are the same, the pixel is kept whole. */
+	const mask_t keep = ((n->b == n->f) & (n->b == n->d))
+					  | ((n->b == n->f) & (n->b == n->h))
+					  | ((n->b == n->d) & (n->b == n->h))
+					  | ((n->f == n->d) & (n->f == n->h));
+
+	store_2(
+		output, pick((n->d == n->b) & ~keep, n->b, e),
+		pick((n->b == n->f) & ~keep, n->f, e)
+	);
+	store_2(
+		row_at(output, pitch, 1), pick((n->h == n->d) & ~keep, n->d, e),
+		pick((n->f == n->h) & ~keep, n->h, e)
+	);
+}
@@ -0,0 +1,92 @@
+#include "shared.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_TRIES 64
+
+void shared_name(char name[SHARED_NAME_SIZE], int32_t pid) {
+	snprintf(name, SHARED_NAME_SIZE, SHARED_PREFIX "%d", pid);
+}
+
+bool shared_attach(shared_reader_t *reader, const char *name) {
+	*reader = (shared_reader_t){ 0 };
+
+	const int32_t fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return false;
+	}
+
+	/* Reading past the end of a shorter segment would raise SIGBUS. */
+	struct stat status;
+	if (fstat(fd, &status) != 0) {
+		const int32_t error = errno;
+		close(fd);
+		errno = error;
+		return false;
+	}
+	if (status.st_size < (off_t)sizeof(shared_segment_t)) {
+		close(fd);
+		errno = EPROTO;
+		return false;
+	}
+
+	/* The segment is kept mapped after the descriptor is closed. */
+	void *segment = mmap(NULL, sizeof(shared_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+	const int32_t error = errno;
+	close(fd);
+	if (segment == MAP_FAILED) {
+		errno = error;
+		return false;
+	}
+
+	/* The writer sets the magic last, once the rest of the header is written. */
+	const shared_segment_t *header = segment;
+	if (header->magic != SHARED_MAGIC || header->version != SHARED_VERSION
+		|| header->size != sizeof(shared_segment_t)) {
+		munmap(segment, sizeof(shared_segment_t));
+		errno = EPROTO;
+		return false;
+	}
+
+	reader->segment = header;
+	return true;
+}
+
+void shared_detach(shared_reader_t *reader) {
+	if (reader->segment != NULL) {
+		munmap((void *)reader->segment, sizeof(shared_segment_t));
+		reader->segment = NULL;
+	}
+}
+
+bool shared_read(const shared_reader_t *reader, shared_state_t *state) {
+	const shared_segment_t *segment = reader->segment;
+
+	for (uint32_t i = 0; i < READ_TRIES; i += 1) {
+		const uint32_t sequence = atomic_load_explicit(
+			&segment->sequence, memory_order_acquire
+		);
+		if ((sequence & 1) != 0) {
+			sched_yield(); /* The writer is in the middle of a frame. */
+			continue;
+		}
+
+		memcpy(state, &segment->state, sizeof(shared_state_t));
+
+		/* The copy is done before checking that the writer did not come back. */
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&segment->sequence, memory_order_relaxed) == sequence) {
+			return true;
+		}
+	}
+
+	errno = EAGAIN;
+	return false;
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Build the binary rom database index read by src/romdb.c.
+
+Each line of the input lists a rom and its settings, '#' starts a comment:
+    <rom path | 0x hash> <profile> <clock speed> [16 SDL scancodes, 0 keeps default]
+
+Usage: mkromdb.py <input.txt> <output.db>
+"""
+
+import struct
+import sys
+
+PROFILES = ["vip", "chip48", "schip", "xochip", "megachip"]
+KEYS_COUNT = 16
+
+
+def fnv1a(content):
+    value = 0xCBF29CE484222325
+    for byte in content:
+        value = ((value ^ byte) * 0x100000001B3) & 0xFFFFFFFFFFFFFFFF
+    return value
+
+
+def parse_line(line):
+    fields = line.split()
+    if fields[0].startswith("0x"):
+        rom_hash = int(fields[0], 16)
+    else:
+        with open(fields[0], "rb") as rom:
+            rom_hash = fnv1a(rom.read())
+
+    profile = PROFILES.index(fields[1])
+    clock = int(fields[2])
+    keymap = [int(code) for code in fields[3:]] or [0] * KEYS_COUNT
+    if len(keymap) != KEYS_COUNT:
+        raise ValueError(f"expected {KEYS_COUNT} scancodes: {line}")
+
+    return struct.pack(f"<QBxH{KEYS_COUNT}H", rom_hash, profile, clock, *keymap)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+
+    entries = []
+    with open(sys.argv[1]) as text:
+        for line in text:
+            line = line.split("#")[0].strip()
+            if line:
+                entries.append(parse_line(line))
+
+    entries.sort(key=lambda entry: struct.unpack_from("<Q", entry)[0])
+    with open(sys.argv[2], "wb") as index:
+        index.write(b"C8DB" + struct.pack("<HxxI", 1, len(entries)))
+        index.writelines(entries)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,123 @@
+/* Show the state exported by a running emulator started with "--export".
+ *
+ * Usage: chip8-view            list the running emulators
+ *        chip8-view <pid>      print the registers and the screen of the latest frame
+ *        chip8-view <pid> -w   print every new frame until the emulator exits
+ */
+
+#include "shared.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SHM_DIRECTORY "/dev/shm" /* Where Linux keeps the segments. */
+#define WATCH_DELAY	  16000		 /* Microseconds between polls, about one frame. */
+
+/* Characters of the pixels, indexed by the bits of both planes. */
+static const char pixels[4] = { ' ', '#', '+', '@' };
+
+static int32_t list_emulators(void);
+static void print_state(const shared_state_t *state);
+
+int main(int argc, char *argv[]) {
+	shared_reader_t reader;
+	shared_state_t state;
+	char name[SHARED_NAME_SIZE];
+
+	if (argc < 2) {
+		return list_emulators();
+	}
+
+	const bool is_watching = argc > 2 && strcmp(argv[2], "-w") == 0;
+	shared_name(name, atoi(argv[1]));
+	if (!shared_attach(&reader, name)) {
+		fprintf(stderr, "Unable to attach to %s: %s\n", name, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	uint64_t frame = 0;
+	do {
+		if (!shared_read(&reader, &state)) {
+			if (is_watching) {
+				continue; /* The emulator is busy, try again at the next poll. */
+			}
+			fprintf(stderr, "Unable to read %s: %s\n", name, strerror(errno));
+			shared_detach(&reader);
+			return EXIT_FAILURE;
+		}
+
+		if (state.frame != frame) {
+			print_state(&state);
+			frame = state.frame;
+		}
+		if (state.has_exited) {
+			break;
+		}
+	} while (is_watching && usleep(WATCH_DELAY) == 0);
+
+	shared_detach(&reader);
+	return EXIT_SUCCESS;
+}
+
+static int32_t list_emulators(void) {
+	const char *prefix = SHARED_PREFIX + 1; /* File names have no leading slash. */
+	DIR *directory = opendir(SHM_DIRECTORY);
+
+	if (directory == NULL) {
+		fprintf(stderr, "Unable to list %s: %s\n", SHM_DIRECTORY, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (struct dirent *entry = readdir(directory); entry != NULL;
+		 entry = readdir(directory)) {
+		if (strncmp(entry->d_name, prefix, strlen(prefix)) == 0) {
+			printf("%s\n", entry->d_name + strlen(prefix));
+		}
+	}
+
+	closedir(directory);
+	return EXIT_SUCCESS;
+}
+
+static void print_state(const shared_state_t *state) {
+	printf(
+		"frame %llu, %llu instructions\n", (unsigned long long)state->frame,
+		(unsigned long long)state->instructions
+	);
+	printf(
+		"PC %04X  I %04X  SP %u  opcode %04X  DT %u  ST %u\n", state->PC, state->I,
+		state->SP, state->opcode, state->delay_timer, state->sound_timer
+	);
+	for (uint8_t i = 0; i < 16; i += 1) {
+		printf("V%X %02X%s", i, state->V[i], i % 8 == 7 ? "\n" : "  ");
+	}
+
+	if (state->is_mega) {
+		printf("MegaChip screen is not exported.\n");
+		return;
+	}
+
+	/* A bad segment must not make the rows read past the planes. */
+	const uint8_t width = state->width < SHARED_ROW_WORDS * 64 ? state->width
+															   : SHARED_ROW_WORDS * 64;
+	const uint8_t height = state->height < SHARED_HEIGHT ? state->height : SHARED_HEIGHT;
+
+	for (uint8_t y = 0; y < height; y += 1) {
+		char row[SHARED_ROW_WORDS * 64 + 1];
+
+		for (uint8_t x = 0; x < width; x += 1) {
+			const uint8_t word = x / 64;
+			const uint64_t bit = 1ull << (63 - x % 64);
+			const uint8_t color = ((state->gfx[0][y][word] & bit) != 0)
+								| ((state->gfx[1][y][word] & bit) != 0) << 1;
+
+			row[x] = pixels[color];
+		}
+		row[width] = '\0';
+		printf("|%s|\n", row);
+	}
+}